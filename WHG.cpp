@@ -1,1476 +1,8573 @@
-#include <iostream>
-#include <cstdlib>
-#include <ctime>
-#include <string>
-#include <chrono>
-#include <thread>
-#include <vector>
-#include <algorithm>
-#include <map>
-#include <limits>
-
-using namespace std;
-
-// ========== Utility Functions ==========
-/**
- * @brief Clears the console screen based on the operating system.
- */
-void clearScreen()
-{
-#ifdef _WIN32
-    system("cls");
-#else
-    system("clear");
-#endif
-}
-
-void animateText(const string &text, int delayMs = 50)
-{
-    for (char c : text)
-    {
-        cout << c << flush;
-        this_thread::sleep_for(chrono::milliseconds(delayMs));
-    }
-}
-
-int getValidInput(int minChoice, int maxChoice, const string &prompt = "Enter your choice: ")
-{
-    int choice;
-    while (true)
-    {
-        cout << prompt;
-        cin >> choice;
-
-        if (cin.fail() || choice < minChoice || choice > maxChoice)
-        {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Please enter a number between "
-                 << minChoice << " and " << maxChoice << ".\n";
-        }
-        else
-        {
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            return choice;
-        }
-    }
-}
-
-// ========== GameSystems ===========
-enum class StatusEffect
-{
-    NONE,
-    POISON,      // Takes damage over time
-    BLEED,       // Takes damage each turn
-    STUN,        // Skips next turn
-    STRENGTH_UP, // Increased attack
-    WEAKNESS     // Decreased attack
-};
-
-map<StatusEffect, string> statusNames = {
-    {StatusEffect::NONE, "None"},
-    {StatusEffect::POISON, "Poison"},
-    {StatusEffect::BLEED, "Bleed"},
-    {StatusEffect::STUN, "Stun"},
-    {StatusEffect::STRENGTH_UP, "Strength Up"},
-    {StatusEffect::WEAKNESS, "Weakness"}};
-
-enum class ItemType
-{
-    WEAPON,
-    ARMOR,
-    ACCESSORY,
-    POTION
-};
-
-class Potion
-{
-private:
-    string name;
-    int amount;
-    bool isHealthPotion;
-
-public:
-    Potion(string n, int a, bool health) : name(n), amount(a), isHealthPotion(health) {}
-
-    string getName() const { return name; }
-    int getAmount() const { return amount; }
-    bool isHealth() const { return isHealthPotion; }
-
-    void displayInfo() const
-    {
-        cout << "\033[1;34m" << name << "\033[0m - Restores " << amount
-             << (isHealthPotion ? " HP" : " MP") << "\n";
-    }
-};
-// ========= BaseClassItem ========
-class Item
-{
-protected:
-    string name;
-    string description;
-    ItemType type;
-    int attackBonus;
-    int healthBonus;
-    int defenseBonus;
-    int manaBonus;
-
-public:
-    Item(string n, string desc, ItemType t, int atk = 0, int hp = 0, int def = 0, int mp = 0)
-        : name(n), description(desc), type(t), attackBonus(atk), healthBonus(hp), defenseBonus(def), manaBonus(mp) {}
-
-    virtual ~Item() {}
-
-    string getName() const { return name; }
-    string getDescription() const { return description; }
-    ItemType getType() const { return type; }
-    int getAttackBonus() const { return attackBonus; }
-    int getHealthBonus() const { return healthBonus; }
-    int getDefenseBonus() const { return defenseBonus; }
-    int getManaBonus() const { return manaBonus; }
-
-    virtual void applyEffect(class Unit &unit) {}
-    virtual void displayInfo() const
-    {
-        cout << "\033[1;33m" << name << "\033[0m - " << description;
-        if (attackBonus > 0)
-            cout << " [ATK +" << attackBonus << "]";
-        if (healthBonus > 0)
-            cout << " [HP +" << healthBonus << "]";
-        if (defenseBonus > 0)
-            cout << " [DEF +" << defenseBonus << "]";
-        if (manaBonus > 0)
-            cout << " [MP +" << manaBonus << "]";
-        cout << "\n";
-    }
-};
-
-// ========= DerivedClassItem ===========
-// SpecificItemClasses
-class FireSword : public Item
-{
-public:
-    FireSword() : Item("Fire Sword", "Burns enemies with fire damage", ItemType::WEAPON, 15) {}
-    void applyEffect(class Unit &unit) override;
-};
-
-class IceShield : public Item
-{
-public:
-    IceShield() : Item("Ice Shield", "Freezes attackers occasionally", ItemType::ARMOR, 0, 20, 10) {}
-    void applyEffect(class Unit &unit) override;
-};
-
-class VampireRing : public Item
-{
-public:
-    VampireRing() : Item("Vampire Ring", "Heals user when dealing damage", ItemType::ACCESSORY, 5, 0, 0) {}
-    void applyEffect(class Unit &unit) override;
-};
-
-class PoisonDagger : public Item
-{
-public:
-    PoisonDagger() : Item("Poison Dagger", "Poisons enemies on hit", ItemType::WEAPON, 8, 0, 0) {}
-    void applyEffect(class Unit &unit) override;
-};
-
-class DragonScale : public Item
-{
-public:
-    DragonScale() : Item("Dragon Scale", "Grants fire resistance and strength", ItemType::ARMOR, 10, 30, 5) {}
-    void applyEffect(class Unit &unit) override;
-};
-
-class LightningOrb : public Item
-{
-public:
-    LightningOrb() : Item("Lightning Orb", "Chance to stun enemies", ItemType::ACCESSORY, 12, 0, 0) {}
-    void applyEffect(class Unit &unit) override;
-};
-
-class HealthPotion : public Item
-{
-public:
-    HealthPotion() : Item("Health Potion", "Restores HP", ItemType::POTION, 0, 30) {}
-    void applyEffect(class Unit &unit) override;
-};
-
-class ManaPotion : public Item
-{
-public:
-    ManaPotion() : Item("Mana Potion", "Restores MP", ItemType::POTION, 0, 0, 0, 20) {}
-    void applyEffect(class Unit &unit) override;
-};
-
-// ========== BaseClassUnit ==========
-class Unit
-{
-protected:
-    string name;
-    int maxHealth;
-    int health;
-    int maxMana;
-    int mana;
-    int baseAttack;
-    int currentAttack;
-    int defense;
-    map<StatusEffect, int> statusEffects;
-    vector<Item *> equipment;
-    vector<Potion> potions;
-    vector<string> battleLog;
-
-public:
-    Unit(string n, int hp, int mp, int atk, int def = 0)
-        : name(n), maxHealth(hp), health(hp), maxMana(mp), mana(mp),
-          baseAttack(atk), currentAttack(atk), defense(def) {}
-
-    virtual ~Unit()
-    {
-        for (Item *item : equipment)
-            delete item;
-    }
-
-    // Getters
-    string getName() const { return name; }
-    int getHealth() const { return health; }
-    int getMaxHealth() const { return maxHealth; }
-    int getMana() const { return mana; }
-    int getMaxMana() const { return maxMana; }
-    int getAttack() const { return currentAttack; }
-    int getDefense() const { return defense; }
-    bool isAlive() const { return health > 0; }
-    const vector<Potion> &getPotions() const { return potions; }
-    const vector<string> &getBattleLog() const { return battleLog; }
-    void clearBattleLog() { battleLog.clear(); }
-
-    // Item management
-    void addToBattleLog(const string &message)
-    {
-        battleLog.push_back(message);
-    }
-    void addItem(Item *item)
-    {
-        if (item->getType() == ItemType::POTION)
-        {
-            if (dynamic_cast<HealthPotion *>(item))
-            {
-                potions.push_back(Potion(item->getName(), item->getHealthBonus(), true));
-            }
-            else
-            {
-                potions.push_back(Potion(item->getName(), item->getManaBonus(), false));
-            }
-            delete item;
-        }
-        else
-        {
-            equipment.push_back(item);
-            item->applyEffect(*this);
-            battleLog.push_back(name + " equipped " + item->getName() + "!");
-        }
-    }
-
-    bool showInventory(bool &usedPotion)
-    {
-        cout << "\n=== INVENTORY ===\n";
-
-        if (equipment.empty() && potions.empty())
-        {
-            cout << "Inventory is empty.\n";
-            cout << "\nPress Enter to continue...";
-            cin.ignore();
-            cin.get();
-            return false;
-        }
-
-        if (!equipment.empty())
-        {
-            cout << "Equipment:\n";
-            for (const Item *item : equipment)
-            {
-                cout << "- ";
-                item->displayInfo();
-            }
-        }
-
-        if (!potions.empty())
-        {
-            cout << "\nPotions:\n";
-            for (size_t i = 0; i < potions.size(); i++)
-            {
-                cout << i + 1 << ". ";
-                potions[i].displayInfo();
-            }
-
-            cout << "\nEnter potion number to use (0 to cancel): ";
-            int choice = getValidInput(0, potions.size());
-
-            if (choice > 0)
-            {
-                usePotion(choice - 1);
-                usedPotion = true;
-                return true;
-            }
-        }
-        else
-        {
-            cout << "\nPress Enter to continue...";
-            cin.ignore();
-            cin.get();
-        }
-        return false;
-    }
-
-    bool usePotion(int index)
-    {
-        if (index < 0 || index >= potions.size())
-            return false;
-
-        Potion potion = potions[index];
-        if (potion.isHealth())
-        {
-            heal(potion.getAmount());
-        }
-        else
-        {
-            restoreMana(potion.getAmount());
-        }
-
-        battleLog.push_back(name + " used " + potion.getName() + "!");
-        potions.erase(potions.begin() + index);
-        return true;
-    }
-
-    // Status effects
-    void addStatus(StatusEffect effect, int duration, string source)
-    {
-        statusEffects[effect] = duration;
-        battleLog.push_back(source + " applied " + statusNames.at(effect) + " to " + name + "!");
-    }
-
-    bool hasStatus(StatusEffect effect) const
-    {
-        return statusEffects.count(effect) && statusEffects.at(effect) > 0;
-    }
-
-    void clearStatus(StatusEffect effect)
-    {
-        statusEffects.erase(effect);
-    }
-
-    void processStatusEffects()
-    {
-        vector<StatusEffect> toRemove;
-
-        for (auto &[effect, duration] : statusEffects)
-        {
-            switch (effect)
-            {
-            case StatusEffect::POISON:
-                takeDamage(5, false, "Poison");
-                break;
-            case StatusEffect::BLEED:
-                takeDamage(3, false, "Bleed");
-                break;
-            case StatusEffect::STRENGTH_UP:
-                currentAttack = baseAttack + 10;
-                break;
-            case StatusEffect::WEAKNESS:
-                currentAttack = max(1, baseAttack - 5);
-                break;
-            default:
-                break;
-            }
-
-            if (--duration <= 0)
-            {
-                toRemove.push_back(effect);
-                battleLog.push_back(name + "'s " + statusNames.at(effect) + " wore off!");
-            }
-        }
-
-        for (auto effect : toRemove)
-        {
-            statusEffects.erase(effect);
-            if (effect == StatusEffect::STRENGTH_UP || effect == StatusEffect::WEAKNESS)
-            {
-                currentAttack = baseAttack;
-            }
-        }
-    }
-
-    // Combat actions
-    void takeDamage(int dmg, bool showBlock = true, string source = "")
-    {
-        int actualDamage = max(1, dmg - defense);
-        int prevHealth = health;
-        health = max(0, health - actualDamage);
-
-        string msg = name + " took " + to_string(actualDamage) + " damage";
-        if (!source.empty())
-            msg += " from " + source;
-        msg += "! [" + to_string(prevHealth) + " -> " + to_string(health) + "/" + to_string(maxHealth) + " HP]";
-        battleLog.push_back(msg);
-
-        if (showBlock && defense > 0 && actualDamage < dmg)
-        {
-            battleLog.push_back(name + " blocked " + to_string(dmg - actualDamage) + " damage!");
-        }
-    }
-
-    void heal(int amount)
-    {
-        int oldHealth = health;
-        health = min(maxHealth, health + amount);
-        int healedAmount = health - oldHealth;
-        battleLog.push_back(name + " healed " + to_string(healedAmount) + " HP! (" + to_string(health) + "/" + to_string(maxHealth) + ")");
-    }
-
-    void restoreMana(int amount)
-    {
-        int oldMana = mana;
-        mana = min(maxMana, mana + amount);
-        int restoredAmount = mana - oldMana;
-        battleLog.push_back(name + " restored " + to_string(restoredAmount) + " MP! (" + to_string(mana) + "/" + to_string(maxMana) + ")");
-    }
-
-    void increaseMaxHealth(int amount)
-    {
-        maxHealth += amount;
-        health += amount;
-        battleLog.push_back(name + "'s max HP increased by " + to_string(amount) + "!");
-    }
-
-    void increaseMaxMana(int amount)
-    {
-        maxMana += amount;
-        mana += amount;
-        battleLog.push_back(name + "'s max MP increased by " + to_string(amount) + "!");
-    }
-
-    void increaseAttack(int amount)
-    {
-        baseAttack += amount;
-        currentAttack = baseAttack;
-        battleLog.push_back(name + "'s attack increased by " + to_string(amount) + "!");
-    }
-
-    void increaseDefense(int amount)
-    {
-        defense += amount;
-        battleLog.push_back(name + "'s defense increased by " + to_string(amount) + "!");
-    }
-
-    virtual void attack(Unit &target)
-    {
-        int targetPrevHealth = target.getHealth();
-        battleLog.push_back(name + " attacks " + target.getName() + " for " + to_string(currentAttack) + " damage!");
-        target.takeDamage(currentAttack);
-        battleLog.push_back(target.getName() + "'s HP: " + to_string(targetPrevHealth) + " -> " +
-                            to_string(target.getHealth()) + "/" + to_string(target.getMaxHealth()));
-    }
-
-    // Skills
-    virtual bool useSkill1(Unit &target) = 0;
-    virtual bool useSkill2(Unit &target) = 0;
-    virtual bool useSkill3(Unit &target) = 0;
-    virtual string getSkill1Name() const = 0;
-    virtual string getSkill2Name() const = 0;
-    virtual string getSkill3Name() const = 0;
-    virtual int getSkill1Cost() const = 0;
-    virtual int getSkill2Cost() const = 0;
-    virtual int getSkill3Cost() const = 0;
-
-    virtual void displayStatus() const
-    {
-        cout << name << " - HP: \033[1;31m" << (isAlive() ? to_string(health) : "0") << "/" << maxHealth << "\033[0m"
-             << ", MP: \033[1;34m" << mana << "/" << maxMana << "\033[0m"
-             << ", ATK: \033[1;33m" << currentAttack << "\033[0m"
-             << ", DEF: \033[1;34m" << defense << "\033[0m";
-
-        if (!statusEffects.empty())
-        {
-            cout << " [Status:";
-            for (const auto &[effect, duration] : statusEffects)
-            {
-                cout << " " << statusNames.at(effect) << "(" << duration << ")";
-            }
-            cout << "]";
-        }
-        cout << "\n";
-    }
-
-    void displayBattleLog() const
-    {
-        cout << "\n=== BATTLE LOG ===\n";
-        if (battleLog.empty())
-        {
-            cout << "No actions yet.\n";
-        }
-        else
-        {
-            for (const string &log : battleLog)
-            {
-                cout << "> " << log << "\n";
-            }
-        }
-    }
-};
-
-// Item effect implementations
-void FireSword::applyEffect(Unit &unit)
-{
-    unit.increaseAttack(attackBonus);
-}
-
-void IceShield::applyEffect(Unit &unit)
-{
-    unit.increaseMaxHealth(healthBonus);
-    unit.increaseDefense(defenseBonus);
-}
-
-void VampireRing::applyEffect(Unit &unit)
-{
-    unit.increaseAttack(attackBonus);
-}
-
-void PoisonDagger::applyEffect(Unit &unit)
-{
-    unit.increaseAttack(attackBonus);
-}
-
-void DragonScale::applyEffect(Unit &unit)
-{
-    unit.increaseAttack(attackBonus);
-    unit.increaseMaxHealth(healthBonus);
-    unit.increaseDefense(defenseBonus);
-}
-
-void LightningOrb::applyEffect(Unit &unit)
-{
-    unit.increaseAttack(attackBonus);
-}
-
-void HealthPotion::applyEffect(Unit &unit)
-{
-    unit.heal(healthBonus);
-}
-
-void ManaPotion::applyEffect(Unit &unit)
-{
-    unit.restoreMana(manaBonus);
-}
-
-// ========= DerivedClassUnit ===========
-// Class player
-class Warrior : public Unit
-{
-public:
-    Warrior(string n) : Unit(n, 120, 50, 20, 2) {}
-
-    string getSkill1Name() const override { return "Power Strike"; }
-    string getSkill2Name() const override { return "Demoralizing Shout"; }
-    string getSkill3Name() const override { return "Battle Rage"; }
-    int getSkill1Cost() const override { return 15; }
-    int getSkill2Cost() const override { return 10; }
-    int getSkill3Cost() const override { return 20; }
-
-    bool useSkill1(Unit &target) override
-    {
-        if (mana < getSkill1Cost())
-        {
-            battleLog.push_back("Not enough MP for Power Strike!");
-            return false;
-        }
-
-        mana -= getSkill1Cost();
-        int dmg = currentAttack + 25;
-        int targetPrevHealth = target.getHealth();
-        battleLog.push_back(name + " uses Power Strike on " + target.getName() + " for " + to_string(dmg) + " damage!");
-        target.takeDamage(dmg);
-        battleLog.push_back(target.getName() + "'s HP: " + to_string(targetPrevHealth) + " -> " +
-                            to_string(target.getHealth()) + "/" + to_string(target.getMaxHealth()));
-        return true;
-    }
-
-    bool useSkill2(Unit &target) override
-    {
-        if (mana < getSkill2Cost())
-        {
-            battleLog.push_back("Not enough MP for Demoralizing Shout!");
-            return false;
-        }
-
-        mana -= getSkill2Cost();
-        int targetPrevAttack = target.getAttack();
-        battleLog.push_back(name + " uses Demoralizing Shout on " + target.getName() + "!");
-        target.addStatus(StatusEffect::WEAKNESS, 3, name);
-        battleLog.push_back(target.getName() + "'s ATK: " + to_string(targetPrevAttack) + " -> " +
-                            to_string(target.getAttack()));
-        return true;
-    }
-
-    bool useSkill3(Unit &target) override
-    {
-        if (mana < getSkill3Cost())
-        {
-            battleLog.push_back("Not enough MP for Battle Rage!");
-            return false;
-        }
-
-        mana -= getSkill3Cost();
-        int prevAttack = currentAttack;
-        battleLog.push_back(name + " enters Battle Rage!");
-        addStatus(StatusEffect::STRENGTH_UP, 3, name);
-        battleLog.push_back(name + "'s ATK: " + to_string(prevAttack) + " -> " +
-                            to_string(currentAttack));
-        return true;
-    }
-};
-
-class Archer : public Unit
-{
-public:
-    Archer(string n) : Unit(n, 80, 35, 30, 1) {}
-
-    string getSkill1Name() const override { return "Poison Arrow"; }
-    string getSkill2Name() const override { return "Piercing Shot"; }
-    string getSkill3Name() const override { return "Double Shot"; }
-    int getSkill1Cost() const override { return 10; }
-    int getSkill2Cost() const override { return 15; }
-    int getSkill3Cost() const override { return 20; }
-
-    bool useSkill1(Unit &target) override
-    {
-        if (mana < getSkill1Cost())
-        {
-            battleLog.push_back("Not enough MP for Poison Arrow!");
-            return false;
-        }
-
-        mana -= getSkill1Cost();
-        int dmg = currentAttack;
-        int targetPrevHealth = target.getHealth();
-        battleLog.push_back(name + " shoots Poison Arrow at " + target.getName() + " for " + to_string(dmg) + " damage!");
-        target.takeDamage(dmg);
-        target.addStatus(StatusEffect::POISON, 3, name);
-        battleLog.push_back(target.getName() + "'s HP: " + to_string(targetPrevHealth) + " -> " +
-                            to_string(target.getHealth()) + "/" + to_string(target.getMaxHealth()));
-        return true;
-    }
-
-    bool useSkill2(Unit &target) override
-    {
-        if (mana < getSkill2Cost())
-        {
-            battleLog.push_back("Not enough MP for Piercing Shot!");
-            return false;
-        }
-
-        mana -= getSkill2Cost();
-        int dmg = currentAttack + 10;
-        int targetPrevHealth = target.getHealth();
-        battleLog.push_back(name + " uses Piercing Shot on " + target.getName() + " for " + to_string(dmg) + " damage!");
-        target.takeDamage(dmg);
-        target.addStatus(StatusEffect::BLEED, 2, name);
-        battleLog.push_back(target.getName() + "'s HP: " + to_string(targetPrevHealth) + " -> " +
-                            to_string(target.getHealth()) + "/" + to_string(target.getMaxHealth()));
-        return true;
-    }
-
-    bool useSkill3(Unit &target) override
-    {
-        if (mana < getSkill3Cost())
-        {
-            battleLog.push_back("Not enough MP for Double Shot!");
-            return false;
-        }
-
-        mana -= getSkill3Cost();
-        int targetPrevHealth = target.getHealth();
-        battleLog.push_back(name + " uses Double Shot on " + target.getName() + "!");
-        target.takeDamage(currentAttack);
-        target.takeDamage(currentAttack);
-        battleLog.push_back(target.getName() + "'s HP: " + to_string(targetPrevHealth) + " -> " +
-                            to_string(target.getHealth()) + "/" + to_string(target.getMaxHealth()));
-        return true;
-    }
-};
-
-class Mage : public Unit
-{
-public:
-    Mage(string n) : Unit(n, 70, 80, 25, 0) {}
-
-    string getSkill1Name() const override { return "Fireball"; }
-    string getSkill2Name() const override { return "Ice Nova"; }
-    string getSkill3Name() const override { return "Life Drain"; }
-    int getSkill1Cost() const override { return 20; }
-    int getSkill2Cost() const override { return 15; }
-    int getSkill3Cost() const override { return 25; }
-
-    bool useSkill1(Unit &target) override
-    {
-        if (mana < getSkill1Cost())
-        {
-            battleLog.push_back("Not enough MP for Fireball!");
-            return false;
-        }
-
-        mana -= getSkill1Cost();
-        int dmg = currentAttack + 20;
-        int targetPrevHealth = target.getHealth();
-        battleLog.push_back(name + " casts Fireball on " + target.getName() + " for " + to_string(dmg) + " damage!");
-        target.takeDamage(dmg);
-        battleLog.push_back(target.getName() + "'s HP: " + to_string(targetPrevHealth) + " -> " +
-                            to_string(target.getHealth()) + "/" + to_string(target.getMaxHealth()));
-        return true;
-    }
-
-    bool useSkill2(Unit &target) override
-    {
-        if (mana < getSkill2Cost())
-        {
-            battleLog.push_back("Not enough MP for Ice Nova!");
-            return false;
-        }
-
-        mana -= getSkill2Cost();
-        battleLog.push_back(name + " casts Ice Nova on " + target.getName() + "!");
-        target.addStatus(StatusEffect::STUN, 1, name);
-        battleLog.push_back(target.getName() + " is stunned for 1 turn!");
-        return true;
-    }
-
-    bool useSkill3(Unit &target) override
-    {
-        if (mana < getSkill3Cost())
-        {
-            battleLog.push_back("Not enough MP for Life Drain!");
-            return false;
-        }
-
-        mana -= getSkill3Cost();
-        int dmg = currentAttack + 5;
-        int targetPrevHealth = target.getHealth();
-        int prevHealth = health;
-        battleLog.push_back(name + " drains life from " + target.getName() + " for " + to_string(dmg) + " damage!");
-        target.takeDamage(dmg);
-        heal(dmg / 2);
-        battleLog.push_back(target.getName() + "'s HP: " + to_string(targetPrevHealth) + " -> " +
-                            to_string(target.getHealth()) + "/" + to_string(target.getMaxHealth()));
-        battleLog.push_back(name + "'s HP: " + to_string(prevHealth) + " -> " +
-                            to_string(health) + "/" + to_string(maxHealth));
-        return true;
-    }
-};
-// ======= DerivedClassUnit =======
-// ======= BossClass =======
-class BossUnit : public Unit
-{
-private:
-    string skillName1, skillName2, skillName3;
-    int skillCost1, skillCost2, skillCost3;
-
-public:
-    BossUnit(string n, string sk1, string sk2, string sk3, int atk, int hp, int def = 0)
-        : Unit(n, hp, 60, atk, def), skillName1(sk1), skillName2(sk2), skillName3(sk3),
-          skillCost1(15), skillCost2(20), skillCost3(25) {}
-
-    string getSkill1Name() const override { return skillName1; }
-    string getSkill2Name() const override { return skillName2; }
-    string getSkill3Name() const override { return skillName3; }
-    int getSkill1Cost() const override { return skillCost1; }
-    int getSkill2Cost() const override { return skillCost2; }
-    int getSkill3Cost() const override { return skillCost3; }
-
-    bool useSkill1(Unit &target) override
-    {
-        if (mana < skillCost1)
-        {
-            battleLog.push_back(name + " doesn't have enough MP for " + skillName1 + "!");
-            return false;
-        }
-
-        mana -= skillCost1;
-        int dmg = currentAttack + 20;
-        int targetPrevHealth = target.getHealth();
-        battleLog.push_back(name + " uses " + skillName1 + " on " + target.getName() + " for " + to_string(dmg) + " damage!");
-        target.takeDamage(dmg);
-        battleLog.push_back(target.getName() + "'s HP: " + to_string(targetPrevHealth) + " -> " +
-                            to_string(target.getHealth()) + "/" + to_string(target.getMaxHealth()));
-        return true;
-    }
-
-    bool useSkill2(Unit &target) override
-    {
-        if (mana < skillCost2)
-        {
-            battleLog.push_back(name + " doesn't have enough MP for " + skillName2 + "!");
-            return false;
-        }
-
-        mana -= skillCost2;
-        int dmg = currentAttack + 15; // Added damage component
-        int targetPrevHealth = target.getHealth();
-        battleLog.push_back(name + " uses " + skillName2 + " on " + target.getName() + " for " + to_string(dmg) + " damage!");
-        target.takeDamage(dmg);
-        target.addStatus(StatusEffect::POISON, 3, name);
-        battleLog.push_back(target.getName() + "'s HP: " + to_string(targetPrevHealth) + " -> " +
-                            to_string(target.getHealth()) + "/" + to_string(target.getMaxHealth()));
-        battleLog.push_back(target.getName() + " is poisoned for 3 turns!");
-        return true;
-    }
-
-    bool useSkill3(Unit &target) override
-    {
-        if (mana < skillCost3)
-        {
-            battleLog.push_back(name + " doesn't have enough MP for " + skillName3 + "!");
-            return false;
-        }
-
-        mana -= skillCost3;
-        int dmg = currentAttack + 10; // Added damage component
-        int targetPrevHealth = target.getHealth();
-        int prevHealth = health;
-        battleLog.push_back(name + " uses " + skillName3 + " on " + target.getName() + " for " + to_string(dmg) + " damage!");
-        target.takeDamage(dmg);
-        target.addStatus(StatusEffect::STUN, 1, name);
-        heal(20);
-        battleLog.push_back(target.getName() + "'s HP: " + to_string(targetPrevHealth) + " -> " +
-                            to_string(target.getHealth()) + "/" + to_string(target.getMaxHealth()));
-        battleLog.push_back(target.getName() + " is stunned for 1 turn!");
-        battleLog.push_back(name + "'s HP: " + to_string(prevHealth) + " -> " +
-                            to_string(health) + "/" + to_string(maxHealth));
-        return true;
-    }
-
-    void attack(Unit &target) override
-    {
-        int targetPrevHealth = target.getHealth();
-        battleLog.push_back(name + " attacks " + target.getName() + " for " + to_string(currentAttack) + " damage!");
-        target.takeDamage(currentAttack);
-        battleLog.push_back(target.getName() + "'s HP: " + to_string(targetPrevHealth) + " -> " +
-                            to_string(target.getHealth()) + "/" + to_string(target.getMaxHealth()));
-    }
-
-    void displayStatus() const override
-    {
-        cout << "\033[1;31m"; // Red color for boss
-        Unit::displayStatus();
-        cout << "\033[0m";
-    }
-};
-
-// ========== Game Functions ==========
-bool coinFlip()
-{
-    cout << "\n=== COIN FLIP TO DETERMINE TURN ORDER ===\n";
-    cout << "Choose: 1. Heads  2. Tails\n";
-
-    int choice = getValidInput(1, 2, "Your choice: ");
-    bool coinResult = (rand() % 2 == 0);
-    string coinName = coinResult ? "Heads" : "Tails";
-
-    cout << "\nFlipping coin...\n";
-    this_thread::sleep_for(chrono::seconds(1));
-    cout << "Result: " << coinName << "!\n";
-
-    bool playerWon = (choice == 1 && coinResult) || (choice == 2 && !coinResult);
-
-    if (playerWon)
-    {
-        cout << "\033[1;32mYou won the coin flip! You go first!\033[0m\n";
-    }
-    else
-    {
-        cout << "\033[1;31mYou lost the coin flip! Enemy goes first!\033[0m\n";
-    }
-
-    this_thread::sleep_for(chrono::seconds(2));
-    return playerWon;
-}
-
-void showSkillsMenu(Unit *player, Unit *target)
-{
-    cout << "\n=== SKILLS MENU ===\n";
-    cout << "1. " << player->getSkill1Name() << " (Cost: " << player->getSkill1Cost() << " MP)\n";
-    cout << "2. " << player->getSkill2Name() << " (Cost: " << player->getSkill2Cost() << " MP)\n";
-    cout << "3. " << player->getSkill3Name() << " (Cost: " << player->getSkill3Cost() << " MP)\n";
-
-    int skillChoice = getValidInput(1, 3, "Choose skill (1-3): ");
-
-    bool skillUsed = false;
-    switch (skillChoice)
-    {
-    case 1:
-        skillUsed = player->useSkill1(*target);
-        break;
-    case 2:
-        skillUsed = player->useSkill2(*target);
-        break;
-    case 3:
-        skillUsed = player->useSkill3(*target);
-        break;
-    }
-
-    if (!skillUsed)
-    {
-        cout << "Using basic attack instead.\n";
-        player->attack(*target);
-    }
-}
-
-vector<Item *> generateRandomItems()
-{
-    vector<Item *> allItems = {
-        new FireSword(),
-        new IceShield(),
-        new VampireRing(),
-        new PoisonDagger(),
-        new DragonScale(),
-        new LightningOrb()};
-
-    vector<Item *> selectedItems;
-    vector<int> usedIndices;
-
-    // Select 3 random items
-    for (int i = 0; i < 3; i++)
-    {
-        int randomIndex;
-        do
-        {
-            randomIndex = rand() % allItems.size();
-        } while (find(usedIndices.begin(), usedIndices.end(), randomIndex) != usedIndices.end());
-
-        usedIndices.push_back(randomIndex);
-        selectedItems.push_back(allItems[randomIndex]);
-    }
-
-    // Clean up unused items
-    for (int i = 0; i < allItems.size(); i++)
-    {
-        if (find(usedIndices.begin(), usedIndices.end(), i) == usedIndices.end())
-        {
-            delete allItems[i];
-        }
-    }
-
-    return selectedItems;
-}
-
-vector<Item *> generateRandomPotions()
-{
-    vector<Item *> potions;
-    int numPotions = rand() % 3 + 1; // 1-3 potions
-
-    for (int i = 0; i < numPotions; i++)
-    {
-        if (rand() % 2 == 0)
-        {
-            potions.push_back(new HealthPotion());
-        }
-        else
-        {
-            potions.push_back(new ManaPotion());
-        }
-    }
-
-    return potions;
-}
-
-Unit *createPlayer(const string &playerName)
-{
-    cout << "\nSelect a class for " << playerName << ":\n"
-         << "1. Warrior (High HP, Medium MP, Physical skills)\n"
-         << "2. Archer (Medium HP, Poison/Bleed skills)\n"
-         << "3. Mage (Low HP, High MP, Magic skills)\n";
-
-    int choice = getValidInput(1, 3, "Choose (1-3): ");
-
-    switch (choice)
-    {
-    case 1:
-        return new Warrior(playerName);
-    case 2:
-        return new Archer(playerName);
-    case 3:
-        return new Mage(playerName);
-    default:
-        return new Warrior(playerName);
-    }
-}
-
-void displayBattleHeader(int stage, Unit *player, Unit *boss)
-{
-    cout << "========================================\n";
-    cout << "| STAGE " << stage << " BATTLE";
-    cout << string(30 - to_string(stage).length(), ' ') << "|\n";
-    cout << "========================================\n";
-
-    cout << "\n=== YOUR STATUS ===\n";
-    player->displayStatus();
-
-    cout << "\n=== ENEMY STATUS ===\n";
-    boss->displayStatus();
-    cout << "\n";
-}
-
-void gameLoop(Unit *player)
-{
-    const vector<string> bossNames = {
-        "Goblin King", "Shadow Knight", "Crimson Wraith",
-        "Lich Queen", "Doom Reaper"};
-
-    const vector<string> bossSkill1 = {
-        "Goblin Smash", "Shadow Blade", "Crimson Slash",
-        "Necroflame", "Void Strike"};
-
-    const vector<string> bossSkill2 = {
-        "Poison Cloud", "Dark Mist", "Blood Curse",
-        "Soul Drain", "Void Corruption"};
-
-    const vector<string> bossSkill3 = {
-        "Stunning Roar", "Shadow Bind", "Crimson Howl",
-        "Necrotic Heal", "Void Stasis"};
-
-    for (int stage = 1; stage <= 5; ++stage)
-    {
-        // Create boss
-        int bossIndex = stage - 1;
-        BossUnit *boss = new BossUnit(
-            bossNames[bossIndex],
-            bossSkill1[bossIndex],
-            bossSkill2[bossIndex],
-            bossSkill3[bossIndex],
-            10 + stage * 5,
-            70 + stage * 20,
-            stage - 1);
-
-        cout << "\n--- ENEMY APPEARED ---\n";
-        boss->displayStatus();
-
-        // Coin flip for turn order
-        bool playerFirst = coinFlip();
-
-        // Combat loop
-        while (player->isAlive() && boss->isAlive())
-        {
-            clearScreen();
-            displayBattleHeader(stage, player, boss);
-
-            // Display combined battle log
-            player->displayBattleLog();
-            player->clearBattleLog();
-            boss->clearBattleLog();
-
-            if (playerFirst)
-            {
-                // Player turn
-                if (player->hasStatus(StatusEffect::STUN))
-                {
-                    player->addToBattleLog("\033[1;35mYou are stunned and skip your turn!\033[0m");
-                    player->clearStatus(StatusEffect::STUN);
-                }
-                else
-                {
-                    player->addToBattleLog("\n=== YOUR TURN ===");
-                    cout << "\n=== YOUR TURN ===\n";
-                    cout << "1. Attack\n2. Use Skills\n3. Inventory\n4. Pass\n";
-
-                    int action = getValidInput(1, 4, "Choose action: ");
-                    bool usedPotion = false;
-
-                    switch (action)
-                    {
-                    case 1:
-                        player->attack(*boss);
-                        break;
-                    case 2:
-                        showSkillsMenu(player, boss);
-                        break;
-                    case 3:
-                        if (player->showInventory(usedPotion))
-                        {
-                            player->processStatusEffects();
-                            this_thread::sleep_for(chrono::seconds(1));
-                            continue;
-                        }
-                        break;
-                    case 4:
-                        player->addToBattleLog("You pass your turn.");
-                        cout << "You pass your turn.\n";
-                        break;
-                    }
-                }
-
-                player->processStatusEffects();
-                if (!boss->isAlive())
-                    break;
-
-                // Boss turn
-                player->addToBattleLog("\n=== " + boss->getName() + "'s TURN ===");
-                cout << "\n=== " << boss->getName() << "'s TURN ===\n";
-                this_thread::sleep_for(chrono::milliseconds(800));
-
-                if (boss->hasStatus(StatusEffect::STUN))
-                {
-                    player->addToBattleLog("\033[1;35m" + boss->getName() + " is stunned and skips turn!\033[0m");
-                    cout << "\033[1;35m" << boss->getName() << " is stunned and skips turn!\033[0m\n";
-                    boss->clearStatus(StatusEffect::STUN);
-                }
-                else
-                {
-                    int bossAction = rand() % 4;
-                    string actionDesc = "";
-
-                    if (bossAction == 3)
-                    {
-                        actionDesc = boss->getName() + " chooses to attack!";
-                        player->addToBattleLog(actionDesc);
-                        cout << actionDesc << endl;
-                        boss->attack(*player);
-                    }
-                    else
-                    {
-                        switch (bossAction)
-                        {
-                        case 0:
-                            actionDesc = boss->getName() + " uses " + boss->getSkill1Name() + "!";
-                            player->addToBattleLog(actionDesc);
-                            cout << actionDesc << endl;
-                            boss->useSkill1(*player);
-                            break;
-                        case 1:
-                            actionDesc = boss->getName() + " uses " + boss->getSkill2Name() + "!";
-                            player->addToBattleLog(actionDesc);
-                            cout << actionDesc << endl;
-                            boss->useSkill2(*player);
-                            break;
-                        case 2:
-                            actionDesc = boss->getName() + " uses " + boss->getSkill3Name() + "!";
-                            player->addToBattleLog(actionDesc);
-                            cout << actionDesc << endl;
-                            boss->useSkill3(*player);
-                            break;
-                        }
-                    }
-                }
-
-                boss->processStatusEffects();
-            }
-            else // Boss goes first
-            {
-                // Boss turn
-                player->addToBattleLog("\n=== " + boss->getName() + "'s TURN ===");
-                cout << "\n=== " << boss->getName() << "'s TURN ===\n";
-                this_thread::sleep_for(chrono::milliseconds(800));
-
-                if (boss->hasStatus(StatusEffect::STUN))
-                {
-                    player->addToBattleLog("\033[1;35m" + boss->getName() + " is stunned and skips turn!\033[0m");
-                    cout << "\033[1;35m" << boss->getName() << " is stunned and skips turn!\033[0m\n";
-                    boss->clearStatus(StatusEffect::STUN);
-                }
-                else
-                {
-                    int bossAction = rand() % 4;
-                    string actionDesc = "";
-
-                    if (bossAction == 3)
-                    {
-                        actionDesc = boss->getName() + " chooses to attack!";
-                        player->addToBattleLog(actionDesc);
-                        cout << actionDesc << endl;
-                        boss->attack(*player);
-                    }
-                    else
-                    {
-                        switch (bossAction)
-                        {
-                        case 0:
-                            actionDesc = boss->getName() + " uses " + boss->getSkill1Name() + "!";
-                            player->addToBattleLog(actionDesc);
-                            cout << actionDesc << endl;
-                            boss->useSkill1(*player);
-                            break;
-                        case 1:
-                            actionDesc = boss->getName() + " uses " + boss->getSkill2Name() + "!";
-                            player->addToBattleLog(actionDesc);
-                            cout << actionDesc << endl;
-                            boss->useSkill2(*player);
-                            break;
-                        case 2:
-                            actionDesc = boss->getName() + " uses " + boss->getSkill3Name() + "!";
-                            player->addToBattleLog(actionDesc);
-                            cout << actionDesc << endl;
-                            boss->useSkill3(*player);
-                            break;
-                        }
-                    }
-                }
-
-                boss->processStatusEffects();
-
-                // Immediately update display after boss action
-                clearScreen();
-                displayBattleHeader(stage, player, boss);
-                player->displayBattleLog();
-                player->clearBattleLog();
-                boss->clearBattleLog();
-
-                if (!player->isAlive())
-                {
-                    clearScreen();
-                    displayBattleHeader(stage, player, boss);
-                    cout << "\n\033[1;31mYou were defeated in stage " << stage << "!\033[0m\n";
-                    delete boss;
-                    return;
-                }
-
-                // Player turn
-                if (player->hasStatus(StatusEffect::STUN))
-                {
-                    player->addToBattleLog("\033[1;35mYou are stunned and skip your turn!\033[0m");
-                    cout << "\033[1;35mYou are stunned and skip your turn!\033[0m\n";
-                    player->clearStatus(StatusEffect::STUN);
-                }
-                else
-                {
-                    player->addToBattleLog("\n=== YOUR TURN ===");
-                    cout << "\n=== YOUR TURN ===\n";
-                    cout << "1. Attack\n2. Use Skills\n3. Inventory\n4. Pass\n";
-
-                    int action = getValidInput(1, 4, "Choose action: ");
-                    bool usedPotion = false;
-
-                    switch (action)
-                    {
-                    case 1:
-                        player->attack(*boss);
-                        break;
-                    case 2:
-                        showSkillsMenu(player, boss);
-                        break;
-                    case 3:
-                        if (player->showInventory(usedPotion))
-                        {
-                            player->processStatusEffects();
-                            this_thread::sleep_for(chrono::seconds(1));
-                            continue;
-                        }
-                        break;
-                    case 4:
-                        player->addToBattleLog("You pass your turn.");
-                        cout << "You pass your turn.\n";
-                        break;
-                    }
-                }
-
-                player->processStatusEffects();
-            }
-
-            this_thread::sleep_for(chrono::seconds(1));
-        }
-
-        if (!player->isAlive())
-        {
-            clearScreen();
-            displayBattleHeader(stage, player, boss);
-            cout << "\n\033[1;31mYou were defeated in stage " << stage << "!\033[0m\n";
-            delete boss;
-            break;
-        }
-
-        // Boss defeated
-        clearScreen();
-        displayBattleHeader(stage, player, boss);
-        cout << "\n\033[1;32mYou defeated " << boss->getName() << "!\033[0m\n";
-
-        // Drop random potions
-        vector<Item *> droppedPotions = generateRandomPotions();
-        for (Item *potion : droppedPotions)
-        {
-            player->addItem(potion);
-        }
-
-        delete boss;
-
-        if (stage < 5)
-        {
-            // Stage upgrade system
-            cout << "\n=== STAGE COMPLETE! CHOOSE UPGRADE ===\n";
-            cout << "1. Heal (+30 HP)\n";
-            cout << "2. Restore Mana (+20 MP)\n";
-            cout << "3. Increase Attack (+5 ATK)\n";
-            cout << "4. Increase Defense (+3 DEF)\n";
-
-            int upgrade = getValidInput(1, 4, "Choose (1-4): ");
-
-            switch (upgrade)
-            {
-            case 1:
-                player->heal(30);
-                break;
-            case 2:
-                player->restoreMana(20);
-                break;
-            case 3:
-                player->increaseAttack(5);
-                break;
-            case 4:
-                player->increaseDefense(3);
-                break;
-            }
-
-            // Item selection system
-            cout << "\n=== ITEM SELECTION ===\n";
-            cout << "Choose 1 item from the following 3 options:\n";
-
-            vector<Item *> itemChoices = generateRandomItems();
-
-            for (int i = 0; i < itemChoices.size(); i++)
-            {
-                cout << (i + 1) << ". ";
-                itemChoices[i]->displayInfo();
-            }
-
-            int itemChoice = getValidInput(1, 3, "Choose item (1-3): ");
-
-            player->addItem(itemChoices[itemChoice - 1]);
-
-            // Clean up other items
-            for (int i = 0; i < itemChoices.size(); i++)
-            {
-                if (i != itemChoice - 1)
-                    delete itemChoices[i];
-            }
-
-            this_thread::sleep_for(chrono::seconds(2));
-        }
-    }
-
-    if (player->isAlive())
-    {
-        cout << "\n\033[1;32m=== CONGRATULATIONS! ===\033[0m\n";
-        cout << "\033[1;33mYou defeated all bosses and conquered the dungeon!\033[0m\n";
-        cout << "\n=== FINAL STATUS ===\n";
-        player->displayStatus();
-    }
-
-    delete player;
-}
-
-// ========== UI Functions ==========
-void printLogo()
-{
-    cout << "\033[1;35m";
-    cout << R"(
-__        __  _    _  _____
-\ \      / //| |  | |/ ____|
- \ \ /\ / /  | |__| || |  __
-  \ V  V /   |  __  || | |_ |
-   \_/\_/    |_|  |_| \_____|
-             |_|  |_| \_____|
-)" << '\n';
-    cout << "\033[0m";
-}
-
-void showIntro()
-{
-    clearScreen();
-    animateText("\nInitializing Wave HG Universe...\n", 30);
-    this_thread::sleep_for(chrono::milliseconds(800));
-    clearScreen();
-    for (int i = 0; i < 3; i++)
-    {
-        cout << "\n\n\n\n";
-        this_thread::sleep_for(chrono::milliseconds(200));
-        clearScreen();
-    }
-    printLogo();
-    animateText("\nText base game\n\n", 40);
-    this_thread::sleep_for(chrono::seconds(2));
-}
-
-void showMainMenu()
-{
-    clearScreen();
-    printLogo();
-    animateText("\nWelcome to Wave Hunger Game Turn Based RPG!\n\n");
-    cout << "1. Start New Game\n2. How to Play\n3. Exit\n";
-}
-
-void showHowToPlay()
-{
-    clearScreen();
-    printLogo();
-    animateText("WELCOME TO Wave Hunger Game Turn Based RPG!\n\n");
-
-    animateText("HOW TO PLAY: \n", 10);
-    animateText("- Choose your class: Warrior, Archer, or Mage\n", 10);
-    animateText("- Battle against bosses in turn-based combat\n", 10);
-    animateText("- Use normal attacks or powerful skills (consume MP)\n", 10);
-    animateText("- Use inventory items to recover HP or MP\n", 10);
-    animateText("- Win by defeating all 5 bosses!\n\n", 10);
-
-    animateText("KEY SYSTEMS:\n"), 10;
-    animateText("- Coin flip determines turn order each battle\n", 10);
-    animateText("- Upgrade system: Choose buffs after each win (Heal, MP, ATK, DEF)\n", 10);
-    animateText("- Loot system: Pick 1 of 3 random powerful items\n", 10);
-    animateText("- Status effects like Poison, Bleed, Stun add strategy\n\n", 10);
-
-    animateText("GOOD LUCK, HERO!\n");
-
-    animateText("Press Enter to return to main menu...");
-    cin.ignore();
-    cin.get();
-}
-
-int main()
-{
-    srand(time(0));
-    showIntro();
-
-    while (true)
-    {
-        showMainMenu();
-        int choice = getValidInput(1, 3, "Choose (1-3): ");
-
-        switch (choice)
-        {
-        case 1:
-        {
-            clearScreen();
-            printLogo();
-            string playerName;
-            animateText("\nEnter your hero's name: ");
-            getline(cin, playerName);
-
-            Unit *player = createPlayer(playerName);
-            clearScreen();
-            printLogo();
-            animateText("\nPreparing for battle...\n");
-            this_thread::sleep_for(chrono::seconds(1));
-
-            gameLoop(player);
-
-            animateText("\nPress Enter to return to main menu...");
-            cin.ignore();
-            cin.get();
-            break;
-        }
-        case 2:
-            showHowToPlay();
-            break;
-        case 3:
-            clearScreen();
-            printLogo();
-            animateText("\nThanks for playing Wave Hunger Game Turn Based RPG!\n");
-            animateText("May your adventures continue...\n");
-            return 0;
-        }
-    }
-}
\ No newline at end of file
+#include <iostream>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <string_view>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <cstdint>
+#include <atomic>
+#include <random>
+#include <memory_resource>
+#include <memory>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <coroutine>
+#include <queue>
+#include <deque>
+#include <functional>
+#include <utility>
+#include <fstream>
+#include <iterator>
+#include <cstddef>
+#include <cstdio>
+#include <type_traits>
+#include <map>
+#include <iomanip>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004 // Missing from older SDK headers
+#endif
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+using namespace std;
+
+// ========== Phase Metrics ==========
+#ifndef WHG_PHASE_METRICS
+#define WHG_PHASE_METRICS 1 // Build with -DWHG_PHASE_METRICS=0 to compile every phase timer out
+#endif
+
+/*
+ * Where a session's time goes. Phases nest: a blocking player turn includes
+ * the input wait inside it, and a boss turn its pause. Coroutine sessions
+ * count the time they spend suspended on input or on a pause as
+ * input_wait / sleep, so idle remote players show up there.
+ */
+enum class Phase : uint8_t
+{
+    INPUT_WAIT,
+    SLEEP,
+    RENDER,
+    PLAYER_TURN,
+    BOSS_TURN,
+    WAVE_TURN,
+    STATUS,
+    REWARD
+};
+
+constexpr int PHASE_COUNT = 8;
+constexpr const char *phaseNames[PHASE_COUNT] = {"input_wait", "sleep",     "render", "player_turn",
+                                                 "boss_turn",  "wave_turn", "status", "reward"};
+
+// Off unless metrics were asked for, so simulations pay a single branch per timer
+bool phaseMetricsEnabled = false;
+
+/**
+ * @brief Calls and clock ticks per Phase of one thread. Only the owning
+ * thread writes (relaxed load and store, no locked instruction); exporters
+ * may read any thread's slot at any time.
+ */
+struct PhaseCounters
+{
+    atomic<uint64_t> calls[PHASE_COUNT];
+    atomic<uint64_t> ticks[PHASE_COUNT];
+
+    void add(Phase phase, uint64_t elapsed)
+    {
+        int i = (int)phase;
+        calls[i].store(calls[i].load(memory_order_relaxed) + 1, memory_order_relaxed);
+        ticks[i].store(ticks[i].load(memory_order_relaxed) + elapsed, memory_order_relaxed);
+    }
+};
+
+// Every thread's slot, kept after the thread exits so its totals still count
+mutex phaseSlotsLock;
+vector<unique_ptr<PhaseCounters>> phaseSlots;
+
+PhaseCounters &localPhaseCounters()
+{
+    thread_local PhaseCounters *mine = []
+    {
+        lock_guard<mutex> guard(phaseSlotsLock);
+        phaseSlots.push_back(make_unique<PhaseCounters>());
+        return phaseSlots.back().get();
+    }();
+    return *mine;
+}
+
+// Raw ticks: the TSC on x86 (constant-rate on anything recent), steady_clock nanoseconds elsewhere
+uint64_t readPhaseTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Tick and clock readings when metrics were enabled, to convert ticks into seconds on export
+uint64_t phaseEpochTicks = 0;
+chrono::steady_clock::time_point phaseEpoch;
+
+void enablePhaseMetrics()
+{
+    phaseMetricsEnabled = true;
+    phaseEpoch = chrono::steady_clock::now();
+    phaseEpochTicks = readPhaseTicks();
+}
+
+double phaseSecondsPerTick()
+{
+    uint64_t ticks = readPhaseTicks() - phaseEpochTicks;
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - phaseEpoch;
+    return ticks > 0 ? elapsed.count() / ticks : 0.0;
+}
+
+// Ticks at a phase start, or 0 when metrics are off
+uint64_t phaseClock()
+{
+#if WHG_PHASE_METRICS
+    if (phaseMetricsEnabled)
+        return readPhaseTicks();
+#endif
+    return 0;
+}
+
+// Charges the time since `start` (from phaseClock) to `phase`
+#if WHG_PHASE_METRICS
+void recordPhaseSince(Phase phase, uint64_t start)
+{
+    if (start != 0)
+        localPhaseCounters().add(phase, phaseClock() - start);
+}
+#else
+void recordPhaseSince(Phase, uint64_t) {}
+#endif
+
+// Times the enclosing scope as one call of `phase`
+class PhaseTimer
+{
+private:
+#if WHG_PHASE_METRICS
+    Phase phase;
+    uint64_t start;
+#endif
+
+public:
+#if WHG_PHASE_METRICS
+    explicit PhaseTimer(Phase timed) : phase(timed), start(phaseClock()) {}
+    ~PhaseTimer() { recordPhaseSince(phase, start); }
+#else
+    explicit PhaseTimer(Phase) {}
+#endif
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+};
+
+/**
+ * @brief All threads' totals as Prometheus text exposition, or as JSON.
+ */
+string formatPhaseMetrics(bool json)
+{
+    uint64_t calls[PHASE_COUNT] = {};
+    double seconds[PHASE_COUNT] = {};
+    double secondsPerTick = phaseSecondsPerTick();
+    {
+        lock_guard<mutex> guard(phaseSlotsLock);
+        for (const unique_ptr<PhaseCounters> &slot : phaseSlots)
+        {
+            for (int i = 0; i < PHASE_COUNT; i++)
+            {
+                calls[i] += slot->calls[i].load(memory_order_relaxed);
+                seconds[i] += slot->ticks[i].load(memory_order_relaxed) * secondsPerTick;
+            }
+        }
+    }
+
+    ostringstream out;
+    if (json)
+    {
+        out << "{\"phases\":{";
+        for (int i = 0; i < PHASE_COUNT; i++)
+            out << (i ? "," : "") << "\"" << phaseNames[i] << "\":{\"calls\":" << calls[i]
+                << ",\"seconds\":" << seconds[i] << "}";
+        out << "}}\n";
+        return out.str();
+    }
+
+    out << "# HELP whg_phase_calls_total Times each game phase ran.\n"
+        << "# TYPE whg_phase_calls_total counter\n";
+    for (int i = 0; i < PHASE_COUNT; i++)
+        out << "whg_phase_calls_total{phase=\"" << phaseNames[i] << "\"} " << calls[i] << "\n";
+    out << "# HELP whg_phase_seconds_total Wall time spent in each game phase.\n"
+        << "# TYPE whg_phase_seconds_total counter\n";
+    for (int i = 0; i < PHASE_COUNT; i++)
+        out << "whg_phase_seconds_total{phase=\"" << phaseNames[i] << "\"} " << seconds[i] << "\n";
+    return out.str();
+}
+
+/**
+ * @brief Writes the metrics to `path`, as JSON when it ends in ".json" and
+ * as Prometheus text otherwise. The file is replaced atomically, so a
+ * scraper (e.g. a textfile collector) never reads half of it.
+ */
+bool writePhaseMetrics(const string &path)
+{
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    string temporary = path + ".tmp";
+    {
+        ofstream file(temporary, ios::trunc);
+        file << formatPhaseMetrics(json);
+        if (!file)
+            return false;
+    }
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+// ========== Utility Functions ==========
+/**
+ * @brief Clears the console screen with ANSI escapes (no shell process).
+ */
+void clearScreen()
+{
+    cout << "\033[2J\033[H" << flush;
+}
+
+/**
+ * @brief Lets the Windows console interpret the ANSI escapes every screen
+ * uses; legacy consoles print them literally until asked. No-op elsewhere.
+ */
+void enableAnsiEscapes()
+{
+#ifdef _WIN32
+    HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode = 0;
+    if (console != INVALID_HANDLE_VALUE && GetConsoleMode(console, &mode))
+        SetConsoleMode(console, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+#endif
+}
+
+const int ANIMATION_FRAME_MS = 16; // Characters due within one frame are written together
+const int TURBO_DELAY_PERCENT = 10; // Default speed of turbo mode
+
+// Scale applied to every animation and pause: 100 = normal, 0 = never wait (turbo mode)
+int delayPercent = 100;
+
+int scaledDelay(int delayMs) { return delayMs * delayPercent / 100; }
+
+void waitFor(int delayMs)
+{
+    int scaled = scaledDelay(delayMs);
+    if (scaled > 0)
+    {
+        PhaseTimer timer(Phase::SLEEP);
+        this_thread::sleep_for(chrono::milliseconds(scaled));
+    }
+}
+
+void animateText(const string &text, int delayMs = 50)
+{
+    delayMs = scaledDelay(delayMs);
+    if (delayMs <= 0)
+    {
+        cout << text << flush;
+        return;
+    }
+
+    string pending;
+    int pendingMs = 0;
+    for (char c : text)
+    {
+        pending += c;
+        pendingMs += delayMs;
+        if (pendingMs >= ANIMATION_FRAME_MS)
+        {
+            cout << pending << flush;
+            this_thread::sleep_for(chrono::milliseconds(pendingMs));
+            pending.clear();
+            pendingMs = 0;
+        }
+    }
+    cout << pending << flush;
+    this_thread::sleep_for(chrono::milliseconds(pendingMs));
+}
+
+// Height of the terminal on stdout, or 0 when it cannot be determined
+int terminalRows()
+{
+#ifdef __linux__
+    winsize size = {};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0)
+        return size.ws_row;
+#endif
+    return 0;
+}
+
+/**
+ * @brief Double-buffered full-screen renderer.
+ *
+ * Frames are composed off-screen into a string. present() compares them
+ * line by line with the frame already on screen and writes only the changed
+ * lines, positioned with ANSI cursor moves, in a single write. Whatever was
+ * printed below the previous frame (menus, prompts) is wiped.
+ */
+class FrameRenderer
+{
+private:
+    vector<string> shown; // Lines currently on screen
+    bool valid = false;   // False until the screen holds a frame drawn by us
+
+    /**
+     * @brief Where `next` stops matching `prev`, backed up to the start of
+     * any escape sequence it cuts. `column` gets that point's screen column
+     * and `colors` the SGR codes in effect there.
+     * @return npos (redraw the line) if the shared part has non-ASCII text,
+     * whose width on screen is unknown
+     */
+    static size_t unchangedPrefix(const string &prev, const string &next, size_t &column, string &colors)
+    {
+        size_t common = mismatch(prev.begin(), prev.begin() + min(prev.size(), next.size()), next.begin()).first -
+                        prev.begin();
+        column = 0;
+        colors.clear();
+        size_t i = 0;
+        while (i < common)
+        {
+            if (next[i] == '\033')
+            {
+                size_t end = next.find_first_of("ABCDEFGHJKSTfmnsu", i + 1);
+                if (end == string::npos || end >= common)
+                    break;
+                string sequence = next.substr(i, end + 1 - i);
+                if (sequence == "\033[0m")
+                    colors.clear();
+                else if (next[end] == 'm')
+                    colors += sequence;
+                i = end + 1;
+                continue;
+            }
+            if ((unsigned char)next[i] >= 0x80)
+                return string::npos;
+            column++;
+            i++;
+        }
+        return i;
+    }
+
+public:
+    /** @brief Forces the next frame to repaint the whole screen. */
+    void invalidate() { valid = false; }
+
+    void present(const string &frame, ostream &out)
+    {
+        vector<string> lines;
+        size_t start = 0, newline;
+        while ((newline = frame.find('\n', start)) != string::npos)
+        {
+            lines.push_back(frame.substr(start, newline - start));
+            start = newline + 1;
+        }
+        if (start < frame.size())
+            lines.push_back(frame.substr(start));
+
+        // A frame as tall as the terminal scrolls it, so its row numbers are stale
+        int rows = terminalRows();
+        if (rows > 0 && (int)max(shown.size(), lines.size()) >= rows)
+            valid = false;
+
+        string buffer = valid ? "" : "\033[2J";
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            size_t from = 0, column = 0;
+            string colors;
+            if (valid && i < shown.size())
+            {
+                if (shown[i] == lines[i])
+                    continue;
+                // Rewrite only from the first changed character, e.g. the one HP value that moved
+                from = unchangedPrefix(shown[i], lines[i], column, colors);
+                if (from == string::npos)
+                    from = column = 0, colors.clear();
+            }
+            buffer += "\033[" + to_string(i + 1) + ";" + to_string(column + 1) + "H\033[0m" + colors;
+            buffer.append(lines[i], from);
+            buffer += "\033[K";
+        }
+        buffer += "\033[0m\033[" + to_string(lines.size() + 1) + ";1H\033[J";
+
+        out.write(buffer.data(), buffer.size());
+        out.flush();
+        shown = move(lines);
+        valid = true;
+    }
+};
+
+/**
+ * @brief Where console input comes from: the lines of a --script file
+ * first, then the terminal. Several choices on one line ("1 2 3 2 1")
+ * answer that many prompts in a row, so a whole turn (or game) can be
+ * sent at once.
+ */
+struct ConsoleInput
+{
+    deque<string> scriptLines;
+    deque<string> typedAhead; // Choices left over from the last line, for the next prompts
+};
+
+ConsoleInput consoleInput;
+
+// Splits a line into whitespace-separated choices at the back of `queue`
+void queueChoices(deque<string> &queue, const string &line)
+{
+    istringstream words(line);
+    string word;
+    while (words >> word)
+        queue.push_back(move(word));
+}
+
+// The leading number of a choice, if it is one in [minChoice, maxChoice]
+bool parseChoice(const string &text, int minChoice, int maxChoice, int &choice)
+{
+    char *end = nullptr;
+    long value = strtol(text.c_str(), &end, 10);
+    if (end == text.c_str() || value < minChoice || value > maxChoice)
+        return false;
+    choice = (int)value;
+    return true;
+}
+
+/**
+ * @brief Next line of console input; script lines are echoed, since
+ * nobody typed them.
+ * @return false once both the script and the terminal are exhausted
+ */
+bool readConsoleLine(string &line)
+{
+    if (!consoleInput.scriptLines.empty())
+    {
+        line = move(consoleInput.scriptLines.front());
+        consoleInput.scriptLines.pop_front();
+        cout << line << "\n";
+        return true;
+    }
+    return (bool)getline(cin, line);
+}
+
+bool hasQueuedInput() { return !consoleInput.typedAhead.empty() || !consoleInput.scriptLines.empty(); }
+
+// Next typed-ahead word (echoed) if there is one, otherwise a whole line
+bool readConsoleText(string &text)
+{
+    if (consoleInput.typedAhead.empty())
+        return readConsoleLine(text);
+    text = move(consoleInput.typedAhead.front());
+    consoleInput.typedAhead.pop_front();
+    cout << text << "\n";
+    return true;
+}
+
+// "Press Enter": waits for a line, unless the player has already sent what comes next
+void waitForEnter()
+{
+    PhaseTimer timer(Phase::INPUT_WAIT);
+    string line;
+    if (!hasQueuedInput())
+        readConsoleLine(line);
+}
+
+int getValidInput(int minChoice, int maxChoice, const string &prompt = "Enter your choice: ")
+{
+    PhaseTimer timer(Phase::INPUT_WAIT);
+    cout << prompt;
+    while (true)
+    {
+        string text;
+        bool typedAhead = !consoleInput.typedAhead.empty();
+        if (typedAhead)
+        {
+            text = move(consoleInput.typedAhead.front());
+            consoleInput.typedAhead.pop_front();
+            cout << text << "\n";
+        }
+        else
+        {
+            string line;
+            if (!readConsoleLine(line))
+            {
+                cout << "\nInput closed.\n";
+                exit(0);
+            }
+            queueChoices(consoleInput.typedAhead, line);
+            if (consoleInput.typedAhead.empty())
+                continue; // A blank line; keep waiting
+            text = move(consoleInput.typedAhead.front());
+            consoleInput.typedAhead.pop_front();
+        }
+
+        int choice;
+        if (parseChoice(text, minChoice, maxChoice, choice))
+            return choice;
+
+        // The rest was sent for prompts that will now come in a different order
+        consoleInput.typedAhead.clear();
+        cout << "Invalid input! Please enter a number between "
+             << minChoice << " and " << maxChoice << ".\n" << prompt;
+    }
+}
+
+// ========== GameSystems ===========
+enum class StatusEffect
+{
+    NONE,
+    POISON,      // Takes damage over time
+    BLEED,       // Takes damage each turn
+    STUN,        // Skips next turn
+    STRENGTH_UP, // Increased attack
+    WEAKNESS     // Decreased attack
+};
+
+constexpr int STATUS_COUNT = 6;
+
+// Indexed by StatusEffect
+constexpr string_view statusNames[STATUS_COUNT] = {
+    "None", "Poison", "Bleed", "Stun", "Strength Up", "Weakness"};
+
+constexpr uint8_t statusBit(StatusEffect effect) { return (uint8_t)(1u << (int)effect); }
+
+inline string statusName(StatusEffect effect) { return string(statusNames[(int)effect]); }
+
+enum class ItemType
+{
+    WEAPON,
+    ARMOR,
+    ACCESSORY,
+    POTION
+};
+
+// ========= Item Catalog ===========
+/** @brief Index into itemCatalog; items are plain values, never heap objects. */
+enum class ItemId : uint8_t
+{
+    FIRE_SWORD,
+    ICE_SHIELD,
+    VAMPIRE_RING,
+    POISON_DAGGER,
+    DRAGON_SCALE,
+    LIGHTNING_ORB,
+    HEALTH_POTION,
+    MANA_POTION
+};
+
+/** @brief Compile-time description of one item and the bonuses it grants. */
+struct ItemDef
+{
+    string_view name;
+    string_view description;
+    ItemType type;
+    int attackBonus;
+    int healthBonus;
+    int defenseBonus;
+    int manaBonus;
+};
+
+// Built-in catalog; a content pack (--content) replaces every entry at startup
+ItemDef itemCatalog[] = {
+    {"Fire Sword", "Burns enemies with fire damage", ItemType::WEAPON, 15, 0, 0, 0},
+    {"Ice Shield", "Freezes attackers occasionally", ItemType::ARMOR, 0, 20, 10, 0},
+    {"Vampire Ring", "Heals user when dealing damage", ItemType::ACCESSORY, 5, 0, 0, 0},
+    {"Poison Dagger", "Poisons enemies on hit", ItemType::WEAPON, 8, 0, 0, 0},
+    {"Dragon Scale", "Grants fire resistance and strength", ItemType::ARMOR, 10, 30, 5, 0},
+    {"Lightning Orb", "Chance to stun enemies", ItemType::ACCESSORY, 12, 0, 0, 0},
+    {"Health Potion", "Restores HP", ItemType::POTION, 0, 30, 0, 0},
+    {"Mana Potion", "Restores MP", ItemType::POTION, 0, 0, 0, 20}};
+
+constexpr int EQUIPMENT_COUNT = 6; // Leading itemCatalog entries offered as stage loot
+
+constexpr int ITEM_COUNT = 8;
+
+inline const ItemDef &itemDef(ItemId id) { return itemCatalog[(int)id]; }
+
+inline bool isHealthPotion(ItemId id) { return id == ItemId::HEALTH_POTION; }
+
+/** @brief Prints an equipment entry with its name, description and bonuses. */
+void displayItemInfo(ItemId id, ostream &out = cout)
+{
+    const ItemDef &item = itemDef(id);
+    out << "\033[1;33m" << item.name << "\033[0m - " << item.description;
+    if (item.attackBonus > 0)
+        out << " [ATK +" << item.attackBonus << "]";
+    if (item.healthBonus > 0)
+        out << " [HP +" << item.healthBonus << "]";
+    if (item.defenseBonus > 0)
+        out << " [DEF +" << item.defenseBonus << "]";
+    if (item.manaBonus > 0)
+        out << " [MP +" << item.manaBonus << "]";
+    out << "\n";
+}
+
+/** @brief Prints a potion entry with the amount it restores. */
+void displayPotionInfo(ItemId id, ostream &out = cout)
+{
+    const ItemDef &potion = itemDef(id);
+    bool health = isHealthPotion(id);
+    out << "\033[1;34m" << potion.name << "\033[0m - Restores "
+         << (health ? potion.healthBonus : potion.manaBonus) << (health ? " HP" : " MP") << "\n";
+}
+
+/** @brief Up to three items handed out at once; small enough to pass by value. */
+struct LootRoll
+{
+    ItemId items[3];
+    int count = 0;
+
+    void push(ItemId id) { items[count++] = id; }
+    int size() const { return count; }
+    ItemId operator[](int i) const { return items[i]; }
+};
+
+// ========== Skill Tables ==========
+/**
+ * @brief Compile-time description of one skill; Unit::useSkill resolves any
+ * skill from this data alone.
+ */
+struct SkillDesc
+{
+    string_view name;
+    string_view usePhrase;  // Logged between user and target names; empty means " uses <name> on "
+    int cost;               // MP
+    int hits;               // Number of hits on the target (0 = no damage)
+    int damageBonus;        // Added to the user's current attack for each hit
+    bool showDamage;        // Log the hit damage in the use message
+    StatusEffect status;    // Applied after the hits, NONE for no status
+    int statusDuration;     // Turns
+    bool statusOnSelf;      // Status goes on the user instead of the target
+    bool announceStatus;    // Log "<target> is stunned/poisoned for N turns!"
+    bool drain;             // Heal the user for half the hit damage
+    int selfHeal;           // Flat heal for the user after the hits
+    bool area = false;      // Hits and statuses also land on every minion of the wave
+};
+
+constexpr int SKILLS_PER_UNIT = 3;
+
+// name, usePhrase, cost, hits, bonus, showDamage, status, duration, onSelf, announce, drain, selfHeal[, area]
+// Built-in tables like the item catalog, replaced in place by a content pack
+SkillDesc warriorSkills[SKILLS_PER_UNIT] = {
+    {"Power Strike", "", 15, 1, 25, true, StatusEffect::NONE, 0, false, false, false, 0},
+    {"Demoralizing Shout", "", 10, 0, 0, false, StatusEffect::WEAKNESS, 3, false, false, false, 0, true},
+    {"Battle Rage", " enters Battle Rage", 20, 0, 0, false, StatusEffect::STRENGTH_UP, 3, true, false, false, 0}};
+
+SkillDesc archerSkills[SKILLS_PER_UNIT] = {
+    {"Poison Arrow", " shoots Poison Arrow at ", 10, 1, 0, true, StatusEffect::POISON, 3, false, false, false, 0},
+    {"Piercing Shot", "", 15, 1, 10, true, StatusEffect::BLEED, 2, false, false, false, 0},
+    {"Double Shot", "", 20, 2, 0, false, StatusEffect::NONE, 0, false, false, false, 0}};
+
+SkillDesc mageSkills[SKILLS_PER_UNIT] = {
+    {"Fireball", " casts Fireball on ", 20, 1, 20, true, StatusEffect::NONE, 0, false, false, false, 0},
+    {"Ice Nova", " casts Ice Nova on ", 15, 0, 0, false, StatusEffect::STUN, 1, false, true, false, 0, true},
+    {"Life Drain", " drains life from ", 25, 1, 5, true, StatusEffect::NONE, 0, false, false, true, 0}};
+
+// Boss mechanics; each boss substitutes its own skill names
+SkillDesc bossSkills[SKILLS_PER_UNIT] = {
+    {"", "", 15, 1, 20, true, StatusEffect::NONE, 0, false, false, false, 0},
+    {"", "", 20, 1, 15, true, StatusEffect::POISON, 3, false, true, false, 0},
+    {"", "", 25, 1, 10, true, StatusEffect::STUN, 1, false, true, false, 20}};
+
+// Indexed by class choice (1 = Warrior, 2 = Archer, 3 = Mage)
+const SkillDesc *const classSkills[4] = {warriorSkills, warriorSkills, archerSkills, mageSkills};
+
+constexpr int BOSS_MANA = 60;
+
+// A stat that grows by a fixed step every stage
+struct StatLine
+{
+    int32_t base;
+    int32_t perStage;
+
+    int at(int stage) const { return base + perStage * stage; }
+};
+
+struct StageScaling
+{
+    StatLine bossAttack, bossHealth, bossDefense;
+    StatLine minionAttack, minionHealth;
+};
+
+StageScaling stageScaling = {{10, 5}, {70, 20}, {-1, 1}, {1, 1}, {6, 4}};
+
+// Starting stats of each hero class, indexed by class choice (1 = Warrior, 2 = Archer, 3 = Mage)
+struct ClassStats
+{
+    int32_t health, mana, attack, defense;
+};
+
+ClassStats classStats[4] = {{0, 0, 0, 0}, {120, 50, 20, 2}, {80, 35, 30, 1}, {70, 80, 25, 0}};
+
+struct BossDef
+{
+    string_view name;
+    string_view skillNames[SKILLS_PER_UNIT];
+};
+
+// One boss per stage
+BossDef bossRoster[5] = {
+    {"Goblin King", {"Goblin Smash", "Poison Cloud", "Stunning Roar"}},
+    {"Shadow Knight", {"Shadow Blade", "Dark Mist", "Shadow Bind"}},
+    {"Crimson Wraith", {"Crimson Slash", "Blood Curse", "Crimson Howl"}},
+    {"Lich Queen", {"Necroflame", "Soul Drain", "Necrotic Heal"}},
+    {"Doom Reaper", {"Void Strike", "Void Corruption", "Void Stasis"}}};
+
+// Endless mode past stage 5 cycles the roster, one epithet per lap: stage 6 is the Risen Goblin King
+constexpr string_view bossEpithets[] = {"Risen", "Dread", "Ancient", "Infernal", "Eternal", "Abyssal", "Primordial"};
+
+// ========== Battle Log ==========
+/**
+ * @brief Kind of a recorded battle event; decides how it is formatted.
+ */
+enum class EventKind : uint8_t
+{
+    TURN_START,       // actor's turn begins
+    STUN_SKIP,        // actor is stunned and skips the turn
+    PASS,             // actor passes
+    CHOOSE_ATTACK,    // boss announces a basic attack
+    ANNOUNCE_SKILL,   // boss announces skill `detail`
+    ATTACK,           // actor attacks target for `amount`
+    SKILL_USE,        // actor uses skill `detail` on target for `amount` (0 = no damage shown)
+    NOT_ENOUGH_MANA,  // player lacks MP for skill `detail`
+    BOSS_NO_MANA,     // boss lacks MP for skill `detail`
+    DAMAGE,           // actor took `amount` damage, HP `before` -> `after` / `maximum`; `detail` = source status
+    BLOCK,            // actor blocked `amount` damage
+    HP_CHANGE,        // actor's HP `before` -> `after` / `maximum`
+    ATK_CHANGE,       // actor's ATK `before` -> `after`
+    STATUS_APPLIED,   // actor applied status `detail` to target
+    STATUS_NOTE,      // actor is stunned / poisoned for `amount` turns
+    STATUS_EXPIRED,   // actor's status `detail` wore off
+    HEAL,             // actor healed `amount` HP, now `after` / `maximum`
+    RESTORE_MANA,     // actor restored `amount` MP, now `after` / `maximum`
+    MAX_HP_UP,        // actor's max HP increased by `amount`
+    MAX_MP_UP,        // actor's max MP increased by `amount`
+    ATTACK_UP,        // actor's attack increased by `amount`
+    DEFENSE_UP,       // actor's defense increased by `amount`
+    EQUIP,            // actor equipped the ItemId in `detail`
+    UNEQUIP,          // actor put away the ItemId in `detail` to make room
+    POTION_USED,      // actor used the potion ItemId in `detail`
+    MINION_HIT,       // actor hit minion #`maximum` with skill `detail` (0 = attack) for `amount`, HP `before` -> `after`
+    WAVE_SKILL,       // actor's skill `detail` swept `amount` minions, `before` of them fell
+    WAVE_ATTACK       // `amount` minions attack actor
+};
+
+/**
+ * @brief One compact, typed battle log record. Text is only built on display.
+ */
+struct BattleEvent
+{
+    EventKind kind;
+    uint8_t actor;  // Slot in the owning log's actor table
+    uint8_t target; // Slot in the owning log's actor table, or BattleLog::NO_ACTOR
+    uint8_t detail; // Skill number, StatusEffect, item index or potion kind depending on kind
+    int32_t amount;
+    int32_t before;
+    int32_t after;
+    int32_t maximum;
+};
+
+/**
+ * @brief Fixed-size ring buffer of BattleEvents owned by a Unit.
+ *
+ * Recording never allocates. Once full, the oldest event is overwritten.
+ * Units are referenced through a small actor table (slot 0 is always the
+ * owner) that is reset together with the events. A disabled log drops every
+ * event, which is what headless simulations use.
+ */
+class BattleLog
+{
+public:
+    static const int CAPACITY = 64; // Power of two
+    static const int MAX_ACTORS = 8;
+    static const uint8_t NO_ACTOR = 0xFF;
+
+private:
+    BattleEvent events[CAPACITY];
+    const class Unit *actors[MAX_ACTORS];
+    int head = 0;
+    int count = 0;
+    int actorCount = 1;
+    bool enabled = true;
+
+    uint8_t actorSlot(const Unit *unit)
+    {
+        if (!unit)
+            return NO_ACTOR;
+        for (int i = 0; i < actorCount; i++)
+        {
+            if (actors[i] == unit)
+                return i;
+        }
+        // A full table reuses the last slot; logs are cleared every turn so this is not reached in practice
+        if (actorCount == MAX_ACTORS)
+            --actorCount;
+        actors[actorCount] = unit;
+        return actorCount++;
+    }
+
+public:
+    explicit BattleLog(const Unit *owner) { actors[0] = owner; }
+    BattleLog(const BattleLog &) = delete;
+    BattleLog &operator=(const BattleLog &) = delete;
+
+    void setEnabled(bool on) { enabled = on; }
+    bool isEnabled() const { return enabled; }
+    bool empty() const { return count == 0; }
+    int size() const { return count; }
+
+    void clear()
+    {
+        head = 0;
+        count = 0;
+        actorCount = 1;
+    }
+
+    void record(EventKind kind, const Unit *actor, const Unit *target = nullptr, int detail = 0,
+                int amount = 0, int before = 0, int after = 0, int maximum = 0)
+    {
+        if (!enabled)
+            return;
+
+        BattleEvent &event = events[(head + count) & (CAPACITY - 1)];
+        if (count == CAPACITY)
+            head = (head + 1) & (CAPACITY - 1);
+        else
+            ++count;
+
+        event.kind = kind;
+        event.actor = actorSlot(actor);
+        event.target = actorSlot(target);
+        event.detail = (uint8_t)detail;
+        event.amount = amount;
+        event.before = before;
+        event.after = after;
+        event.maximum = maximum;
+    }
+
+    // i-th event, oldest first
+    const BattleEvent &at(int i) const { return events[(head + i) & (CAPACITY - 1)]; }
+
+    // `viewer` is who reads the line ("YOUR TURN"); by default the log's owner
+    string format(const BattleEvent &event, const Unit *viewer = nullptr) const;
+};
+
+// ========== BaseClassUnit ==========
+class EnemyPool;
+
+constexpr int MAX_SAVED_EQUIPMENT = 8; // One item per cleared stage fits with room to spare
+constexpr int MAX_SAVED_POTIONS = 32;
+
+/**
+ * @brief Everything about a unit that changes during a run, as plain bytes.
+ *
+ * Trivially copyable and free of padding, so it can be written to disk or
+ * copied around as-is; the name, class and skills are kept elsewhere.
+ */
+struct UnitState
+{
+    int32_t maxHealth;
+    int32_t health;
+    int32_t maxMana;
+    int32_t mana;
+    int32_t baseAttack;
+    int32_t currentAttack;
+    int32_t defense;
+    int32_t statusDurations[STATUS_COUNT];
+    uint8_t activeStatus;
+    uint8_t equipmentCount;
+    uint8_t potionCount;
+    uint8_t reserved;
+    ItemId equipment[MAX_SAVED_EQUIPMENT];
+    ItemId potions[MAX_SAVED_POTIONS];
+};
+static_assert(is_trivially_copyable_v<UnitState> && sizeof(UnitState) == 96, "UnitState layout changed");
+
+// Fields of a status line, as bits of Unit::changedFields()
+enum StatField : uint8_t
+{
+    FIELD_HP = 1,
+    FIELD_MP = 2,
+    FIELD_ATK = 4,
+    FIELD_DEF = 8,
+    FIELD_STATUS = 16,
+    ALL_FIELDS = 31
+};
+
+class Unit
+{
+private:
+    // The stats as last displayed, so renders can show only what changed since
+    struct ShownStats
+    {
+        int health = -1, maxHealth = 0, mana = 0, maxMana = 0, attack = 0, defense = 0;
+        int statusDurations[STATUS_COUNT] = {};
+    } shown;
+
+protected:
+    pmr::string name;
+    int maxHealth;
+    int health;
+    int maxMana;
+    int mana;
+    int baseAttack;
+    int currentAttack;
+    int defense;
+    int statusDurations[STATUS_COUNT] = {}; // Turns left, indexed by StatusEffect
+    uint8_t activeStatus = 0;               // One statusBit per applied effect
+    pmr::vector<ItemId> equipment;
+    pmr::vector<ItemId> potions;
+    BattleLog battleLog;
+    const SkillDesc *skills; // SKILLS_PER_UNIT entries
+    bool enemy = false;      // Enemy units word their log messages in the third person
+
+public:
+    Unit(string_view n, const SkillDesc *skillTable, int hp, int mp, int atk, int def = 0,
+         pmr::memory_resource *memory = pmr::get_default_resource())
+        : name(n, memory), maxHealth(hp), health(hp), maxMana(mp), mana(mp),
+          baseAttack(atk), currentAttack(atk), defense(def), equipment(memory), potions(memory),
+          battleLog(this), skills(skillTable) {}
+
+    virtual ~Unit() {}
+
+    // Getters
+    string getName() const { return string(name); }
+    int getHealth() const { return health; }
+    int getMaxHealth() const { return maxHealth; }
+    int getMana() const { return mana; }
+    int getMaxMana() const { return maxMana; }
+    int getAttack() const { return currentAttack; }
+    int getBaseAttack() const { return baseAttack; }
+    int getDefense() const { return defense; }
+    bool isAlive() const { return health > 0; }
+    bool isEnemy() const { return enemy; }
+    const pmr::vector<ItemId> &getEquipment() const { return equipment; }
+    const pmr::vector<ItemId> &getPotions() const { return potions; }
+    BattleLog &getBattleLog() { return battleLog; }
+    const BattleLog &getBattleLog() const { return battleLog; }
+    void clearBattleLog() { battleLog.clear(); }
+
+    // Item management; a unit carries at most what a save game can hold, so endless runs stay bounded
+    void addItem(ItemId id)
+    {
+        const ItemDef &item = itemDef(id);
+        if (item.type == ItemType::POTION)
+        {
+            // A full bag leaves the potion behind
+            if (potions.size() < MAX_SAVED_POTIONS)
+                potions.push_back(id);
+            return;
+        }
+
+        // Every slot taken: the oldest piece, and its bonuses, make way for the new one
+        if (equipment.size() == MAX_SAVED_EQUIPMENT)
+        {
+            const ItemDef &oldest = itemDef(equipment.front());
+            baseAttack -= oldest.attackBonus;
+            currentAttack -= oldest.attackBonus;
+            maxHealth -= oldest.healthBonus;
+            health = min(health, maxHealth);
+            defense -= oldest.defenseBonus;
+            battleLog.record(EventKind::UNEQUIP, this, nullptr, (uint8_t)equipment.front());
+            equipment.erase(equipment.begin());
+        }
+
+        equipment.push_back(id);
+        if (item.attackBonus > 0)
+            increaseAttack(item.attackBonus);
+        if (item.healthBonus > 0)
+            increaseMaxHealth(item.healthBonus);
+        if (item.defenseBonus > 0)
+            increaseDefense(item.defenseBonus);
+        battleLog.record(EventKind::EQUIP, this, nullptr, (uint8_t)id);
+    }
+
+    bool usePotion(int index)
+    {
+        if (index < 0 || index >= (int)potions.size())
+            return false;
+
+        ItemId potion = potions[index];
+        if (isHealthPotion(potion))
+        {
+            heal(itemDef(potion).healthBonus);
+        }
+        else
+        {
+            restoreMana(itemDef(potion).manaBonus);
+        }
+
+        battleLog.record(EventKind::POTION_USED, this, nullptr, (uint8_t)potion);
+        potions.erase(potions.begin() + index);
+        return true;
+    }
+
+    /**
+     * @brief Copies the unit's mutable state into `state`.
+     * @return false if it has more items than UnitState can hold.
+     */
+    bool captureState(UnitState &state) const
+    {
+        if (equipment.size() > MAX_SAVED_EQUIPMENT || potions.size() > MAX_SAVED_POTIONS)
+            return false;
+
+        state = UnitState{};
+        state.maxHealth = maxHealth;
+        state.health = health;
+        state.maxMana = maxMana;
+        state.mana = mana;
+        state.baseAttack = baseAttack;
+        state.currentAttack = currentAttack;
+        state.defense = defense;
+        copy(begin(statusDurations), end(statusDurations), state.statusDurations);
+        state.activeStatus = activeStatus;
+        state.equipmentCount = (uint8_t)equipment.size();
+        state.potionCount = (uint8_t)potions.size();
+        copy(equipment.begin(), equipment.end(), state.equipment);
+        copy(potions.begin(), potions.end(), state.potions);
+        return true;
+    }
+
+    // Overwrites the stats as saved; item bonuses are already part of them, so nothing is re-applied
+    void restoreState(const UnitState &state)
+    {
+        maxHealth = state.maxHealth;
+        health = state.health;
+        maxMana = state.maxMana;
+        mana = state.mana;
+        baseAttack = state.baseAttack;
+        currentAttack = state.currentAttack;
+        defense = state.defense;
+        copy(begin(state.statusDurations), end(state.statusDurations), statusDurations);
+        activeStatus = state.activeStatus;
+        equipment.assign(state.equipment, state.equipment + state.equipmentCount);
+        potions.assign(state.potions, state.potions + state.potionCount);
+        battleLog.clear();
+    }
+
+protected:
+    // Fresh stats with no statuses, items or log, keeping the object and the storage it already owns
+    void resetTo(int hp, int mp, int atk, int def)
+    {
+        maxHealth = health = hp;
+        maxMana = mana = mp;
+        baseAttack = currentAttack = atk;
+        defense = def;
+        fill(begin(statusDurations), end(statusDurations), 0);
+        activeStatus = 0;
+        equipment.clear();
+        potions.clear();
+        battleLog.clear();
+    }
+
+public:
+    // Status effects
+    void addStatus(StatusEffect effect, int duration, const Unit &source)
+    {
+        statusDurations[(int)effect] = duration;
+        activeStatus |= statusBit(effect);
+        battleLog.record(EventKind::STATUS_APPLIED, &source, this, (int)effect);
+    }
+
+    bool hasStatus(StatusEffect effect) const
+    {
+        return statusDurations[(int)effect] > 0;
+    }
+
+    int getStatusDuration(StatusEffect effect) const { return statusDurations[(int)effect]; }
+    uint8_t getActiveStatus() const { return activeStatus; }
+
+    void clearStatus(StatusEffect effect)
+    {
+        statusDurations[(int)effect] = 0;
+        activeStatus &= ~statusBit(effect);
+    }
+
+    // Ticks every active effect in StatusEffect order, then drops the expired ones
+    void processStatusEffects()
+    {
+        PhaseTimer timer(Phase::STATUS);
+        uint8_t expired = 0;
+
+        for (int i = 1; i < STATUS_COUNT; i++)
+        {
+            StatusEffect effect = (StatusEffect)i;
+            if (!(activeStatus & statusBit(effect)))
+                continue;
+
+            switch (effect)
+            {
+            case StatusEffect::POISON:
+                takeDamage(5, false, StatusEffect::POISON);
+                break;
+            case StatusEffect::BLEED:
+                takeDamage(3, false, StatusEffect::BLEED);
+                break;
+            case StatusEffect::STRENGTH_UP:
+                currentAttack = baseAttack + 10;
+                break;
+            case StatusEffect::WEAKNESS:
+                currentAttack = max(1, baseAttack - 5);
+                break;
+            default:
+                break;
+            }
+
+            if (--statusDurations[i] <= 0)
+            {
+                expired |= statusBit(effect);
+                statusDurations[i] = 0;
+                battleLog.record(EventKind::STATUS_EXPIRED, this, nullptr, i);
+            }
+        }
+
+        activeStatus &= ~expired;
+        if (expired & (statusBit(StatusEffect::STRENGTH_UP) | statusBit(StatusEffect::WEAKNESS)))
+        {
+            currentAttack = baseAttack;
+        }
+    }
+
+    // Combat actions
+    void takeDamage(int dmg, bool showBlock = true, StatusEffect source = StatusEffect::NONE)
+    {
+        int actualDamage = max(1, dmg - defense);
+        int prevHealth = health;
+        health = max(0, health - actualDamage);
+
+        battleLog.record(EventKind::DAMAGE, this, nullptr, (int)source, actualDamage, prevHealth, health, maxHealth);
+
+        if (showBlock && defense > 0 && actualDamage < dmg)
+        {
+            battleLog.record(EventKind::BLOCK, this, nullptr, 0, dmg - actualDamage);
+        }
+    }
+
+    void heal(int amount)
+    {
+        int oldHealth = health;
+        health = min(maxHealth, health + amount);
+        int healedAmount = health - oldHealth;
+        battleLog.record(EventKind::HEAL, this, nullptr, 0, healedAmount, oldHealth, health, maxHealth);
+    }
+
+    void restoreMana(int amount)
+    {
+        int oldMana = mana;
+        mana = min(maxMana, mana + amount);
+        int restoredAmount = mana - oldMana;
+        battleLog.record(EventKind::RESTORE_MANA, this, nullptr, 0, restoredAmount, oldMana, mana, maxMana);
+    }
+
+    void increaseMaxHealth(int amount)
+    {
+        maxHealth += amount;
+        health += amount;
+        battleLog.record(EventKind::MAX_HP_UP, this, nullptr, 0, amount);
+    }
+
+    void increaseMaxMana(int amount)
+    {
+        maxMana += amount;
+        mana += amount;
+        battleLog.record(EventKind::MAX_MP_UP, this, nullptr, 0, amount);
+    }
+
+    void increaseAttack(int amount)
+    {
+        baseAttack += amount;
+        currentAttack = baseAttack;
+        battleLog.record(EventKind::ATTACK_UP, this, nullptr, 0, amount);
+    }
+
+    void increaseDefense(int amount)
+    {
+        defense += amount;
+        battleLog.record(EventKind::DEFENSE_UP, this, nullptr, 0, amount);
+    }
+
+    void attack(Unit &target)
+    {
+        int targetPrevHealth = target.getHealth();
+        battleLog.record(EventKind::ATTACK, this, &target, 0, currentAttack);
+        target.takeDamage(currentAttack);
+        logHealthChange(target, targetPrevHealth);
+    }
+
+    // Records "<unit>'s HP: before -> now/max" in this unit's log
+    void logHealthChange(const Unit &unit, int prevHealth)
+    {
+        battleLog.record(EventKind::HP_CHANGE, &unit, nullptr, 0, 0, prevHealth, unit.getHealth(), unit.getMaxHealth());
+    }
+
+    // Skills
+    const SkillDesc &getSkill(int skill) const { return skills[skill - 1]; }
+    string getSkillName(int skill) const { return string(getSkill(skill).name); }
+    int getSkillCost(int skill) const { return getSkill(skill).cost; }
+
+    string getSkillUsePhrase(int skill) const
+    {
+        const SkillDesc &desc = getSkill(skill);
+        return desc.usePhrase.empty() ? " uses " + string(desc.name) + " on " : string(desc.usePhrase);
+    }
+
+    // Basic attack on minion `minion` of a wave
+    void attackMinion(EnemyPool &wave, int minion);
+
+    // `total` damage from many small blows, each already reduced by defense; logged as one hit
+    void takeBarrage(int total)
+    {
+        int prevHealth = health;
+        health = max(0, health - total);
+        battleLog.record(EventKind::DAMAGE, this, nullptr, 0, total, prevHealth, health, maxHealth);
+    }
+
+    /**
+     * @brief Resolves skill 1-3 from its SkillDesc.
+     * @param wave Minions of the fight; area skills sweep all of them
+     * @param minion Index into `wave` to aim a single-target skill at a minion instead of `target`
+     * @return false (and nothing happens) if the unit lacks MP.
+     */
+    bool useSkill(int skill, Unit &target, EnemyPool *wave = nullptr, int minion = -1)
+    {
+        const SkillDesc &desc = getSkill(skill);
+        if (mana < desc.cost)
+        {
+            battleLog.record(enemy ? EventKind::BOSS_NO_MANA : EventKind::NOT_ENOUGH_MANA, this, nullptr, skill);
+            return false;
+        }
+
+        mana -= desc.cost;
+        int dmg = currentAttack + desc.damageBonus;
+        // A wave skill whose main target already fell only sweeps the minions
+        if (minion >= 0 || (desc.area && wave && !target.isAlive()))
+        {
+            int prevHealth = health;
+            strikeMinions(skill, dmg, *wave, minion);
+            if (desc.status != StatusEffect::NONE && desc.statusOnSelf)
+                addStatus(desc.status, desc.statusDuration, *this);
+            if (desc.drain)
+                heal(dmg / 2);
+            if (desc.selfHeal > 0)
+                heal(desc.selfHeal);
+            if (desc.drain || desc.selfHeal > 0)
+                logHealthChange(*this, prevHealth);
+            return true;
+        }
+
+        Unit &statusTarget = desc.statusOnSelf ? *this : target;
+        int targetPrevHealth = target.getHealth();
+        int statusPrevAttack = statusTarget.getAttack();
+        int prevHealth = health;
+
+        bool targetShown = desc.hits > 0 || !desc.statusOnSelf;
+        battleLog.record(EventKind::SKILL_USE, this, targetShown ? &target : nullptr, skill,
+                         desc.showDamage ? dmg : 0);
+
+        for (int i = 0; i < desc.hits; i++)
+            target.takeDamage(dmg);
+        if (desc.status != StatusEffect::NONE)
+            statusTarget.addStatus(desc.status, desc.statusDuration, *this);
+        if (desc.drain)
+            heal(dmg / 2);
+        if (desc.selfHeal > 0)
+            heal(desc.selfHeal);
+
+        if (desc.hits > 0)
+            logHealthChange(target, targetPrevHealth);
+        if (desc.announceStatus)
+            battleLog.record(EventKind::STATUS_NOTE, &target, nullptr, (int)desc.status, desc.statusDuration);
+        if (desc.status == StatusEffect::STRENGTH_UP || desc.status == StatusEffect::WEAKNESS)
+            battleLog.record(EventKind::ATK_CHANGE, &statusTarget, nullptr, 0, 0, statusPrevAttack,
+                             statusTarget.getAttack());
+        if (desc.drain || desc.selfHeal > 0)
+            logHealthChange(*this, prevHealth);
+        if (desc.area && wave)
+            strikeMinions(skill, dmg, *wave, -1);
+        return true;
+    }
+
+    // Lands skill `skill` (hits of `dmg` and its status) on one minion, or on the whole wave for -1
+    void strikeMinions(int skill, int dmg, EnemyPool &wave, int minion);
+
+    // StatField bits of what differs from the last markShown(); everything until the first
+    uint8_t changedFields() const
+    {
+        if (shown.health < 0)
+            return ALL_FIELDS;
+        uint8_t fields = 0;
+        if (health != shown.health || maxHealth != shown.maxHealth)
+            fields |= FIELD_HP;
+        if (mana != shown.mana || maxMana != shown.maxMana)
+            fields |= FIELD_MP;
+        if (currentAttack != shown.attack)
+            fields |= FIELD_ATK;
+        if (defense != shown.defense)
+            fields |= FIELD_DEF;
+        if (!equal(begin(statusDurations), end(statusDurations), shown.statusDurations))
+            fields |= FIELD_STATUS;
+        return fields;
+    }
+
+    void markShown()
+    {
+        shown.health = health;
+        shown.maxHealth = maxHealth;
+        shown.mana = mana;
+        shown.maxMana = maxMana;
+        shown.attack = currentAttack;
+        shown.defense = defense;
+        copy(begin(statusDurations), end(statusDurations), shown.statusDurations);
+    }
+
+    // The status line, or with `fields` just those of its parts (an emptied status set shows as "none")
+    virtual void displayStatus(ostream &out = cout, uint8_t fields = ALL_FIELDS) const
+    {
+        out << name << " -";
+        const char *separator = " ";
+        if (fields & FIELD_HP)
+        {
+            out << separator << "HP: \033[1;31m" << (isAlive() ? to_string(health) : "0") << "/" << maxHealth
+                << "\033[0m";
+            separator = ", ";
+        }
+        if (fields & FIELD_MP)
+        {
+            out << separator << "MP: \033[1;34m" << mana << "/" << maxMana << "\033[0m";
+            separator = ", ";
+        }
+        if (fields & FIELD_ATK)
+        {
+            out << separator << "ATK: \033[1;33m" << currentAttack << "\033[0m";
+            separator = ", ";
+        }
+        if (fields & FIELD_DEF)
+            out << separator << "DEF: \033[1;34m" << defense << "\033[0m";
+
+        if ((fields & FIELD_STATUS) && activeStatus)
+        {
+            out << " [Status:";
+            for (int i = 1; i < STATUS_COUNT; i++)
+            {
+                if (activeStatus & statusBit((StatusEffect)i))
+                    out << " " << statusNames[i] << "(" << statusDurations[i] << ")";
+            }
+            out << "]";
+        }
+        else if ((fields & FIELD_STATUS) && fields != ALL_FIELDS)
+        {
+            out << " [Status: none]";
+        }
+        out << "\n";
+    }
+
+    // Without `heading`, only the events themselves (nothing at all for an empty log), worded for `viewer`
+    void displayBattleLog(ostream &out = cout, bool heading = true, const Unit *viewer = nullptr) const
+    {
+        if (heading)
+            out << "\n=== BATTLE LOG ===\n";
+        if (battleLog.empty())
+        {
+            if (heading)
+                out << "No actions yet.\n";
+        }
+        else
+        {
+            for (int i = 0; i < battleLog.size(); i++)
+            {
+                out << "> " << battleLog.format(battleLog.at(i), viewer) << "\n";
+            }
+        }
+    }
+};
+
+string BattleLog::format(const BattleEvent &event, const Unit *viewer) const
+{
+    const Unit &actor = *actors[event.actor];
+    const bool isOwner = viewer ? &actor == viewer : event.actor == 0;
+    const string actorName = actor.getName();
+    const string targetName = event.target == NO_ACTOR ? "" : actors[event.target]->getName();
+    const string status = event.detail < STATUS_COUNT ? statusName((StatusEffect)event.detail) : "";
+
+    switch (event.kind)
+    {
+    case EventKind::TURN_START:
+        return isOwner ? "\n=== YOUR TURN ===" : "\n=== " + actorName + "'s TURN ===";
+    case EventKind::STUN_SKIP:
+        return isOwner ? "\033[1;35mYou are stunned and skip your turn!\033[0m"
+                       : "\033[1;35m" + actorName + " is stunned and skips turn!\033[0m";
+    case EventKind::PASS:
+        return isOwner ? "You pass your turn." : actorName + " passes.";
+    case EventKind::CHOOSE_ATTACK:
+        return actorName + " chooses to attack!";
+    case EventKind::ANNOUNCE_SKILL:
+        return actorName + " uses " + actor.getSkillName(event.detail) + "!";
+    case EventKind::ATTACK:
+        return actorName + " attacks " + targetName + " for " + to_string(event.amount) + " damage!";
+    case EventKind::SKILL_USE:
+    {
+        string msg = actorName + actor.getSkillUsePhrase(event.detail) + targetName;
+        if (event.amount > 0)
+            msg += " for " + to_string(event.amount) + " damage";
+        return msg + "!";
+    }
+    case EventKind::NOT_ENOUGH_MANA:
+        return "Not enough MP for " + actor.getSkillName(event.detail) + "!";
+    case EventKind::BOSS_NO_MANA:
+        return actorName + " doesn't have enough MP for " + actor.getSkillName(event.detail) + "!";
+    case EventKind::DAMAGE:
+    {
+        string msg = actorName + " took " + to_string(event.amount) + " damage";
+        if (event.detail != (uint8_t)StatusEffect::NONE)
+            msg += " from " + status;
+        return msg + "! [" + to_string(event.before) + " -> " + to_string(event.after) + "/" +
+               to_string(event.maximum) + " HP]";
+    }
+    case EventKind::BLOCK:
+        return actorName + " blocked " + to_string(event.amount) + " damage!";
+    case EventKind::HP_CHANGE:
+        return actorName + "'s HP: " + to_string(event.before) + " -> " + to_string(event.after) + "/" +
+               to_string(event.maximum);
+    case EventKind::ATK_CHANGE:
+        return actorName + "'s ATK: " + to_string(event.before) + " -> " + to_string(event.after);
+    case EventKind::STATUS_APPLIED:
+        return actorName + " applied " + status + " to " + targetName + "!";
+    case EventKind::STATUS_NOTE:
+        if (event.detail == (uint8_t)StatusEffect::STUN)
+            return actorName + " is stunned for " + to_string(event.amount) + " turn!";
+        return actorName + " is poisoned for " + to_string(event.amount) + " turns!";
+    case EventKind::STATUS_EXPIRED:
+        return actorName + "'s " + status + " wore off!";
+    case EventKind::HEAL:
+        return actorName + " healed " + to_string(event.amount) + " HP! (" + to_string(event.after) + "/" +
+               to_string(event.maximum) + ")";
+    case EventKind::RESTORE_MANA:
+        return actorName + " restored " + to_string(event.amount) + " MP! (" + to_string(event.after) + "/" +
+               to_string(event.maximum) + ")";
+    case EventKind::MAX_HP_UP:
+        return actorName + "'s max HP increased by " + to_string(event.amount) + "!";
+    case EventKind::MAX_MP_UP:
+        return actorName + "'s max MP increased by " + to_string(event.amount) + "!";
+    case EventKind::ATTACK_UP:
+        return actorName + "'s attack increased by " + to_string(event.amount) + "!";
+    case EventKind::DEFENSE_UP:
+        return actorName + "'s defense increased by " + to_string(event.amount) + "!";
+    case EventKind::EQUIP:
+        return actorName + " equipped " + string(itemCatalog[event.detail].name) + "!";
+    case EventKind::UNEQUIP:
+        return actorName + " put away " + string(itemCatalog[event.detail].name) + " to make room.";
+    case EventKind::POTION_USED:
+        return actorName + " used " + string(itemCatalog[event.detail].name) + "!";
+    case EventKind::MINION_HIT:
+    {
+        string minion = "Minion #" + to_string(event.maximum);
+        string msg = event.detail == 0 ? actorName + " attacks " + minion
+                                       : actorName + " uses " + actor.getSkillName(event.detail) + " on " + minion;
+        msg += " for " + to_string(event.amount) + " damage! [" + to_string(event.before) + " -> " +
+               to_string(event.after) + " HP]";
+        return event.after == 0 ? msg + " " + minion + " falls!" : msg;
+    }
+    case EventKind::WAVE_SKILL:
+        return actorName + "'s " + actor.getSkillName(event.detail) + " sweeps " + to_string(event.amount) +
+               " minions! (" + to_string(event.before) + " defeated)";
+    case EventKind::WAVE_ATTACK:
+        return to_string(event.amount) + (event.amount == 1 ? " minion attacks " : " minions attack ") + actorName + "!";
+    }
+    return "";
+}
+
+// ========= DerivedClassUnit ===========
+// Class player
+class Warrior : public Unit
+{
+public:
+    Warrior(string_view n, pmr::memory_resource *memory = pmr::get_default_resource())
+        : Unit(n, warriorSkills, classStats[1].health, classStats[1].mana, classStats[1].attack, classStats[1].defense,
+               memory) {}
+};
+
+class Archer : public Unit
+{
+public:
+    Archer(string_view n, pmr::memory_resource *memory = pmr::get_default_resource())
+        : Unit(n, archerSkills, classStats[2].health, classStats[2].mana, classStats[2].attack, classStats[2].defense,
+               memory) {}
+};
+
+class Mage : public Unit
+{
+public:
+    Mage(string_view n, pmr::memory_resource *memory = pmr::get_default_resource())
+        : Unit(n, mageSkills, classStats[3].health, classStats[3].mana, classStats[3].attack, classStats[3].defense,
+               memory) {}
+};
+// ======= DerivedClassUnit =======
+// ======= BossClass =======
+class BossTactics;
+class Rng;
+
+class BossUnit : public Unit
+{
+private:
+    SkillDesc ownSkills[SKILLS_PER_UNIT]; // bossSkills with this boss's names
+    const BossTactics *tactics = nullptr; // Decision table; without one every action is equally likely
+
+public:
+    BossUnit(string_view n, string_view sk1, string_view sk2, string_view sk3, int atk, int hp, int def = 0,
+             pmr::memory_resource *memory = pmr::get_default_resource())
+        : Unit(n, ownSkills, hp, BOSS_MANA, atk, def, memory)
+    {
+        string_view names[SKILLS_PER_UNIT] = {sk1, sk2, sk3};
+        for (int i = 0; i < SKILLS_PER_UNIT; i++)
+        {
+            ownSkills[i] = bossSkills[i];
+            ownSkills[i].name = names[i];
+        }
+        enemy = true;
+    }
+
+    /**
+     * @brief Turns this object into the next stage's boss, "<epithet> <base.name>".
+     * Reusing one boss per run keeps long runs from growing the arena; the
+     * name only allocates when it outgrows every name it held before.
+     */
+    void respawn(string_view epithet, const BossDef &base, int atk, int hp, int def)
+    {
+        name.clear();
+        if (!epithet.empty())
+            name.append(epithet).append(1, ' ');
+        name.append(base.name);
+        for (int i = 0; i < SKILLS_PER_UNIT; i++)
+            ownSkills[i].name = base.skillNames[i];
+        resetTo(hp, BOSS_MANA, atk, def);
+    }
+
+    void setTactics(const BossTactics *table) { tactics = table; }
+    const BossTactics *getTactics() const { return tactics; }
+
+    // Picks this turn's action with one draw: 0-2 for skills 1-3, 3 for a plain attack
+    int chooseAction(const Unit &player, Rng &rng) const;
+
+    void displayStatus(ostream &out = cout, uint8_t fields = ALL_FIELDS) const override
+    {
+        out << "\033[1;31m"; // Red color for boss
+        Unit::displayStatus(out, fields);
+        out << "\033[0m";
+    }
+};
+
+// ========== Random Numbers ==========
+/**
+ * @brief Small seedable xoshiro256** generator.
+ *
+ * Every game owns one through its GameContext, so runs are reproducible
+ * from their seed and independent games can run on separate threads.
+ */
+class Rng
+{
+private:
+    uint64_t state[4];
+
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+public:
+    explicit Rng(uint64_t seed = 0) { reseed(seed); }
+
+    // Expands a 64-bit seed into the full state with splitmix64
+    void reseed(uint64_t seed)
+    {
+        for (uint64_t &word : state)
+        {
+            uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next()
+    {
+        uint64_t result = rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    // Uniform integer in [0, bound) using a multiply-shift range reduction
+    int below(int bound)
+    {
+        return (int)(((next() >> 32) * (uint64_t)bound) >> 32);
+    }
+
+    // Raw generator state, for save games
+    void saveState(uint64_t out[4]) const { copy(state, state + 4, out); }
+    void restoreState(const uint64_t in[4]) { copy(in, in + 4, state); }
+};
+
+// ========== Boss Tactics ==========
+/**
+ * @brief Tuning knobs of one stage's boss, in relative odds (0-60 each).
+ *
+ * `skill` and `attack` are the base odds of each action. `finisher` is
+ * added to Skill 1 and the plain attack while the hero is below a quarter
+ * HP, and `recover` to Skill 3 (the self-heal) while the boss is.
+ */
+struct BossWeights
+{
+    uint8_t skill[SKILLS_PER_UNIT];
+    uint8_t attack;
+    uint8_t finisher;
+    uint8_t recover;
+};
+
+// One entry per stage: the first boss mostly swings, later ones lean on their skills and read the fight
+constexpr BossWeights bossWeights[5] = {
+    {{3, 3, 2}, 24, 0, 0},
+    {{4, 4, 3}, 20, 4, 4},
+    {{5, 6, 4}, 18, 6, 6},
+    {{6, 8, 6}, 14, 8, 8},
+    {{8, 8, 8}, 12, 10, 10}};
+
+/**
+ * @brief Precomputed boss decisions for every situation a fight can be in.
+ *
+ * A situation packs the boss's and hero's HP quarter, which boss skills
+ * the boss can pay for and whether the hero is already stunned or poisoned.
+ * Each entry holds running totals of the action odds with unaffordable
+ * skills zeroed and repeated statuses discounted, so choosing is one
+ * random draw and three compares. Actions use the old roll's encoding:
+ * 0-2 for skills 1-3, 3 for the plain attack.
+ */
+class BossTactics
+{
+public:
+    static constexpr int HEALTH_BUCKETS = 4;
+    static constexpr int SITUATIONS = HEALTH_BUCKETS * HEALTH_BUCKETS * (1 << SKILLS_PER_UNIT) * 4;
+
+private:
+    uint8_t cumulative[SITUATIONS][4];
+
+    static constexpr int bucket(int health, int maxHealth)
+    {
+        return health <= 0 ? 0 : min(HEALTH_BUCKETS - 1, health * HEALTH_BUCKETS / maxHealth);
+    }
+
+public:
+    constexpr explicit BossTactics(const BossWeights &weights) : cumulative()
+    {
+        for (int s = 0; s < SITUATIONS; s++)
+        {
+            int bossBucket = s % HEALTH_BUCKETS;
+            int playerBucket = s / HEALTH_BUCKETS % HEALTH_BUCKETS;
+            int affordable = s / (HEALTH_BUCKETS * HEALTH_BUCKETS) % (1 << SKILLS_PER_UNIT);
+            bool playerStunned = s / (HEALTH_BUCKETS * HEALTH_BUCKETS * (1 << SKILLS_PER_UNIT)) & 1;
+            bool playerPoisoned = s / (HEALTH_BUCKETS * HEALTH_BUCKETS * (1 << SKILLS_PER_UNIT)) & 2;
+
+            int odds[4] = {weights.skill[0], weights.skill[1], weights.skill[2], weights.attack};
+            if (playerBucket == 0)
+            {
+                odds[0] += weights.finisher;
+                odds[3] += weights.finisher;
+            }
+            if (bossBucket == 0)
+                odds[2] += weights.recover;
+            if (playerPoisoned)
+                odds[1] /= 4;
+            if (playerStunned)
+                odds[2] /= 4;
+            for (int k = 0; k < SKILLS_PER_UNIT; k++)
+                if (!(affordable & (1 << k)))
+                    odds[k] = 0;
+            odds[3] = max(1, odds[3]);
+
+            int total = 0;
+            for (int a = 0; a < 4; a++)
+                cumulative[s][a] = (uint8_t)(total += odds[a]);
+        }
+    }
+
+    static int situation(int bossHealth, int bossMaxHealth, int bossMana, int playerHealth,
+                                   int playerMaxHealth, bool playerStunned, bool playerPoisoned)
+    {
+        int affordable = 0;
+        for (int k = 0; k < SKILLS_PER_UNIT; k++)
+            affordable |= (bossMana >= bossSkills[k].cost) << k;
+        return bucket(bossHealth, bossMaxHealth) +
+               HEALTH_BUCKETS * (bucket(playerHealth, playerMaxHealth) +
+                                 HEALTH_BUCKETS * (affordable + (1 << SKILLS_PER_UNIT) * (playerStunned + 2 * playerPoisoned)));
+    }
+
+    int choose(int situation, Rng &rng) const
+    {
+        const uint8_t *running = cumulative[situation];
+        int roll = rng.below(running[3]);
+        return (roll >= running[0]) + (roll >= running[1]) + (roll >= running[2]);
+    }
+
+    // Odds of `action` out of total(situation)
+    int weight(int situation, int action) const
+    {
+        return cumulative[situation][action] - (action > 0 ? cumulative[situation][action - 1] : 0);
+    }
+
+    int total(int situation) const { return cumulative[situation][3]; }
+};
+
+// Default decision tables, built at compile time from bossWeights
+constexpr BossTactics stageTactics[5] = {BossTactics(bossWeights[0]), BossTactics(bossWeights[1]),
+                                         BossTactics(bossWeights[2]), BossTactics(bossWeights[3]),
+                                         BossTactics(bossWeights[4])};
+
+// The tables new games use, and the weights they were built from; a content pack points both elsewhere
+const BossWeights *activeWeights = bossWeights;
+const BossTactics *activeTactics = stageTactics;
+
+int BossUnit::chooseAction(const Unit &player, Rng &rng) const
+{
+    if (!tactics)
+        return rng.below(4);
+    return tactics->choose(BossTactics::situation(health, maxHealth, mana, player.getHealth(), player.getMaxHealth(),
+                                                  player.hasStatus(StatusEffect::STUN),
+                                                  player.hasStatus(StatusEffect::POISON)),
+                           rng);
+}
+
+// ========== Session Arena ==========
+/**
+ * @brief Monotonic memory owning everything one game session allocates.
+ *
+ * The player, every boss, their names and their item lists are carved out of
+ * one buffer and are never freed one by one; the whole session goes away in a
+ * single reset(), or when the arena itself is destroyed. Objects made with
+ * create() are not destructed, so they must keep all of their storage in the
+ * arena (pmr containers built on resource()).
+ */
+class SessionArena
+{
+public:
+    static constexpr size_t INITIAL_BYTES = 16384; // Enough for a full five-stage run
+
+private:
+    alignas(max_align_t) unsigned char initialBuffer[INITIAL_BYTES];
+    pmr::monotonic_buffer_resource memory;
+
+public:
+    SessionArena() : memory(initialBuffer, sizeof(initialBuffer)) {}
+    SessionArena(const SessionArena &) = delete;
+    SessionArena &operator=(const SessionArena &) = delete;
+
+    pmr::memory_resource *resource() { return &memory; }
+
+    /** @brief Builds a T in the arena, passing the arena as its last constructor argument. */
+    template <typename T, typename... Args>
+    T *create(Args &&...args)
+    {
+        void *slot = memory.allocate(sizeof(T), alignof(T));
+        return new (slot) T(forward<Args>(args)..., &memory);
+    }
+
+    /** @brief Drops every object of the session at once. */
+    void reset() { memory.release(); }
+};
+
+// ========== Game Context ==========
+/**
+ * @brief Per-run settings shared by every game function.
+ *
+ * A headless context skips all terminal output, screen clears and sleeps so
+ * a run can be simulated at full CPU speed. All random decisions draw from
+ * the context's own generator instead of the global rand(). Battle logging
+ * can be switched off entirely when nothing will ever display it. Units of
+ * the run live in the context's arena and die with it.
+ */
+struct GameContext
+{
+    bool headless = false;
+    bool battleLog = true; // Record battle events; off means every log call returns immediately
+    int firstStage = 1;    // Set by loadGame for a resumed run
+    int waveSize = 0;      // Minions fighting beside each stage's boss; 0 = the boss alone
+    bool endless = false;  // Keep generating stages past the fifth until the hero falls
+    const BossTactics *bossTactics = activeTactics; // One table per stage; point elsewhere to retune the bosses
+    string savePath;       // When set, the run is saved here after every cleared stage
+    Rng rng;
+    SessionArena arena; // Owns the player, bosses and loot of the run
+};
+
+/**
+ * @brief Outcome of a single run through the stages.
+ */
+struct GameResult
+{
+    bool won = false;
+    int stageReached = 0; // Stage the player died in, or the last stage on a win; endless runs always die
+    int turns = 0;        // Combat loop iterations over the whole run
+};
+
+void pauseFor(const GameContext &ctx, int delayMs)
+{
+    if (!ctx.headless)
+        waitFor(delayMs);
+}
+
+// ========== Player Policies ==========
+/**
+ * @brief Source of every player decision made during a run.
+ *
+ * Each method returns the same number the matching menu would accept from
+ * getValidInput, so the combat rules never need to know who is playing.
+ */
+class PlayerPolicy
+{
+public:
+    virtual ~PlayerPolicy() {}
+
+    virtual int chooseCoin() = 0;                                                // 1 = Heads, 2 = Tails
+    virtual int chooseAction(const Unit &player, const Unit &boss) = 0;          // 1-4
+    virtual int chooseSkill(const Unit &player, const Unit &boss) = 0;           // 1-3
+    virtual int choosePotion(const Unit &player) = 0;                            // 0 = cancel, 1..n
+    virtual int chooseUpgrade(const Unit &player) = 0;                           // 1-4
+    virtual int chooseItem(const Unit &player, const LootRoll &items) = 0;       // 1..items.size()
+    // 1 = boss, 2 = weakest minion, 3 = most dangerous; asked only while minions stand
+    virtual int chooseTarget(const Unit &player, const Unit &boss, const EnemyPool &wave) = 0;
+    virtual void acknowledge() {}                                                // "Press Enter to continue..."
+    virtual void observeTurnOrder(bool /*playerFirst*/) {}                       // Told after every coin flip
+};
+
+// Reads every decision from the terminal
+class ConsolePolicy : public PlayerPolicy
+{
+public:
+    int chooseCoin() override { return getValidInput(1, 2, "Your choice: "); }
+    int chooseAction(const Unit &, const Unit &) override { return getValidInput(1, 4, "Choose action: "); }
+    int chooseSkill(const Unit &, const Unit &) override { return getValidInput(1, 3, "Choose skill (1-3): "); }
+    int choosePotion(const Unit &player) override { return getValidInput(0, player.getPotions().size()); }
+    int chooseUpgrade(const Unit &) override { return getValidInput(1, 4, "Choose (1-4): "); }
+    int chooseItem(const Unit &, const LootRoll &items) override
+    {
+        return getValidInput(1, items.size(), "Choose item (1-" + to_string(items.size()) + "): ");
+    }
+    int chooseTarget(const Unit &, const Unit &, const EnemyPool &) override
+    {
+        return getValidInput(1, 3, "Choose target: ");
+    }
+
+    void acknowledge() override { waitForEnter(); }
+};
+
+// Index of the unit's first health (or mana) potion, or -1 if it has none
+int findPotion(const Unit &unit, bool health)
+{
+    const pmr::vector<ItemId> &potions = unit.getPotions();
+    for (size_t i = 0; i < potions.size(); i++)
+    {
+        if (isHealthPotion(potions[i]) == health)
+            return i;
+    }
+    return -1;
+}
+
+// Simple greedy heuristic used for headless balance simulations
+class AutoPolicy : public PlayerPolicy
+{
+private:
+    // Most expensive skill the unit can currently afford, or 0 if none
+    static int bestSkill(const Unit &unit)
+    {
+        int best = 0;
+        int bestCost = -1;
+        for (int i = 1; i <= SKILLS_PER_UNIT; i++)
+        {
+            int cost = unit.getSkillCost(i);
+            if (cost <= unit.getMana() && cost > bestCost)
+            {
+                best = i;
+                bestCost = cost;
+            }
+        }
+        return best;
+    }
+
+    static bool lowHealth(const Unit &unit) { return unit.getHealth() * 3 < unit.getMaxHealth(); }
+
+public:
+    int chooseCoin() override { return 1; }
+
+    int chooseAction(const Unit &player, const Unit &) override
+    {
+        if (lowHealth(player) && findPotion(player, true) >= 0)
+            return 3;
+        if (bestSkill(player) > 0)
+            return 2;
+        if (findPotion(player, false) >= 0)
+            return 3;
+        return 1;
+    }
+
+    int chooseSkill(const Unit &player, const Unit &) override { return max(1, bestSkill(player)); }
+
+    int choosePotion(const Unit &player) override
+    {
+        int index = lowHealth(player) ? findPotion(player, true) : -1;
+        if (index < 0)
+            index = findPotion(player, false);
+        return index + 1;
+    }
+
+    int chooseUpgrade(const Unit &player) override
+    {
+        return player.getHealth() * 2 < player.getMaxHealth() ? 1 : 3;
+    }
+
+    int chooseItem(const Unit &, const LootRoll &) override { return 1; }
+
+    // Boss first (minions only chip at the hero), then the weakest minion to thin the wave fastest
+    int chooseTarget(const Unit &, const Unit &boss, const EnemyPool &) override { return boss.isAlive() ? 1 : 2; }
+};
+
+// ========== Battle Search ==========
+/**
+ * @brief Plain-data copy of one combatant, with the same combat rules as
+ * Unit (takeDamage, heal, useSkill, processStatusEffects) minus logging.
+ */
+struct FighterState
+{
+    int32_t health, maxHealth, mana, maxMana, baseAttack, attack, defense;
+    int8_t status[STATUS_COUNT]; // Turns left, indexed by StatusEffect
+
+    bool isAlive() const { return health > 0; }
+    bool hasStatus(StatusEffect effect) const { return status[(int)effect] > 0; }
+    bool operator==(const FighterState &) const = default;
+
+    void takeDamage(int dmg) { health = max(0, health - max(1, dmg - defense)); }
+    void heal(int amount) { health = min(maxHealth, health + amount); }
+    void restoreMana(int amount) { mana = min(maxMana, mana + amount); }
+    void strike(FighterState &target) const { target.takeDamage(attack); }
+
+    bool useSkill(const SkillDesc &desc, FighterState &target)
+    {
+        if (mana < desc.cost)
+            return false;
+
+        mana -= desc.cost;
+        int dmg = attack + desc.damageBonus;
+        for (int i = 0; i < desc.hits; i++)
+            target.takeDamage(dmg);
+        if (desc.status != StatusEffect::NONE)
+            (desc.statusOnSelf ? *this : target).status[(int)desc.status] = (int8_t)desc.statusDuration;
+        if (desc.drain)
+            heal(dmg / 2);
+        if (desc.selfHeal > 0)
+            heal(desc.selfHeal);
+        return true;
+    }
+
+    void processStatusEffects()
+    {
+        bool attackExpired = false;
+        for (int i = 1; i < STATUS_COUNT; i++)
+        {
+            if (status[i] <= 0)
+                continue;
+
+            switch ((StatusEffect)i)
+            {
+            case StatusEffect::POISON:
+                takeDamage(5);
+                break;
+            case StatusEffect::BLEED:
+                takeDamage(3);
+                break;
+            case StatusEffect::STRENGTH_UP:
+                attack = baseAttack + 10;
+                break;
+            case StatusEffect::WEAKNESS:
+                attack = max(1, baseAttack - 5);
+                break;
+            default:
+                break;
+            }
+
+            if (--status[i] <= 0)
+            {
+                status[i] = 0;
+                attackExpired |= i == (int)StatusEffect::STRENGTH_UP || i == (int)StatusEffect::WEAKNESS;
+            }
+        }
+        if (attackExpired)
+            attack = baseAttack;
+    }
+
+    static FighterState capture(const Unit &unit)
+    {
+        FighterState state = {unit.getHealth(), unit.getMaxHealth(), unit.getMana(), unit.getMaxMana(),
+                              unit.getBaseAttack(), unit.getAttack(), unit.getDefense(), {}};
+        for (int i = 1; i < STATUS_COUNT; i++)
+            state.status[i] = (int8_t)unit.getStatusDuration((StatusEffect)i);
+        return state;
+    }
+};
+
+// Everything the player can do on their turn; SKILL_1..3 are consecutive
+enum class BattleMove : uint8_t
+{
+    ATTACK,
+    SKILL_1,
+    SKILL_2,
+    SKILL_3,
+    HEALTH_POTION,
+    MANA_POTION,
+    PASS
+};
+
+/**
+ * @brief One stage fight as a trivially copyable value. Copying it is the
+ * whole cost of branching, which is what makes tree search affordable.
+ */
+struct BattleState
+{
+    FighterState player;
+    FighterState boss;
+    const SkillDesc *playerSkills;  // SKILLS_PER_UNIT entries
+    const BossTactics *bossTactics; // Null when every boss action is equally likely
+    uint8_t healthPotions;
+    uint8_t manaPotions;
+    bool playerFirst;
+
+    static BattleState capture(const Unit &player, const Unit &boss, bool playerFirst)
+    {
+        const BossUnit *bossUnit = dynamic_cast<const BossUnit *>(&boss);
+        BattleState state = {FighterState::capture(player), FighterState::capture(boss), &player.getSkill(1),
+                             bossUnit ? bossUnit->getTactics() : nullptr, 0, 0, playerFirst};
+        for (ItemId potion : player.getPotions())
+            ++(isHealthPotion(potion) ? state.healthPotions : state.manaPotions);
+        return state;
+    }
+
+    /**
+     * @brief playerTurn on the snapshot; a stunned player loses the move.
+     * @return true if a potion was drunk, which ends the round.
+     */
+    bool playerMove(BattleMove move)
+    {
+        if (player.hasStatus(StatusEffect::STUN))
+        {
+            player.status[(int)StatusEffect::STUN] = 0;
+            return false;
+        }
+
+        switch (move)
+        {
+        case BattleMove::ATTACK:
+            player.strike(boss);
+            break;
+        case BattleMove::SKILL_1:
+        case BattleMove::SKILL_2:
+        case BattleMove::SKILL_3:
+            if (!player.useSkill(playerSkills[(int)move - (int)BattleMove::SKILL_1], boss))
+                player.strike(boss);
+            break;
+        case BattleMove::HEALTH_POTION:
+            if (healthPotions == 0)
+                break;
+            --healthPotions;
+            player.heal(itemDef(ItemId::HEALTH_POTION).healthBonus);
+            return true;
+        case BattleMove::MANA_POTION:
+            if (manaPotions == 0)
+                break;
+            --manaPotions;
+            player.restoreMana(itemDef(ItemId::MANA_POTION).manaBonus);
+            return true;
+        case BattleMove::PASS:
+            break;
+        }
+        return false;
+    }
+
+    // Key into bossTactics for the boss's next decision
+    int bossSituation() const
+    {
+        return BossTactics::situation(boss.health, boss.maxHealth, boss.mana, player.health, player.maxHealth,
+                                      player.hasStatus(StatusEffect::STUN), player.hasStatus(StatusEffect::POISON));
+    }
+
+    // bossTurn on the snapshot, with the action BossUnit::chooseAction picked (0-2 skills, 3 attack)
+    void bossMove(int roll)
+    {
+        if (boss.hasStatus(StatusEffect::STUN))
+        {
+            boss.status[(int)StatusEffect::STUN] = 0;
+            return;
+        }
+
+        if (roll == 3)
+            boss.strike(player);
+        else
+            boss.useSkill(bossSkills[roll], player);
+    }
+};
+static_assert(is_trivially_copyable_v<BattleState>, "BattleState must stay cheap to copy");
+
+/**
+ * @brief Expectimax player: searches `depth` rounds ahead, maximising over
+ * its own moves and weighting the boss's actions by its decision table.
+ *
+ * Leaves are scored by the surviving HP share; won fights score above any
+ * unfinished one and prefer finishing with more HP, MP and potions, since
+ * all of those carry over to the next stage. Upgrades and loot are still
+ * picked by the AutoPolicy heuristics.
+ */
+class SearchPolicy : public AutoPolicy
+{
+private:
+    int depth;
+    bool playerFirst = true;
+    BattleMove planned = BattleMove::ATTACK;
+    long long expansions = 0;
+
+    static double wonValue(const BattleState &state)
+    {
+        const FighterState &p = state.player;
+        return 1.0 + 0.5 * p.health / p.maxHealth + 0.1 * p.mana / max(1, p.maxMana) +
+               0.05 * (state.healthPotions + state.manaPotions);
+    }
+
+    static double leafValue(const BattleState &state)
+    {
+        double player = (double)state.player.health / state.player.maxHealth;
+        double boss = (double)state.boss.health / state.boss.maxHealth;
+        return player / (player + boss);
+    }
+
+    // Worth of the round continuing after the player has moved (and drunk a potion or not)
+    double afterPlayerMove(BattleState state, bool drankPotion, int roundsLeft)
+    {
+        state.player.processStatusEffects();
+        if (!state.player.isAlive())
+            return 0.0;
+        if (!state.boss.isAlive())
+            return wonValue(state);
+        if (drankPotion && state.playerFirst)
+            return roundsLeft > 1 ? playerNode(state, roundsLeft - 1) : leafValue(state); // The boss loses its turn
+
+        if (state.boss.hasStatus(StatusEffect::STUN))
+            return afterBossMove(state, 0, roundsLeft);
+
+        double total = 0.0;
+        if (!state.bossTactics)
+        {
+            for (int action = 0; action < 4; action++)
+                total += afterBossMove(state, action, roundsLeft);
+            return total / 4;
+        }
+
+        int situation = state.bossSituation();
+        for (int action = 0; action < 4; action++)
+        {
+            int weight = state.bossTactics->weight(situation, action);
+            if (weight > 0)
+                total += weight * afterBossMove(state, action, roundsLeft);
+        }
+        return total / state.bossTactics->total(situation);
+    }
+
+    double afterBossMove(BattleState state, int roll, int roundsLeft)
+    {
+        ++expansions;
+        state.bossMove(roll);
+        state.boss.processStatusEffects();
+        if (!state.player.isAlive())
+            return 0.0;
+        if (!state.boss.isAlive())
+            return wonValue(state);
+        return roundsLeft > 1 ? playerNode(state, roundsLeft - 1) : leafValue(state);
+    }
+
+    double playerNode(const BattleState &state, int roundsLeft)
+    {
+        if (state.player.hasStatus(StatusEffect::STUN))
+        {
+            BattleState next = state;
+            next.playerMove(BattleMove::PASS);
+            return afterPlayerMove(next, false, roundsLeft);
+        }
+
+        double best = -1.0;
+        for (int m = (int)BattleMove::ATTACK; m < (int)BattleMove::PASS; m++)
+        {
+            if (!isUseful(state, (BattleMove)m))
+                continue;
+            ++expansions;
+            BattleState next = state;
+            bool drankPotion = next.playerMove((BattleMove)m);
+            best = max(best, afterPlayerMove(next, drankPotion, roundsLeft));
+        }
+        return best;
+    }
+
+    // Skips moves that would only repeat another one: unaffordable skills attack, missing potions pass
+    static bool isUseful(const BattleState &state, BattleMove move)
+    {
+        switch (move)
+        {
+        case BattleMove::SKILL_1:
+        case BattleMove::SKILL_2:
+        case BattleMove::SKILL_3:
+            return state.playerSkills[(int)move - (int)BattleMove::SKILL_1].cost <= state.player.mana;
+        case BattleMove::HEALTH_POTION:
+            return state.healthPotions > 0 && state.player.health < state.player.maxHealth;
+        case BattleMove::MANA_POTION:
+            return state.manaPotions > 0 && state.player.mana < state.player.maxMana;
+        default:
+            return true;
+        }
+    }
+
+public:
+    explicit SearchPolicy(int searchDepth = 3) : depth(max(1, searchDepth)) {}
+
+    long long nodesExpanded() const { return expansions; }
+
+    // The best move for a player who is about to act (not stunned)
+    BattleMove bestMove(const BattleState &state)
+    {
+        BattleMove best = BattleMove::ATTACK;
+        double bestValue = -1.0;
+        for (int m = (int)BattleMove::ATTACK; m < (int)BattleMove::PASS; m++)
+        {
+            if (!isUseful(state, (BattleMove)m))
+                continue;
+            ++expansions;
+            BattleState next = state;
+            bool drankPotion = next.playerMove((BattleMove)m);
+            double value = afterPlayerMove(next, drankPotion, depth);
+            if (value > bestValue)
+            {
+                bestValue = value;
+                best = (BattleMove)m;
+            }
+        }
+        return best;
+    }
+
+    void observeTurnOrder(bool first) override { playerFirst = first; }
+
+    int chooseAction(const Unit &player, const Unit &boss) override
+    {
+        planned = bestMove(BattleState::capture(player, boss, playerFirst));
+        switch (planned)
+        {
+        case BattleMove::ATTACK:
+            return 1;
+        case BattleMove::HEALTH_POTION:
+        case BattleMove::MANA_POTION:
+            return 3;
+        case BattleMove::PASS:
+            return 4;
+        default:
+            return 2;
+        }
+    }
+
+    int chooseSkill(const Unit &, const Unit &) override { return 1 + (int)planned - (int)BattleMove::SKILL_1; }
+
+    int choosePotion(const Unit &player) override
+    {
+        return findPotion(player, planned == BattleMove::HEALTH_POTION) + 1;
+    }
+};
+
+// ========== Enemy Waves ==========
+// Minion stats for a stage; a wave is any number of these fighting beside the stage boss
+int minionAttackForStage(int stage) { return stageScaling.minionAttack.at(stage); }
+int minionHealthForStage(int stage) { return stageScaling.minionHealth.at(stage); }
+
+struct Minion
+{
+    FighterState state;
+    uint16_t number; // 1-based spawn order; survives compaction so the log can name it
+};
+
+/**
+ * @brief The minions of one stage, stored contiguously in the session arena.
+ *
+ * Fallen minions stay in place until compact(), which the TurnScheduler runs
+ * between turns, so indices handed out during one turn stay valid for that
+ * turn. Target queries are single linear passes over the packed states,
+ * which stays in the microseconds for waves of several hundred.
+ */
+class EnemyPool
+{
+private:
+    pmr::vector<Minion> minions;
+
+public:
+    explicit EnemyPool(pmr::memory_resource *resource) : minions(resource) {}
+
+    // Refills the pool with `count` fresh minions; the storage is kept, so one pool serves a whole run
+    void spawn(int count, int stage)
+    {
+        int health = minionHealthForStage(stage);
+        int attack = minionAttackForStage(stage);
+        minions.clear();
+        minions.reserve(count);
+        for (int i = 0; i < count; i++)
+            minions.push_back({{health, health, 0, 0, attack, attack, 0, {}}, (uint16_t)(i + 1)});
+    }
+
+    int size() const { return minions.size(); }
+    bool empty() const { return minions.empty(); }
+    Minion &operator[](int i) { return minions[i]; }
+    const Minion &operator[](int i) const { return minions[i]; }
+
+    int standing() const
+    {
+        int count = 0;
+        for (const Minion &minion : minions)
+            count += minion.state.isAlive();
+        return count;
+    }
+
+    // Index of the standing minion with the least HP, or -1
+    int weakest() const
+    {
+        int best = -1;
+        for (int i = 0; i < size(); i++)
+        {
+            int health = minions[i].state.health;
+            if (health > 0 && (best < 0 || health < minions[best].state.health))
+                best = i;
+        }
+        return best;
+    }
+
+    // Index of the standing minion that hits hardest through `heroDefense` (stunned ones do not hit), or -1
+    int mostDangerous(int heroDefense) const
+    {
+        int best = -1;
+        int bestThreat = -1;
+        for (int i = 0; i < size(); i++)
+        {
+            const FighterState &minion = minions[i].state;
+            if (!minion.isAlive())
+                continue;
+            int threat = minion.hasStatus(StatusEffect::STUN) ? 0 : max(1, minion.attack - heroDefense);
+            if (threat > bestThreat || (threat == bestThreat && minion.health < minions[best].state.health))
+            {
+                best = i;
+                bestThreat = threat;
+            }
+        }
+        return best;
+    }
+
+    // Drops every fallen minion, keeping the survivors in spawn order
+    void compact()
+    {
+        minions.erase(remove_if(minions.begin(), minions.end(), [](const Minion &m) { return !m.state.isAlive(); }),
+                      minions.end());
+    }
+};
+
+void Unit::attackMinion(EnemyPool &wave, int minion)
+{
+    Minion &target = wave[minion];
+    int prevHealth = target.state.health;
+    target.state.takeDamage(currentAttack);
+    battleLog.record(EventKind::MINION_HIT, this, nullptr, 0, max(1, currentAttack - target.state.defense), prevHealth,
+                     target.state.health, target.number);
+}
+
+void Unit::strikeMinions(int skill, int dmg, EnemyPool &wave, int minion)
+{
+    const SkillDesc &desc = getSkill(skill);
+    int first = minion < 0 ? 0 : minion;
+    int last = minion < 0 ? wave.size() : minion + 1;
+    int hit = 0;
+    int defeated = 0;
+    for (int i = first; i < last; i++)
+    {
+        Minion &target = wave[i];
+        if (!target.state.isAlive())
+            continue;
+
+        int prevHealth = target.state.health;
+        for (int h = 0; h < desc.hits; h++)
+            target.state.takeDamage(dmg);
+        if (desc.status != StatusEffect::NONE && !desc.statusOnSelf)
+            target.state.status[(int)desc.status] = (int8_t)desc.statusDuration;
+        ++hit;
+        defeated += !target.state.isAlive();
+        if (minion >= 0)
+            battleLog.record(EventKind::MINION_HIT, this, nullptr, skill, desc.hits * max(1, dmg - target.state.defense),
+                             prevHealth, target.state.health, target.number);
+    }
+    if (minion < 0 && hit > 0)
+        battleLog.record(EventKind::WAVE_SKILL, this, nullptr, skill, hit, defeated);
+}
+
+// ========== Replays ==========
+/**
+ * @brief Everything needed to re-execute one run: its seed, class and the
+ * answer to every PlayerPolicy question in the order the game asked them,
+ * plus the outcome it reached when recorded.
+ */
+struct Replay
+{
+    uint64_t seed = 0;
+    uint8_t classChoice = 1;
+    uint16_t waveSize = 0; // GameContext::waveSize of the run
+    vector<uint8_t> choices;
+
+    bool won = false;
+    uint8_t stageReached = 0; // 0 while the run has not finished
+    uint16_t turns = 0;
+    int16_t finalHealth = 0;
+
+    void begin(uint64_t runSeed, int runClass, int runWaveSize = 0)
+    {
+        seed = runSeed;
+        classChoice = (uint8_t)runClass;
+        waveSize = (uint16_t)runWaveSize;
+        choices.clear();
+        stageReached = 0;
+    }
+
+    void finish(const GameResult &result, const Unit &player)
+    {
+        won = result.won;
+        stageReached = (uint8_t)result.stageReached;
+        turns = (uint16_t)result.turns;
+        finalHealth = (int16_t)player.getHealth();
+    }
+};
+
+/*
+ * Binary layout, little-endian, 21 bytes plus one byte per choice:
+ *   'W' 'R' version class | seed:8 | won<<7 | stage | turns:2 | finalHealth:2 | waveSize:2 | count:2 | choices
+ * Version 1 records lack waveSize (19-byte header) and still decode, as boss-only runs.
+ */
+constexpr uint8_t REPLAY_VERSION = 2;
+constexpr size_t REPLAY_HEADER_BYTES = 21;
+constexpr size_t REPLAY_V1_HEADER_BYTES = 19;
+
+void putLittleEndian(string &out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        out += (char)(value >> (8 * i));
+}
+
+uint64_t getLittleEndian(const string &in, size_t offset, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value |= (uint64_t)(uint8_t)in[offset + i] << (8 * i);
+    return value;
+}
+
+string encodeReplay(const Replay &replay)
+{
+    string out;
+    out.reserve(REPLAY_HEADER_BYTES + replay.choices.size());
+    out += 'W';
+    out += 'R';
+    out += (char)REPLAY_VERSION;
+    out += (char)replay.classChoice;
+    putLittleEndian(out, replay.seed, 8);
+    out += (char)((replay.won ? 0x80 : 0) | replay.stageReached);
+    putLittleEndian(out, replay.turns, 2);
+    putLittleEndian(out, (uint16_t)replay.finalHealth, 2);
+    putLittleEndian(out, replay.waveSize, 2);
+    putLittleEndian(out, replay.choices.size(), 2);
+    out.append(replay.choices.begin(), replay.choices.end());
+    return out;
+}
+
+/**
+ * @brief Decodes the replay starting at `offset` of an archive.
+ * @return Bytes consumed, or 0 if the data there is not a valid replay.
+ */
+size_t decodeReplay(const string &data, size_t offset, Replay &replay)
+{
+    if (data.size() - offset < REPLAY_V1_HEADER_BYTES || data[offset] != 'W' || data[offset + 1] != 'R')
+        return 0;
+    uint8_t version = data[offset + 2];
+    size_t header = version == 1 ? REPLAY_V1_HEADER_BYTES : REPLAY_HEADER_BYTES;
+    if ((version != 1 && version != REPLAY_VERSION) || data.size() - offset < header)
+        return 0;
+
+    size_t count = getLittleEndian(data, offset + header - 2, 2);
+    if (data.size() - offset - header < count)
+        return 0;
+
+    replay.classChoice = data[offset + 3];
+    replay.seed = getLittleEndian(data, offset + 4, 8);
+    replay.won = (uint8_t)data[offset + 12] & 0x80;
+    replay.stageReached = (uint8_t)data[offset + 12] & 0x7F;
+    replay.turns = getLittleEndian(data, offset + 13, 2);
+    replay.finalHealth = (int16_t)getLittleEndian(data, offset + 15, 2);
+    replay.waveSize = version == 1 ? 0 : getLittleEndian(data, offset + 17, 2);
+    const char *choices = data.data() + offset + header;
+    replay.choices.assign(choices, choices + count);
+    return header + count;
+}
+
+// Passes every decision through from another policy and writes it down
+class RecordingPolicy : public PlayerPolicy
+{
+private:
+    PlayerPolicy &inner;
+    vector<uint8_t> &choices;
+
+    int record(int choice)
+    {
+        choices.push_back((uint8_t)choice);
+        return choice;
+    }
+
+public:
+    RecordingPolicy(PlayerPolicy &source, vector<uint8_t> &out) : inner(source), choices(out) {}
+
+    int chooseCoin() override { return record(inner.chooseCoin()); }
+    int chooseAction(const Unit &player, const Unit &boss) override { return record(inner.chooseAction(player, boss)); }
+    int chooseSkill(const Unit &player, const Unit &boss) override { return record(inner.chooseSkill(player, boss)); }
+    int choosePotion(const Unit &player) override { return record(inner.choosePotion(player)); }
+    int chooseUpgrade(const Unit &player) override { return record(inner.chooseUpgrade(player)); }
+    int chooseItem(const Unit &player, const LootRoll &items) override { return record(inner.chooseItem(player, items)); }
+    int chooseTarget(const Unit &player, const Unit &boss, const EnemyPool &wave) override
+    {
+        return record(inner.chooseTarget(player, boss, wave));
+    }
+    void acknowledge() override { inner.acknowledge(); }
+    void observeTurnOrder(bool playerFirst) override { inner.observeTurnOrder(playerFirst); }
+};
+
+// Answers every decision from a recorded replay, in order
+class ReplayPolicy : public PlayerPolicy
+{
+private:
+    const vector<uint8_t> &choices;
+    size_t position = 0;
+    bool overrun = false; // The game asked more questions than were recorded
+
+    int next()
+    {
+        if (position < choices.size())
+            return choices[position++];
+        overrun = true;
+        return 1;
+    }
+
+public:
+    explicit ReplayPolicy(const vector<uint8_t> &recorded) : choices(recorded) {}
+
+    bool consumedExactly() const { return !overrun && position == choices.size(); }
+
+    int chooseCoin() override { return next(); }
+    int chooseAction(const Unit &, const Unit &) override { return next(); }
+    int chooseSkill(const Unit &, const Unit &) override { return next(); }
+    int choosePotion(const Unit &) override { return next(); }
+    int chooseUpgrade(const Unit &) override { return next(); }
+    int chooseItem(const Unit &, const LootRoll &) override { return next(); }
+    int chooseTarget(const Unit &, const Unit &, const EnemyPool &) override { return next(); }
+};
+
+// ========== Game Functions ==========
+bool coinFlip(PlayerPolicy &policy, GameContext &ctx)
+{
+    if (!ctx.headless)
+    {
+        cout << "\n=== COIN FLIP TO DETERMINE TURN ORDER ===\n";
+        cout << "Choose: 1. Heads  2. Tails\n";
+    }
+
+    int choice = policy.chooseCoin();
+    bool coinResult = (ctx.rng.below(2) == 0);
+    bool playerWon = (choice == 1 && coinResult) || (choice == 2 && !coinResult);
+
+    if (ctx.headless)
+        return playerWon;
+
+    string coinName = coinResult ? "Heads" : "Tails";
+
+    cout << "\nFlipping coin...\n";
+    pauseFor(ctx, 1000);
+    cout << "Result: " << coinName << "!\n";
+
+    if (playerWon)
+    {
+        cout << "\033[1;32mYou won the coin flip! You go first!\033[0m\n";
+    }
+    else
+    {
+        cout << "\033[1;31mYou lost the coin flip! Enemy goes first!\033[0m\n";
+    }
+
+    pauseFor(ctx, 2000);
+    return playerWon;
+}
+
+/**
+ * @brief Whether action 1-4 (with `skill` for action 2) hits a single enemy
+ * while minions stand, so the player has to say which one. A skill the
+ * player cannot afford becomes a basic attack, which needs a target too.
+ */
+bool needsTarget(const Unit &player, int action, int skill, const EnemyPool &wave)
+{
+    if (wave.standing() == 0 || (action != 1 && action != 2))
+        return false;
+    if (action == 1 || skill < 1 || skill > SKILLS_PER_UNIT || player.getMana() < player.getSkillCost(skill))
+        return true;
+    const SkillDesc &desc = player.getSkill(skill);
+    return !desc.area && (desc.hits > 0 || !desc.statusOnSelf);
+}
+
+void showTargetMenu(const Unit &player, const Unit &boss, const EnemyPool &wave, ostream &out = cout)
+{
+    int weakest = wave.weakest();
+    int dangerous = wave.mostDangerous(player.getDefense());
+    out << "\n=== CHOOSE TARGET ===\n";
+    out << "1. " << boss.getName() << " (HP: " << boss.getHealth() << "/" << boss.getMaxHealth() << ")"
+        << (boss.isAlive() ? "" : " - defeated, hits the weakest minion") << "\n";
+    // With no minion standing, choices 2 and 3 fall back to the boss in resolveTarget
+    if (weakest < 0)
+        out << "2. Weakest minion - none standing, hits " << boss.getName() << "\n";
+    else
+        out << "2. Weakest minion (#" << wave[weakest].number << ", HP: " << wave[weakest].state.health << ")\n";
+    if (dangerous < 0)
+        out << "3. Most dangerous minion - none standing, hits " << boss.getName() << "\n";
+    else
+        out << "3. Most dangerous minion (#" << wave[dangerous].number << ", ATK: " << wave[dangerous].state.attack
+            << ")\n";
+}
+
+// Minion index that target choice 1-3 lands on, or -1 for the boss; a fallen boss redirects to the weakest minion
+int resolveTarget(int choice, const Unit &player, const Unit &boss, const EnemyPool &wave)
+{
+    int minion = -1;
+    if (choice == 2)
+        minion = wave.weakest();
+    else if (choice == 3)
+        minion = wave.mostDangerous(player.getDefense());
+    if (minion < 0 && !boss.isAlive())
+        minion = wave.weakest();
+    return minion;
+}
+
+// Asks for a target when the action needs one; -1 means the boss
+int aimAction(Unit *player, Unit *boss, const EnemyPool &wave, int action, int skill, PlayerPolicy &policy,
+              const GameContext &ctx)
+{
+    if (!needsTarget(*player, action, skill, wave))
+        return -1;
+    if (!ctx.headless)
+        showTargetMenu(*player, *boss, wave);
+    return resolveTarget(policy.chooseTarget(*player, *boss, wave), *player, *boss, wave);
+}
+
+void attackTarget(Unit *player, Unit *boss, EnemyPool &wave, int minion)
+{
+    if (minion >= 0)
+        player->attackMinion(wave, minion);
+    else
+        player->attack(*boss);
+}
+
+void showSkillsMenu(Unit *player, Unit *target, EnemyPool &wave, PlayerPolicy &policy, const GameContext &ctx)
+{
+    if (!ctx.headless)
+    {
+        cout << "\n=== SKILLS MENU ===\n";
+        for (int i = 1; i <= SKILLS_PER_UNIT; i++)
+            cout << i << ". " << player->getSkill(i).name << " (Cost: " << player->getSkillCost(i) << " MP)\n";
+    }
+
+    int skillChoice = policy.chooseSkill(*player, *target);
+    int minion = aimAction(player, target, wave, 2, skillChoice, policy, ctx);
+
+    bool skillUsed = skillChoice >= 1 && skillChoice <= SKILLS_PER_UNIT &&
+                     player->useSkill(skillChoice, *target, &wave, minion);
+
+    if (!skillUsed)
+    {
+        if (!ctx.headless)
+            cout << "Using basic attack instead.\n";
+        attackTarget(player, target, wave, minion);
+    }
+}
+
+/**
+ * @brief Shows equipment and potions and lets the player drink one.
+ * @return true if a potion was used (which ends the player's turn).
+ */
+bool showInventory(Unit *player, bool &usedPotion, PlayerPolicy &policy, const GameContext &ctx)
+{
+    const pmr::vector<ItemId> &equipment = player->getEquipment();
+    const pmr::vector<ItemId> &potions = player->getPotions();
+
+    if (!ctx.headless)
+        cout << "\n=== INVENTORY ===\n";
+
+    if (equipment.empty() && potions.empty())
+    {
+        if (!ctx.headless)
+        {
+            cout << "Inventory is empty.\n";
+            cout << "\nPress Enter to continue...";
+        }
+        policy.acknowledge();
+        return false;
+    }
+
+    if (!ctx.headless && !equipment.empty())
+    {
+        cout << "Equipment:\n";
+        for (ItemId item : equipment)
+        {
+            cout << "- ";
+            displayItemInfo(item);
+        }
+    }
+
+    if (!potions.empty())
+    {
+        if (!ctx.headless)
+        {
+            cout << "\nPotions:\n";
+            for (size_t i = 0; i < potions.size(); i++)
+            {
+                cout << i + 1 << ". ";
+                displayPotionInfo(potions[i]);
+            }
+
+            cout << "\nEnter potion number to use (0 to cancel): ";
+        }
+        int choice = policy.choosePotion(*player);
+
+        if (choice > 0)
+        {
+            player->usePotion(choice - 1);
+            usedPotion = true;
+            return true;
+        }
+    }
+    else
+    {
+        if (!ctx.headless)
+            cout << "\nPress Enter to continue...";
+        policy.acknowledge();
+    }
+    return false;
+}
+
+/**
+ * @brief Picks 3 distinct equipment items with a partial Fisher-Yates shuffle
+ * over catalog indices.
+ */
+LootRoll generateRandomItems(Rng &rng)
+{
+    ItemId pool[EQUIPMENT_COUNT];
+    for (int i = 0; i < EQUIPMENT_COUNT; i++)
+        pool[i] = (ItemId)i;
+
+    LootRoll selectedItems;
+    for (int i = 0; i < 3; i++)
+    {
+        int randomIndex = i + rng.below(EQUIPMENT_COUNT - i);
+        swap(pool[i], pool[randomIndex]);
+        selectedItems.push(pool[i]);
+    }
+
+    return selectedItems;
+}
+
+LootRoll generateRandomPotions(Rng &rng)
+{
+    LootRoll potions;
+    int numPotions = rng.below(3) + 1; // 1-3 potions
+
+    for (int i = 0; i < numPotions; i++)
+    {
+        potions.push(rng.below(2) == 0 ? ItemId::HEALTH_POTION : ItemId::MANA_POTION);
+    }
+
+    return potions;
+}
+
+// Display name of class 1-3, as the class menu lists them
+const char *className(int classChoice)
+{
+    static const char *const names[4] = {"", "Warrior", "Archer", "Mage"};
+    return names[classChoice];
+}
+
+/**
+ * @brief Creates a hero of the given class (1 = Warrior, 2 = Archer, 3 = Mage).
+ */
+Unit *createPlayerOfClass(SessionArena &arena, int classChoice, const string &playerName)
+{
+    switch (classChoice)
+    {
+    case 1:
+        return arena.create<Warrior>(playerName);
+    case 2:
+        return arena.create<Archer>(playerName);
+    case 3:
+        return arena.create<Mage>(playerName);
+    default:
+        return arena.create<Warrior>(playerName);
+    }
+}
+
+// Asks which class the named hero should be; 1 = Warrior, 2 = Archer, 3 = Mage
+int chooseClass(const string &playerName)
+{
+    cout << "\nSelect a class for " << playerName << ":\n"
+         << "1. Warrior (High HP, Medium MP, Physical skills)\n"
+         << "2. Archer (Medium HP, Poison/Bleed skills)\n"
+         << "3. Mage (Low HP, High MP, Magic skills)\n";
+
+    return getValidInput(1, 3, "Choose (1-3): ");
+}
+
+// The wave's line of the battle header; nothing once every minion is down
+void displayWave(const EnemyPool &wave, ostream &out)
+{
+    if (int standing = wave.standing())
+    {
+        int weakest = wave.weakest();
+        out << "Wave - \033[1;31m" << standing << "\033[0m minion" << (standing == 1 ? "" : "s") << " standing"
+            << ", weakest #" << wave[weakest].number << " at " << wave[weakest].state.health << " HP\n";
+    }
+}
+
+void displayBattleHeader(int stage, Unit *player, Unit *boss, const EnemyPool &wave, ostream &out = cout)
+{
+    out << "========================================\n";
+    out << "| STAGE " << stage << " BATTLE";
+    out << string(30 - to_string(stage).length(), ' ') << "|\n";
+    out << "========================================\n";
+
+    out << "\n=== YOUR STATUS ===\n";
+    player->displayStatus(out);
+
+    out << "\n=== ENEMY STATUS ===\n";
+    boss->displayStatus(out);
+    displayWave(wave, out);
+    out << "\n";
+}
+
+// Clears the screen and redraws the header and the player's battle log
+void renderBattle(int stage, Unit *player, Unit *boss, const EnemyPool &wave, const GameContext &ctx)
+{
+    if (!ctx.headless)
+    {
+        PhaseTimer timer(Phase::RENDER);
+        clearScreen();
+        displayBattleHeader(stage, player, boss, wave);
+        player->displayBattleLog();
+    }
+    player->clearBattleLog();
+    boss->clearBattleLog();
+}
+
+/**
+ * @brief Resolves one player turn (stun check, action menu, chosen action).
+ * @return true if the player drank a potion, which ends the whole round.
+ */
+bool playerTurn(Unit *player, Unit *boss, EnemyPool &wave, PlayerPolicy &policy, const GameContext &ctx, bool echoStun)
+{
+    PhaseTimer timer(Phase::PLAYER_TURN);
+    if (player->hasStatus(StatusEffect::STUN))
+    {
+        player->getBattleLog().record(EventKind::STUN_SKIP, player);
+        if (echoStun && !ctx.headless)
+            cout << "\033[1;35mYou are stunned and skip your turn!\033[0m\n";
+        player->clearStatus(StatusEffect::STUN);
+        return false;
+    }
+
+    player->getBattleLog().record(EventKind::TURN_START, player);
+    if (!ctx.headless)
+    {
+        cout << "\n=== YOUR TURN ===\n";
+        cout << "1. Attack\n2. Use Skills\n3. Inventory\n4. Pass\n";
+    }
+
+    int action = policy.chooseAction(*player, *boss);
+    bool usedPotion = false;
+
+    switch (action)
+    {
+    case 1:
+        attackTarget(player, boss, wave, aimAction(player, boss, wave, 1, 0, policy, ctx));
+        break;
+    case 2:
+        showSkillsMenu(player, boss, wave, policy, ctx);
+        break;
+    case 3:
+        if (showInventory(player, usedPotion, policy, ctx))
+            return true;
+        break;
+    case 4:
+        player->getBattleLog().record(EventKind::PASS, player);
+        if (!ctx.headless)
+            cout << "You pass your turn.\n";
+        break;
+    }
+    return false;
+}
+
+void bossTurn(BossUnit *boss, Unit *player, GameContext &ctx)
+{
+    PhaseTimer timer(Phase::BOSS_TURN);
+    player->getBattleLog().record(EventKind::TURN_START, boss);
+    if (!ctx.headless)
+        cout << "\n=== " << boss->getName() << "'s TURN ===\n";
+    pauseFor(ctx, 800);
+
+    if (boss->hasStatus(StatusEffect::STUN))
+    {
+        player->getBattleLog().record(EventKind::STUN_SKIP, boss);
+        if (!ctx.headless)
+            cout << "\033[1;35m" << boss->getName() << " is stunned and skips turn!\033[0m\n";
+        boss->clearStatus(StatusEffect::STUN);
+        return;
+    }
+
+    int bossAction = boss->chooseAction(*player, ctx.rng);
+
+    if (bossAction == 3)
+        player->getBattleLog().record(EventKind::CHOOSE_ATTACK, boss);
+    else
+        player->getBattleLog().record(EventKind::ANNOUNCE_SKILL, boss, nullptr, bossAction + 1);
+
+    if (!ctx.headless)
+    {
+        if (bossAction == 3)
+            cout << boss->getName() << " chooses to attack!" << endl;
+        else
+            cout << boss->getName() << " uses " << boss->getSkill(bossAction + 1).name << "!" << endl;
+    }
+
+    if (bossAction == 3)
+        boss->attack(*player);
+    else
+        boss->useSkill(bossAction + 1, *player);
+}
+
+/**
+ * @brief Every standing minion strikes at once; stunned ones shake off the
+ * stun instead. Blows are summed and land as one hit, so a turn of a huge
+ * wave is a single pass over the pool.
+ */
+void waveTurn(EnemyPool &wave, Unit *player, GameContext &ctx)
+{
+    PhaseTimer timer(Phase::WAVE_TURN);
+    if (!ctx.headless)
+        cout << "\n=== THE WAVE's TURN ===\n";
+    pauseFor(ctx, 800);
+
+    int attackers = 0;
+    int total = 0;
+    for (int i = 0; i < wave.size(); i++)
+    {
+        FighterState &minion = wave[i].state;
+        if (!minion.isAlive())
+            continue;
+        if (minion.hasStatus(StatusEffect::STUN))
+        {
+            minion.status[(int)StatusEffect::STUN] = 0;
+        }
+        else
+        {
+            ++attackers;
+            total += max(1, minion.attack - player->getDefense());
+        }
+        minion.processStatusEffects();
+    }
+
+    if (attackers == 0)
+        return;
+    player->getBattleLog().record(EventKind::WAVE_ATTACK, player, nullptr, 0, attackers);
+    player->takeBarrage(total);
+}
+
+/**
+ * @brief Initiative queue of one battle: who acts, in which order, each round.
+ *
+ * Actor 0 is the hero and actors 1..n are the enemies in the order they
+ * were added; a minion wave acts as one more actor, WAVE, after them. The
+ * coin-flip winner's side opens every round. A round ends early once the
+ * fight is decided (hero down, or every enemy and minion down) or when
+ * endRound() is called; a potion ends the round that way. Downed enemies
+ * lose their turns, and fallen minions are compacted out of the wave at
+ * every turn boundary. Both the blocking gameLoop and the coroutine playRun
+ * drive their battles through this one queue.
+ */
+class TurnScheduler
+{
+public:
+    static constexpr int MAX_ENEMIES = 7;
+    static constexpr int PLAYER = 0;
+    static constexpr int ROUND_OVER = -1;
+    static constexpr int WAVE = MAX_ENEMIES + 1;
+
+private:
+    Unit *player;
+    BossUnit *enemies[MAX_ENEMIES];
+    int enemyCount = 0;
+    EnemyPool *wave = nullptr;
+    bool playerFirst;
+    int order[MAX_ENEMIES + 2];
+    int actorCount = 0;  // Used slots of `order`
+    int cursor = 0;      // Next slot of `order` this round
+    bool ended = false;  // endRound() was called
+
+    void buildOrder()
+    {
+        int slot = 0;
+        if (playerFirst)
+            order[slot++] = PLAYER;
+        for (int i = 1; i <= enemyCount; i++)
+            order[slot++] = i;
+        if (wave)
+            order[slot++] = WAVE;
+        if (!playerFirst)
+            order[slot++] = PLAYER;
+        actorCount = slot;
+    }
+
+public:
+    TurnScheduler(Unit *hero, bool heroFirst) : player(hero), playerFirst(heroFirst) { buildOrder(); }
+
+    void addEnemy(BossUnit *enemy)
+    {
+        if (enemyCount < MAX_ENEMIES)
+            enemies[enemyCount++] = enemy;
+        buildOrder();
+    }
+
+    void setWave(EnemyPool *minions)
+    {
+        wave = minions;
+        buildOrder();
+    }
+
+    BossUnit *enemy(int actor) const { return enemies[actor - 1]; }
+
+    bool enemiesAlive() const
+    {
+        for (int i = 0; i < enemyCount; i++)
+            if (enemies[i]->isAlive())
+                return true;
+        return wave && wave->standing() > 0;
+    }
+
+    bool decided() const { return !player->isAlive() || !enemiesAlive(); }
+
+    // Starts the next round; false once the fight is decided
+    bool beginRound()
+    {
+        cursor = 0;
+        ended = false;
+        return !decided();
+    }
+
+    // Actor whose turn it is, or ROUND_OVER
+    int nextActor()
+    {
+        if (wave)
+            wave->compact();
+        while (!ended && cursor < actorCount && !decided())
+        {
+            int actor = order[cursor++];
+            if (actor == PLAYER || (actor == WAVE ? !wave->empty() : enemy(actor)->isAlive()))
+                return actor;
+        }
+        return ROUND_OVER;
+    }
+
+    void endRound() { ended = true; }
+
+    // Whether the hero's side opens the rounds
+    bool playerLeads() const { return playerFirst; }
+
+    // True once someone has already moved this round, so the hero's turn is not the first on screen
+    bool othersActed() const { return cursor > 1; }
+};
+
+// Boss stats for a stage; shared by gameLoop and BattleBatch
+int bossAttackForStage(int stage) { return stageScaling.bossAttack.at(stage); }
+int bossHealthForStage(int stage) { return stageScaling.bossHealth.at(stage); }
+int bossDefenseForStage(int stage) { return stageScaling.bossDefense.at(stage); }
+
+/**
+ * @brief The boss of any stage: the roster for stages 1-5, then the roster
+ * again with a new epithet every lap, stats following the same formulas and
+ * the stage 5 tactics.
+ * @param reuse Previous stage's boss to turn into this one instead of creating another
+ */
+BossUnit *spawnBoss(int stage, GameContext &ctx, BossUnit *reuse = nullptr)
+{
+    const BossDef &def = bossRoster[(stage - 1) % 5];
+    int lap = (stage - 1) / 5;
+    string_view epithet = lap == 0 ? string_view() : bossEpithets[(lap - 1) % size(bossEpithets)];
+
+    BossUnit *boss = reuse ? reuse : ctx.arena.create<BossUnit>("", "", "", "", 0, 1, 0);
+    boss->respawn(epithet, def, bossAttackForStage(stage), bossHealthForStage(stage), bossDefenseForStage(stage));
+    boss->getBattleLog().setEnabled(ctx.battleLog);
+    boss->setTactics(&ctx.bossTactics[min(stage, 5) - 1]);
+    return boss;
+}
+
+// Boss drop: 1-3 random potions straight into the player's inventory
+void dropPotions(Unit *player, Rng &rng)
+{
+    LootRoll droppedPotions = generateRandomPotions(rng);
+    for (int i = 0; i < droppedPotions.size(); i++)
+    {
+        player->addItem(droppedPotions[i]);
+    }
+}
+
+// Applies choice 1-4 of the stage-complete upgrade menu
+void applyUpgrade(Unit *player, int upgrade)
+{
+    switch (upgrade)
+    {
+    case 1:
+        player->heal(30);
+        break;
+    case 2:
+        player->restoreMana(20);
+        break;
+    case 3:
+        player->increaseAttack(5);
+        break;
+    case 4:
+        player->increaseDefense(3);
+        break;
+    }
+}
+
+// ========== Save Games ==========
+/**
+ * @brief On-disk checkpoint of a run between two stages.
+ *
+ * A fixed-size, padding-free block in host byte order, so a save can be
+ * mapped straight into memory and validated where it lies: no parsing and
+ * no allocation. Any change to the layout must bump SAVE_VERSION.
+ */
+constexpr uint16_t SAVE_VERSION = 2;
+constexpr int MAX_SAVED_NAME = 32; // Including the terminating NUL
+
+struct SaveGame
+{
+    char magic[4];      // "WHGS"
+    uint16_t version;   // SAVE_VERSION
+    uint16_t size;      // sizeof(SaveGame)
+    uint32_t checksum;  // FNV-1a over every byte after this field
+    uint8_t classChoice; // 1 = Warrior, 2 = Archer, 3 = Mage
+    uint8_t endless;     // 1 for an endless run
+    uint16_t stage;      // Next stage to fight, 2-5 (any from 2 when endless)
+    char name[MAX_SAVED_NAME];
+    uint64_t rngState[4];
+    UnitState player;
+};
+static_assert(is_trivially_copyable_v<SaveGame> && sizeof(SaveGame) == 176, "SaveGame layout changed");
+
+uint32_t saveChecksum(const SaveGame &save)
+{
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&save);
+    uint32_t hash = 2166136261u;
+    for (size_t i = offsetof(SaveGame, checksum) + sizeof(save.checksum); i < sizeof(SaveGame); i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+// Which class a hero was created as, recognised by its skill table; 0 for anything else
+int classOfPlayer(const Unit &player)
+{
+    const SkillDesc *skills = &player.getSkill(1);
+    if (skills == warriorSkills)
+        return 1;
+    if (skills == archerSkills)
+        return 2;
+    if (skills == mageSkills)
+        return 3;
+    return 0;
+}
+
+/**
+ * @brief Writes a checkpoint for resuming at `nextStage`. The file is
+ * replaced atomically, so a crash mid-write keeps the previous save.
+ */
+bool saveGame(const string &path, const Unit &player, int nextStage, const Rng &rng, bool endless = false)
+{
+    SaveGame save;
+    memset(&save, 0, sizeof(save));
+    memcpy(save.magic, "WHGS", 4);
+    save.version = SAVE_VERSION;
+    save.size = sizeof(SaveGame);
+    save.classChoice = (uint8_t)classOfPlayer(player);
+    save.endless = endless;
+    save.stage = (uint16_t)nextStage;
+    player.getName().copy(save.name, MAX_SAVED_NAME - 1);
+    rng.saveState(save.rngState);
+    if (save.classChoice == 0 || nextStage > UINT16_MAX || !player.captureState(save.player))
+        return false;
+    save.checksum = saveChecksum(save);
+
+    string temporary = path + ".tmp";
+    {
+        ofstream file(temporary, ios::binary | ios::trunc);
+        file.write(reinterpret_cast<const char *>(&save), sizeof(save));
+        if (!file)
+            return false;
+    }
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+/**
+ * @brief Checks a save in place.
+ * @return nullptr if it can be resumed, otherwise why not.
+ */
+const char *validateSave(const SaveGame &save)
+{
+    if (memcmp(save.magic, "WHGS", 4) != 0)
+        return "not a save game";
+    if (save.version != SAVE_VERSION || save.size != sizeof(SaveGame))
+        return "saved by an incompatible version";
+    if (save.checksum != saveChecksum(save))
+        return "checksum mismatch";
+    if (save.classChoice < 1 || save.classChoice > 3 || save.endless > 1 || save.stage < 2 ||
+        (!save.endless && save.stage > 5))
+        return "invalid class or stage";
+    if (memchr(save.name, '\0', MAX_SAVED_NAME) == nullptr)
+        return "unterminated name";
+
+    const UnitState &unit = save.player;
+    if (unit.health <= 0 || unit.health > unit.maxHealth || unit.mana < 0 || unit.mana > unit.maxMana ||
+        unit.baseAttack <= 0 || unit.currentAttack <= 0 || unit.defense < 0)
+        return "invalid stats";
+    if (unit.equipmentCount > MAX_SAVED_EQUIPMENT || unit.potionCount > MAX_SAVED_POTIONS)
+        return "too many items";
+    for (int i = 0; i < unit.equipmentCount; i++)
+        if ((int)unit.equipment[i] >= EQUIPMENT_COUNT)
+            return "invalid equipment";
+    for (int i = 0; i < unit.potionCount; i++)
+        if ((int)unit.potions[i] < EQUIPMENT_COUNT || (int)unit.potions[i] >= (int)size(itemCatalog))
+            return "invalid potion";
+    for (int i = 0; i < STATUS_COUNT; i++)
+    {
+        bool active = unit.activeStatus & statusBit((StatusEffect)i);
+        if (unit.statusDurations[i] < 0 || active != (unit.statusDurations[i] > 0))
+            return "invalid status effects";
+    }
+    if (unit.activeStatus >> STATUS_COUNT)
+        return "invalid status effects";
+    return nullptr;
+}
+
+/**
+ * @brief Read-only view of a whole file: memory-mapped where the platform
+ * allows it, read into a buffer otherwise.
+ */
+class MappedFile
+{
+private:
+    const void *data = nullptr;
+    size_t bytes = 0;
+#if defined(__unix__) || defined(__APPLE__)
+    void *mapping = MAP_FAILED;
+#else
+    vector<char> buffer;
+#endif
+
+public:
+    explicit MappedFile(const string &path)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                data = mapping;
+                bytes = info.st_size;
+            }
+        }
+        close(fd);
+#else
+        ifstream file(path, ios::binary);
+        buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        data = buffer.data();
+        bytes = buffer.size();
+#endif
+    }
+
+    ~MappedFile()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        if (mapping != MAP_FAILED)
+            munmap(mapping, bytes);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool isOpen() const { return data != nullptr; }
+    size_t size() const { return bytes; }
+    const void *contents() const { return data; }
+};
+
+/**
+ * @brief Restores a saved run into `ctx`: the hero is rebuilt in its arena,
+ * the generator state is put back and ctx.firstStage is set so gameLoop
+ * picks up at the saved stage.
+ * @return The hero, or nullptr (after printing why) if the save is unusable.
+ */
+Unit *loadGame(const string &path, GameContext &ctx)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+    {
+        cerr << "Cannot open save game " << path << "\n";
+        return nullptr;
+    }
+
+    // A mapping is page-aligned, and the read-in fallback is aligned for any object
+    const char *problem = file.size() == sizeof(SaveGame) ? nullptr : "wrong file size";
+    const SaveGame &save = *static_cast<const SaveGame *>(file.contents());
+    if (!problem)
+        problem = validateSave(save);
+    if (problem)
+    {
+        cerr << "Cannot load " << path << ": " << problem << "\n";
+        return nullptr;
+    }
+
+    Unit *player = createPlayerOfClass(ctx.arena, save.classChoice, save.name);
+    player->restoreState(save.player);
+    ctx.rng.restoreState(save.rngState);
+    ctx.firstStage = save.stage;
+    ctx.endless = save.endless;
+    return player;
+}
+
+// Called after each stage's rewards; a failed autosave is reported but never ends the run
+void autosave(const Unit &player, int nextStage, const GameContext &ctx)
+{
+    if (!ctx.savePath.empty() && !saveGame(ctx.savePath, player, nextStage, ctx.rng, ctx.endless))
+        cerr << "Cannot write save game " << ctx.savePath << "\n";
+}
+
+GameResult gameLoop(Unit *player, PlayerPolicy &policy, GameContext &ctx)
+{
+    GameResult result;
+    BossUnit *boss = nullptr;
+    EnemyPool wave(ctx.arena.resource());
+
+    for (int stage = ctx.firstStage; ctx.endless || stage <= 5; ++stage)
+    {
+        result.stageReached = stage;
+
+        boss = spawnBoss(stage, ctx, boss);
+        wave.spawn(ctx.waveSize, stage);
+        player->getBattleLog().setEnabled(ctx.battleLog);
+
+        if (!ctx.headless)
+        {
+            cout << "\n--- ENEMY APPEARED ---\n";
+            boss->displayStatus();
+            if (!wave.empty())
+                cout << "...leading a wave of " << wave.size() << " minions!\n";
+        }
+
+        // Coin flip for turn order
+        bool playerFirst = coinFlip(policy, ctx);
+        policy.observeTurnOrder(playerFirst);
+
+        // Combat loop
+        TurnScheduler turns(player, playerFirst);
+        turns.addEnemy(boss);
+        if (!wave.empty())
+            turns.setWave(&wave);
+        while (turns.beginRound())
+        {
+            ++result.turns;
+            renderBattle(stage, player, boss, wave, ctx);
+
+            for (int actor; (actor = turns.nextActor()) != TurnScheduler::ROUND_OVER;)
+            {
+                if (actor == TurnScheduler::WAVE)
+                {
+                    waveTurn(wave, player, ctx);
+                    continue;
+                }
+                if (actor != TurnScheduler::PLAYER)
+                {
+                    BossUnit *enemy = turns.enemy(actor);
+                    bossTurn(enemy, player, ctx);
+                    enemy->processStatusEffects();
+                    continue;
+                }
+
+                // Show what the enemies did before asking for the player's move
+                if (turns.othersActed())
+                    renderBattle(stage, player, boss, wave, ctx);
+                bool usedPotion = playerTurn(player, boss, wave, policy, ctx, turns.othersActed());
+                player->processStatusEffects();
+                if (usedPotion)
+                    turns.endRound();
+            }
+
+            pauseFor(ctx, 1000);
+        }
+
+        if (!player->isAlive())
+        {
+            if (!ctx.headless)
+            {
+                PhaseTimer timer(Phase::RENDER);
+                clearScreen();
+                displayBattleHeader(stage, player, boss, wave);
+                cout << "\n\033[1;31mYou were defeated in stage " << stage << "!\033[0m\n";
+            }
+            break;
+        }
+
+        // Boss defeated; the log still refers to the boss, so flush it before the next stage
+        if (!ctx.headless)
+        {
+            PhaseTimer timer(Phase::RENDER);
+            clearScreen();
+            displayBattleHeader(stage, player, boss, wave);
+            player->displayBattleLog();
+            cout << "\n\033[1;32mYou defeated " << boss->getName() << (ctx.waveSize > 0 ? " and the wave" : "")
+                 << "!\033[0m\n";
+        }
+        player->clearBattleLog();
+
+        PhaseTimer reward(Phase::REWARD); // Through the end of the stage
+        dropPotions(player, ctx.rng);
+
+        if (ctx.endless || stage < 5)
+        {
+            // Stage upgrade system
+            if (!ctx.headless)
+            {
+                cout << "\n=== STAGE COMPLETE! CHOOSE UPGRADE ===\n";
+                cout << "1. Heal (+30 HP)\n";
+                cout << "2. Restore Mana (+20 MP)\n";
+                cout << "3. Increase Attack (+5 ATK)\n";
+                cout << "4. Increase Defense (+3 DEF)\n";
+            }
+
+            applyUpgrade(player, policy.chooseUpgrade(*player));
+
+            // Item selection system
+            LootRoll itemChoices = generateRandomItems(ctx.rng);
+
+            if (!ctx.headless)
+            {
+                cout << "\n=== ITEM SELECTION ===\n";
+                cout << "Choose 1 item from the following 3 options:\n";
+
+                for (int i = 0; i < itemChoices.size(); i++)
+                {
+                    cout << (i + 1) << ". ";
+                    displayItemInfo(itemChoices[i]);
+                }
+            }
+
+            int itemChoice = policy.chooseItem(*player, itemChoices);
+
+            player->addItem(itemChoices[itemChoice - 1]);
+            autosave(*player, stage + 1, ctx);
+
+            pauseFor(ctx, 2000);
+        }
+    }
+
+    if (player->isAlive())
+    {
+        result.won = true;
+        if (!ctx.headless)
+        {
+            cout << "\n\033[1;32m=== CONGRATULATIONS! ===\033[0m\n";
+            cout << "\033[1;33mYou defeated all bosses and conquered the dungeon!\033[0m\n";
+            cout << "\n=== FINAL STATUS ===\n";
+            player->displayStatus();
+        }
+    }
+
+    return result;
+}
+
+// ========== Content Packs ==========
+/**
+ * @brief Binary content pack: every table above that a designer tunes,
+ * compiled offline from a text source by --build-content.
+ *
+ * Layout: ContentHeader, then the records in a fixed order (3 PackClass,
+ * 12 PackSkill for the Warrior, Archer, Mage and boss tables, 8 PackItem,
+ * 5 PackBoss, 1 StageScaling), then a string table that PackString fields
+ * index into. All of it is fixed-size and padding-free in host byte order,
+ * so a pack is mapped and validated where it lies, like a save game, and
+ * the game tables end up pointing into the mapping. Any change to the
+ * layout must bump CONTENT_VERSION.
+ */
+constexpr uint16_t CONTENT_VERSION = 1;
+constexpr int PACK_SKILLS = 4 * SKILLS_PER_UNIT;
+constexpr int PACK_MAX_HITS = 8; // Hits per skill use; the built-in skills use at most 2
+
+struct ContentHeader
+{
+    char magic[4];        // "WHGC"
+    uint16_t version;     // CONTENT_VERSION
+    uint16_t headerSize;  // sizeof(ContentHeader)
+    uint32_t checksum;    // FNV-1a over every byte after this field
+    uint32_t stringBytes; // Size of the trailing string table
+};
+
+struct PackString
+{
+    uint32_t offset; // Into the string table
+    uint32_t length;
+};
+
+struct PackClass
+{
+    ClassStats stats;
+};
+
+// SkillDesc flags, one bit each
+enum PackSkillFlag : uint8_t
+{
+    SHOW_DAMAGE = 1,
+    STATUS_ON_SELF = 2,
+    ANNOUNCE_STATUS = 4,
+    DRAIN = 8,
+    AREA = 16
+};
+
+struct PackSkill
+{
+    PackString name;
+    PackString usePhrase;
+    int32_t cost, hits, damageBonus, statusDuration, selfHeal;
+    uint8_t status; // StatusEffect
+    uint8_t flags;  // PackSkillFlag bits
+    uint8_t unused[2];
+};
+
+struct PackItem
+{
+    PackString name;
+    PackString description;
+    int32_t type; // ItemType
+    int32_t attackBonus, healthBonus, defenseBonus, manaBonus;
+};
+
+struct PackBoss
+{
+    PackString name;
+    PackString skillNames[SKILLS_PER_UNIT];
+    BossWeights weights;
+    uint8_t unused[2];
+};
+
+/** @brief The fixed part of a pack, everything but the string table. */
+struct ContentRecords
+{
+    ContentHeader header;
+    PackClass classes[3];
+    PackSkill skills[PACK_SKILLS];
+    PackItem items[ITEM_COUNT];
+    PackBoss bosses[5];
+    StageScaling scaling;
+};
+static_assert(is_trivially_copyable_v<ContentRecords> && sizeof(ContentRecords) == 1072, "Content pack layout changed");
+
+SkillDesc *const packSkillTables[4] = {warriorSkills, archerSkills, mageSkills, bossSkills};
+constexpr const char *packStatusNames[STATUS_COUNT] = {"none", "poison", "bleed", "stun", "strength_up", "weakness"};
+constexpr const char *packItemTypes[4] = {"weapon", "armor", "accessory", "potion"};
+constexpr const char *packFlagNames[5] = {"show_damage", "on_self", "announce", "drain", "area"};
+
+uint32_t contentChecksum(const char *pack, size_t bytes)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = offsetof(ContentHeader, checksum) + sizeof(uint32_t); i < bytes; i++)
+        hash = (hash ^ (unsigned char)pack[i]) * 16777619u;
+    return hash;
+}
+
+/**
+ * @brief Checks a pack in place.
+ * @return nullptr if it can be loaded, otherwise why not.
+ */
+const char *validateContent(const char *pack, size_t bytes)
+{
+    if (bytes < sizeof(ContentRecords))
+        return "file too small";
+    const ContentRecords &records = *reinterpret_cast<const ContentRecords *>(pack);
+    const ContentHeader &header = records.header;
+    if (memcmp(header.magic, "WHGC", 4) != 0)
+        return "not a content pack";
+    if (header.version != CONTENT_VERSION || header.headerSize != sizeof(ContentHeader))
+        return "built by an incompatible version";
+    if (bytes != sizeof(ContentRecords) + header.stringBytes)
+        return "wrong file size";
+    if (header.checksum != contentChecksum(pack, bytes))
+        return "checksum mismatch";
+
+    auto inTable = [&](const PackString &text) { return text.offset <= header.stringBytes && text.length <= header.stringBytes - text.offset; };
+    for (const PackClass &entry : records.classes)
+    {
+        const ClassStats &stats = entry.stats;
+        if (stats.health <= 0 || stats.mana < 0 || stats.attack <= 0 || stats.defense < 0)
+            return "invalid class stats";
+    }
+    for (const PackSkill &skill : records.skills)
+    {
+        if (!inTable(skill.name) || !inTable(skill.usePhrase))
+            return "skill name out of range";
+        // A negative bonus would make drain skills heal by negative amounts
+        if (skill.cost < 0 || skill.hits < 0 || skill.hits > PACK_MAX_HITS || skill.damageBonus < 0 ||
+            skill.selfHeal < 0 || skill.status >= STATUS_COUNT || skill.statusDuration < 0 ||
+            skill.statusDuration > INT8_MAX || skill.flags >> 5)
+            return "invalid skill";
+    }
+    for (int i = 0; i < ITEM_COUNT; i++)
+    {
+        const PackItem &item = records.items[i];
+        if (!inTable(item.name) || !inTable(item.description))
+            return "item name out of range";
+        // Item ids carry meaning: the leading ones are loot, the rest are the two potions
+        bool potion = item.type == (int32_t)ItemType::POTION;
+        if (item.type < 0 || item.type > (int32_t)ItemType::POTION || potion != (i >= EQUIPMENT_COUNT) ||
+            item.attackBonus < 0 || item.healthBonus < 0 || item.defenseBonus < 0 || item.manaBonus < 0)
+            return "invalid item";
+    }
+    for (const PackBoss &boss : records.bosses)
+    {
+        if (!inTable(boss.name) || !all_of(boss.skillNames, boss.skillNames + SKILLS_PER_UNIT, inTable))
+            return "boss name out of range";
+        // BossTactics keeps running odds in bytes, so the largest possible total must fit one
+        const BossWeights &odds = boss.weights;
+        if (odds.skill[0] + odds.skill[1] + odds.skill[2] + odds.attack + 2 * odds.finisher + odds.recover > 255)
+            return "boss odds too large";
+    }
+    const StageScaling &scaling = records.scaling;
+    for (const StatLine *line : {&scaling.bossAttack, &scaling.bossHealth, &scaling.minionAttack, &scaling.minionHealth})
+    {
+        if (line->perStage < 0 || line->at(1) <= 0)
+            return "invalid stage scaling";
+    }
+    if (scaling.bossDefense.perStage < 0 || scaling.bossDefense.at(1) < 0)
+        return "invalid stage scaling";
+    return nullptr;
+}
+
+/**
+ * @brief Maps a content pack and points every game table at it. The pack
+ * stays mapped for the rest of the process, so call this once, before any
+ * game or worker thread has started.
+ * @return false (after printing why) if the pack is unusable; the built-in content stays.
+ */
+bool loadContentPack(const string &path)
+{
+    static unique_ptr<MappedFile> mapped;
+    static BossWeights weights[5];
+    static vector<BossTactics> tactics;
+
+    unique_ptr<MappedFile> file = make_unique<MappedFile>(path);
+    if (!file->isOpen())
+    {
+        cerr << "Cannot open content pack " << path << "\n";
+        return false;
+    }
+    // A mapping is page-aligned, and the read-in fallback is aligned for any object
+    const char *pack = static_cast<const char *>(file->contents());
+    if (const char *problem = validateContent(pack, file->size()))
+    {
+        cerr << "Cannot load " << path << ": " << problem << "\n";
+        return false;
+    }
+
+    const ContentRecords &records = *reinterpret_cast<const ContentRecords *>(pack);
+    const char *strings = pack + sizeof(ContentRecords);
+    auto text = [strings](const PackString &entry) { return string_view(strings + entry.offset, entry.length); };
+
+    for (int c = 0; c < 3; c++)
+        classStats[c + 1] = records.classes[c].stats;
+    for (int i = 0; i < PACK_SKILLS; i++)
+    {
+        const PackSkill &skill = records.skills[i];
+        packSkillTables[i / SKILLS_PER_UNIT][i % SKILLS_PER_UNIT] = {
+            text(skill.name), text(skill.usePhrase), skill.cost, skill.hits, skill.damageBonus,
+            (skill.flags & SHOW_DAMAGE) != 0, (StatusEffect)skill.status, skill.statusDuration,
+            (skill.flags & STATUS_ON_SELF) != 0, (skill.flags & ANNOUNCE_STATUS) != 0, (skill.flags & DRAIN) != 0,
+            skill.selfHeal, (skill.flags & AREA) != 0};
+    }
+    for (int i = 0; i < ITEM_COUNT; i++)
+    {
+        const PackItem &item = records.items[i];
+        itemCatalog[i] = {text(item.name), text(item.description), (ItemType)item.type,
+                          item.attackBonus, item.healthBonus, item.defenseBonus, item.manaBonus};
+    }
+    tactics.clear();
+    for (int b = 0; b < 5; b++)
+    {
+        const PackBoss &boss = records.bosses[b];
+        bossRoster[b] = {text(boss.name), {text(boss.skillNames[0]), text(boss.skillNames[1]), text(boss.skillNames[2])}};
+        weights[b] = boss.weights;
+        tactics.emplace_back(weights[b]);
+    }
+    stageScaling = records.scaling;
+    activeWeights = weights;
+    activeTactics = tactics.data();
+    mapped = move(file);
+    return true;
+}
+
+// Whitespace-separated words and "quoted strings" (which may be empty); '#' starts a comment
+vector<string> contentTokens(const string &line)
+{
+    vector<string> tokens;
+    size_t i = 0;
+    while (i < line.size())
+    {
+        if (isspace((unsigned char)line[i]))
+        {
+            i++;
+            continue;
+        }
+        if (line[i] == '#')
+            break;
+        if (line[i] == '"')
+        {
+            size_t close = line.find('"', i + 1);
+            if (close == string::npos)
+                close = line.size();
+            tokens.push_back(line.substr(i + 1, close - i - 1));
+            i = close + 1;
+            continue;
+        }
+        size_t end = i;
+        while (end < line.size() && !isspace((unsigned char)line[end]))
+            end++;
+        tokens.push_back(line.substr(i, end - i));
+        i = end;
+    }
+    return tokens;
+}
+
+/**
+ * @brief Writes the content in use (built-in, or the loaded pack) as a
+ * text source for --build-content.
+ */
+bool exportContent(const string &path)
+{
+    ofstream out(path, ios::trunc);
+    auto quoted = [](string_view text) { return "\"" + string(text) + "\""; };
+
+    out << "# Wave Hunger Game content. Compile with --build-content <this file> <pack>, play with --content <pack>.\n"
+        << "# Records must stay in this order and number; \"quoted\" fields are text.\n\n"
+        << "# class <hp> <mp> <attack> <defense>\n";
+    for (int c = 1; c <= 3; c++)
+        out << "class " << classStats[c].health << " " << classStats[c].mana << " " << classStats[c].attack << " "
+            << classStats[c].defense << " # " << className(c) << "\n";
+
+    out << "\n# skill <name> <use phrase> <mp cost> <hits> <damage bonus> <status> <turns> <self heal> [flags]\n"
+        << "# status: none poison bleed stun strength_up weakness; flags: show_damage on_self announce drain area\n"
+        << "# Three per table: Warrior, Archer, Mage, then the boss mechanics (named per boss below)\n";
+    for (SkillDesc *table : packSkillTables)
+    {
+        for (int i = 0; i < SKILLS_PER_UNIT; i++)
+        {
+            const SkillDesc &skill = table[i];
+            out << "skill " << quoted(skill.name) << " " << quoted(skill.usePhrase) << " " << skill.cost << " "
+                << skill.hits << " " << skill.damageBonus << " " << packStatusNames[(int)skill.status] << " "
+                << skill.statusDuration << " " << skill.selfHeal;
+            bool flags[5] = {skill.showDamage, skill.statusOnSelf, skill.announceStatus, skill.drain, skill.area};
+            for (int f = 0; f < 5; f++)
+                if (flags[f])
+                    out << " " << packFlagNames[f];
+            out << "\n";
+        }
+    }
+
+    out << "\n# item <name> <description> <type> <attack> <hp> <defense> <mp>\n"
+        << "# The first " << EQUIPMENT_COUNT << " are loot, then the health and the mana potion\n";
+    for (const ItemDef &item : itemCatalog)
+        out << "item " << quoted(item.name) << " " << quoted(item.description) << " " << packItemTypes[(int)item.type]
+            << " " << item.attackBonus << " " << item.healthBonus << " " << item.defenseBonus << " " << item.manaBonus
+            << "\n";
+
+    out << "\n# boss <name> <skill 1> <skill 2> <skill 3> <odds: skill 1> <skill 2> <skill 3> <attack> <finisher> <recover>\n";
+    for (int b = 0; b < 5; b++)
+    {
+        const BossDef &boss = bossRoster[b];
+        const BossWeights &odds = activeWeights[b];
+        out << "boss " << quoted(boss.name);
+        for (string_view skill : boss.skillNames)
+            out << " " << quoted(skill);
+        out << " " << (int)odds.skill[0] << " " << (int)odds.skill[1] << " " << (int)odds.skill[2] << " "
+            << (int)odds.attack << " " << (int)odds.finisher << " " << (int)odds.recover << "\n";
+    }
+
+    const StageScaling &scaling = stageScaling;
+    out << "\n# scaling <stat> <base> <per stage>: the stat at stage N is base + N * per stage\n";
+    out << "scaling boss_attack " << scaling.bossAttack.base << " " << scaling.bossAttack.perStage << "\n"
+        << "scaling boss_health " << scaling.bossHealth.base << " " << scaling.bossHealth.perStage << "\n"
+        << "scaling boss_defense " << scaling.bossDefense.base << " " << scaling.bossDefense.perStage << "\n"
+        << "scaling minion_attack " << scaling.minionAttack.base << " " << scaling.minionAttack.perStage << "\n"
+        << "scaling minion_health " << scaling.minionHealth.base << " " << scaling.minionHealth.perStage << "\n";
+    return (bool)out.flush();
+}
+
+/**
+ * @brief Compiles a text source (as written by exportContent) into a pack.
+ * The pack is replaced atomically and checked with validateContent before
+ * it is written, so a pack that builds is one the game will load.
+ * @return Process exit code
+ */
+int buildContentPack(const string &sourcePath, const string &packPath)
+{
+    ifstream source(sourcePath);
+    if (!source)
+    {
+        cerr << "Cannot open content source " << sourcePath << "\n";
+        return 1;
+    }
+
+    ContentRecords records;
+    memset(&records, 0, sizeof(records));
+    string strings;
+    int classes = 0, skills = 0, items = 0, bosses = 0, scalings = 0;
+    int lineNumber = 0;
+    const char *problem = nullptr;
+
+    auto addString = [&strings](const string &text)
+    {
+        PackString entry = {(uint32_t)strings.size(), (uint32_t)text.size()};
+        strings += text;
+        return entry;
+    };
+    auto nameIndex = [](const string &word, const char *const *names, int count)
+    {
+        for (int i = 0; i < count; i++)
+            if (word == names[i])
+                return i;
+        return -1;
+    };
+
+    string line;
+    while (!problem && getline(source, line))
+    {
+        ++lineNumber;
+        vector<string> t = contentTokens(line);
+        if (t.empty())
+            continue;
+        auto number = [&](size_t i)
+        {
+            char *end = nullptr;
+            long value = i < t.size() ? strtol(t[i].c_str(), &end, 10) : 0;
+            if (i >= t.size() || *end != '\0' || t[i].empty())
+                problem = "expected a number";
+            return (int32_t)value;
+        };
+
+        if (t[0] == "class" && t.size() == 5)
+        {
+            if (classes == 3)
+                problem = "more than 3 classes";
+            else
+                records.classes[classes++].stats = {number(1), number(2), number(3), number(4)};
+        }
+        else if (t[0] == "skill" && t.size() >= 9)
+        {
+            if (skills == PACK_SKILLS)
+            {
+                problem = "more than 12 skills";
+                continue;
+            }
+            PackSkill &skill = records.skills[skills++];
+            skill.name = addString(t[1]);
+            skill.usePhrase = addString(t[2]);
+            skill.cost = number(3);
+            skill.hits = number(4);
+            skill.damageBonus = number(5);
+            int status = nameIndex(t[6], packStatusNames, STATUS_COUNT);
+            skill.status = (uint8_t)max(0, status);
+            skill.statusDuration = number(7);
+            skill.selfHeal = number(8);
+            if (status < 0)
+                problem = "unknown status";
+            for (size_t f = 9; f < t.size(); f++)
+            {
+                int flag = nameIndex(t[f], packFlagNames, 5);
+                if (flag < 0)
+                    problem = "unknown skill flag";
+                else
+                    skill.flags |= 1 << flag;
+            }
+        }
+        else if (t[0] == "item" && t.size() == 8)
+        {
+            if (items == ITEM_COUNT)
+            {
+                problem = "more than 8 items";
+                continue;
+            }
+            PackItem &item = records.items[items++];
+            item.name = addString(t[1]);
+            item.description = addString(t[2]);
+            item.type = nameIndex(t[3], packItemTypes, 4);
+            item.attackBonus = number(4);
+            item.healthBonus = number(5);
+            item.defenseBonus = number(6);
+            item.manaBonus = number(7);
+            if (item.type < 0)
+                problem = "unknown item type";
+        }
+        else if (t[0] == "boss" && t.size() == 11)
+        {
+            if (bosses == 5)
+            {
+                problem = "more than 5 bosses";
+                continue;
+            }
+            PackBoss &boss = records.bosses[bosses++];
+            boss.name = addString(t[1]);
+            for (int i = 0; i < SKILLS_PER_UNIT; i++)
+                boss.skillNames[i] = addString(t[2 + i]);
+            int odds[6];
+            for (int i = 0; i < 6; i++)
+            {
+                odds[i] = number(5 + i);
+                if (odds[i] < 0 || odds[i] > 255)
+                    problem = "boss odds out of range";
+            }
+            boss.weights = {{(uint8_t)odds[0], (uint8_t)odds[1], (uint8_t)odds[2]}, (uint8_t)odds[3], (uint8_t)odds[4],
+                            (uint8_t)odds[5]};
+        }
+        else if (t[0] == "scaling" && t.size() == 4)
+        {
+            const char *stats[5] = {"boss_attack", "boss_health", "boss_defense", "minion_attack", "minion_health"};
+            StatLine *lines[5] = {&records.scaling.bossAttack, &records.scaling.bossHealth, &records.scaling.bossDefense,
+                                  &records.scaling.minionAttack, &records.scaling.minionHealth};
+            int stat = nameIndex(t[1], stats, 5);
+            if (stat < 0)
+                problem = "unknown scaling stat";
+            else
+            {
+                *lines[stat] = {number(2), number(3)};
+                scalings |= 1 << stat;
+            }
+        }
+        else
+        {
+            problem = "unknown record or wrong number of fields";
+        }
+    }
+    if (problem)
+    {
+        cerr << sourcePath << ":" << lineNumber << ": " << problem << "\n";
+        return 1;
+    }
+    if (classes != 3 || skills != PACK_SKILLS || items != ITEM_COUNT || bosses != 5 || scalings != 31)
+    {
+        cerr << sourcePath << ": needs 3 classes, 12 skills, 8 items, 5 bosses and all 5 scaling lines\n";
+        return 1;
+    }
+
+    ContentHeader &header = records.header;
+    memcpy(header.magic, "WHGC", 4);
+    header.version = CONTENT_VERSION;
+    header.headerSize = sizeof(ContentHeader);
+    header.stringBytes = strings.size();
+    string pack(reinterpret_cast<const char *>(&records), sizeof(records));
+    pack += strings;
+    uint32_t checksum = contentChecksum(pack.data(), pack.size());
+    memcpy(&pack[offsetof(ContentHeader, checksum)], &checksum, sizeof(checksum));
+
+    if (const char *invalid = validateContent(pack.data(), pack.size()))
+    {
+        cerr << sourcePath << ": " << invalid << "\n";
+        return 1;
+    }
+
+    string temporary = packPath + ".tmp";
+    {
+        ofstream file(temporary, ios::binary | ios::trunc);
+        file.write(pack.data(), pack.size());
+        if (!file)
+        {
+            cerr << "Cannot write content pack " << packPath << "\n";
+            return 1;
+        }
+    }
+    if (rename(temporary.c_str(), packPath.c_str()) != 0)
+    {
+        cerr << "Cannot write content pack " << packPath << "\n";
+        return 1;
+    }
+    cout << "Content pack " << packPath << ": " << pack.size() << " bytes (" << strings.size() << " of text)\n";
+    return 0;
+}
+
+// ========== Headless Simulation ==========
+/**
+ * @brief Aggregate results over a batch of simulated runs.
+ */
+struct BatchStats
+{
+    long long games = 0;
+    long long wins = 0;
+    long long turns = 0;
+    long long deathsAtStage[6] = {}; // Index 1-5, 0 unused; endless deaths past stage 5 count as 5
+    long long searchNodes = 0;       // Nodes expanded by SearchPolicy, if it played
+    int deepestStage = 0;
+
+    void record(const GameResult &result)
+    {
+        ++games;
+        turns += result.turns;
+        deepestStage = max(deepestStage, result.stageReached);
+        if (result.won)
+            ++wins;
+        else
+            ++deathsAtStage[min(result.stageReached, 5)];
+    }
+
+    void merge(const BatchStats &other)
+    {
+        games += other.games;
+        wins += other.wins;
+        turns += other.turns;
+        for (int stage = 0; stage <= 5; stage++)
+            deathsAtStage[stage] += other.deathsAtStage[stage];
+        searchNodes += other.searchNodes;
+        deepestStage = max(deepestStage, other.deepestStage);
+    }
+};
+
+/**
+ * @brief Plays one complete run with no terminal I/O.
+ * @param classChoice 1 = Warrior, 2 = Archer, 3 = Mage
+ * @param seed Seed for the run's private generator
+ * @param waveSize Minions beside every boss
+ * @param endless Play on past stage 5 until the hero falls
+ */
+GameResult simulateGame(int classChoice, PlayerPolicy &policy, uint64_t seed, Replay *recording = nullptr,
+                        int waveSize = 0, bool endless = false)
+{
+    GameContext ctx;
+    ctx.headless = true;
+    ctx.battleLog = false;
+    ctx.waveSize = waveSize;
+    ctx.endless = endless;
+    ctx.rng.reseed(seed);
+    Unit *player = createPlayerOfClass(ctx.arena, classChoice, "Sim");
+    if (!recording)
+        return gameLoop(player, policy, ctx);
+
+    recording->begin(seed, classChoice, waveSize);
+    RecordingPolicy recorder(policy, recording->choices);
+    GameResult result = gameLoop(player, recorder, ctx);
+    recording->finish(result, *player);
+    return result;
+}
+
+// Seed of game number `index` in a batch, independent of how games are split over threads
+uint64_t gameSeed(uint64_t batchSeed, long long index)
+{
+    return batchSeed ^ ((uint64_t)index * 0xD1B54A32D192ED03ULL);
+}
+
+/**
+ * @brief Seed of stream `index` under `seed`, through splitmix64's finalizer.
+ * Unlike gameSeed, whose XOR steps add up linearly, it can be nested
+ * (connection, then run) without two different paths meeting on a seed.
+ */
+uint64_t mixSeed(uint64_t seed, uint64_t index)
+{
+    uint64_t z = seed ^ (index * 0x9E3779B97F4A7C15ULL + 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Spreads a batch of headless runs over a pool of worker threads.
+ *
+ * Workers claim chunks of game indices from a shared atomic counter and
+ * accumulate into their own cache-line-aligned stats slot, which are summed
+ * after joining, so no lock is taken on the hot path. Each game is seeded by
+ * its index, so results do not depend on the thread count.
+ * @param records If set, receives the encoded replay of every game, by index
+ * @param searchDepth If positive, SearchPolicy plays with this many rounds of lookahead instead of AutoPolicy
+ * @param waveSize Minions fighting beside every boss
+ * @param endless Endless runs instead of five stages; they cannot be recorded
+ */
+BatchStats runSimulations(long long games, int classChoice, int threads, uint64_t seed,
+                          vector<string> *records = nullptr, int searchDepth = 0, int waveSize = 0,
+                          bool endless = false)
+{
+    struct alignas(64) WorkerSlot
+    {
+        BatchStats stats;
+    };
+
+    const long long chunkSize = 1024;
+    threads = max(1, threads);
+    vector<WorkerSlot> slots(threads);
+    atomic<long long> nextGame(0);
+    if (records)
+        records->assign(games, string());
+
+    auto worker = [&](WorkerSlot &slot)
+    {
+        AutoPolicy autoPolicy;
+        SearchPolicy searchPolicy(searchDepth);
+        PlayerPolicy &policy = searchDepth > 0 ? searchPolicy : autoPolicy;
+        Replay replay;
+        while (true)
+        {
+            long long begin = nextGame.fetch_add(chunkSize, memory_order_relaxed);
+            if (begin >= games)
+                break;
+            long long end = min(games, begin + chunkSize);
+            for (long long i = begin; i < end; i++)
+            {
+                slot.stats.record(
+                    simulateGame(classChoice, policy, gameSeed(seed, i), records ? &replay : nullptr, waveSize, endless));
+                if (records)
+                    (*records)[i] = encodeReplay(replay);
+            }
+        }
+        slot.stats.searchNodes = searchPolicy.nodesExpanded();
+    };
+
+    vector<thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.emplace_back(worker, ref(slots[t]));
+    worker(slots[0]);
+    for (thread &th : pool)
+        th.join();
+
+    BatchStats total;
+    for (const WorkerSlot &slot : slots)
+        total.merge(slot.stats);
+    return total;
+}
+
+void printBatchStats(const BatchStats &stats, double seconds)
+{
+    cout << "Games played: " << stats.games << "\n";
+    if (stats.games == 0)
+        return;
+
+    cout << "Win rate: " << 100.0 * stats.wins / stats.games << "%\n";
+    cout << "Average turns per run: " << (double)stats.turns / stats.games << "\n";
+    cout << "Deaths by stage:\n";
+    for (int stage = 1; stage <= 5; stage++)
+    {
+        cout << "  Stage " << stage << (stage == 5 && stats.deepestStage > 5 ? "+" : "") << ": "
+             << stats.deathsAtStage[stage] << " (" << 100.0 * stats.deathsAtStage[stage] / stats.games << "%)\n";
+    }
+    if (stats.deepestStage > 5)
+        cout << "Deepest stage reached: " << stats.deepestStage << "\n";
+    cout << "Elapsed: " << seconds << " s (" << 1e6 * seconds / stats.games << " us per run)\n";
+    if (stats.searchNodes > 0)
+        cout << "Search nodes: " << stats.searchNodes << " (" << stats.searchNodes / seconds << " per second)\n";
+}
+
+/**
+ * @brief Re-executes a replay through gameLoop with no I/O.
+ * @return true if it asked exactly the recorded questions and reached the recorded outcome.
+ */
+bool replayMatches(const Replay &replay)
+{
+    GameContext ctx;
+    ctx.headless = true;
+    ctx.battleLog = false;
+    ctx.waveSize = replay.waveSize;
+    ctx.rng.reseed(replay.seed);
+    Unit *player = createPlayerOfClass(ctx.arena, replay.classChoice, "Replay");
+
+    ReplayPolicy policy(replay.choices);
+    GameResult result = gameLoop(player, policy, ctx);
+    return policy.consumedExactly() && result.won == replay.won && result.stageReached == replay.stageReached &&
+           result.turns == replay.turns && player->getHealth() == replay.finalHealth;
+}
+
+bool appendToFile(const string &path, const string &data)
+{
+    ofstream file(path, ios::binary | ios::app);
+    file.write(data.data(), data.size());
+    return (bool)file;
+}
+
+/**
+ * @brief Checks every replay of an archive (concatenated records) against
+ * the current rules, spread over worker threads like runSimulations.
+ * @return Process exit code: 0 if all replays still match.
+ */
+int verifyReplayArchive(const string &path, int threads)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+    {
+        cerr << "Cannot open replay archive " << path << "\n";
+        return 1;
+    }
+    string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    vector<Replay> replays;
+    size_t offset = 0;
+    while (offset < data.size())
+    {
+        Replay replay;
+        size_t used = decodeReplay(data, offset, replay);
+        if (used == 0)
+        {
+            cerr << "Corrupt replay at byte " << offset << " of " << path << "\n";
+            return 1;
+        }
+        replays.push_back(move(replay));
+        offset += used;
+    }
+
+    auto start = chrono::steady_clock::now();
+    const size_t chunkSize = 1024;
+    atomic<size_t> nextReplay(0);
+    atomic<long long> mismatches(0);
+    atomic<size_t> firstMismatch(replays.size());
+
+    auto worker = [&]()
+    {
+        long long local = 0;
+        while (true)
+        {
+            size_t begin = nextReplay.fetch_add(chunkSize, memory_order_relaxed);
+            if (begin >= replays.size())
+                break;
+            size_t end = min(replays.size(), begin + chunkSize);
+            for (size_t i = begin; i < end; i++)
+            {
+                if (!replayMatches(replays[i]))
+                {
+                    ++local;
+                    size_t seen = firstMismatch.load();
+                    while (i < seen && !firstMismatch.compare_exchange_weak(seen, i))
+                    {
+                    }
+                }
+            }
+        }
+        mismatches += local;
+    };
+
+    vector<thread> pool;
+    for (int t = 1; t < max(1, threads); t++)
+        pool.emplace_back(worker);
+    worker();
+    for (thread &th : pool)
+        th.join();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    cout << "Replays: " << replays.size() << " (" << data.size() << " bytes)\n";
+    cout << "Mismatches: " << mismatches;
+    if (mismatches > 0)
+        cout << " (first at replay #" << firstMismatch << ", seed " << replays[firstMismatch].seed << ")";
+    cout << "\n";
+    if (!replays.empty())
+        cout << "Elapsed: " << elapsed.count() << " s (" << replays.size() / elapsed.count() << " replays/s)\n";
+    return mismatches == 0 ? 0 : 1;
+}
+
+// ========== Balance Sweep ==========
+constexpr int SWEEP_REWARDS = 4;                // Cleared stages that offer a reward in a five-stage run
+constexpr int SWEEP_PLANS = 256;                // 4^SWEEP_REWARDS upgrade sequences
+constexpr const char upgradeLetters[] = "HMAD"; // Heal, Mana, Attack, Defense, as numbered by applyUpgrade
+
+/**
+ * @brief One point of the strategy space: a class, the upgrade taken after
+ * each cleared stage, and the item picked whenever the loot offers it.
+ */
+struct SweepStrategy
+{
+    int classChoice;
+    int upgrades[SWEEP_REWARDS]; // 1-4 per cleared stage; endless runs cycle through them
+    ItemId favorite;
+
+    static constexpr int COUNT = 3 * SWEEP_PLANS * EQUIPMENT_COUNT;
+
+    // Ordered by class, then upgrade plan (first reward most significant), then item
+    static SweepStrategy at(int index)
+    {
+        SweepStrategy strategy;
+        strategy.classChoice = 1 + index / (SWEEP_PLANS * EQUIPMENT_COUNT);
+        int plan = index / EQUIPMENT_COUNT % SWEEP_PLANS;
+        for (int i = SWEEP_REWARDS - 1; i >= 0; i--, plan /= 4)
+            strategy.upgrades[i] = 1 + plan % 4;
+        strategy.favorite = (ItemId)(index % EQUIPMENT_COUNT);
+        return strategy;
+    }
+
+    string plan() const
+    {
+        string letters;
+        for (int upgrade : upgrades)
+            letters += upgradeLetters[upgrade - 1];
+        return letters;
+    }
+};
+
+// Fights like AutoPolicy but takes its rewards from a SweepStrategy
+class StrategyPolicy : public AutoPolicy
+{
+private:
+    const SweepStrategy &strategy;
+    int rewards = 0; // Upgrades chosen so far in the current run
+
+public:
+    explicit StrategyPolicy(const SweepStrategy &plan) : strategy(plan) {}
+
+    void newRun() { rewards = 0; }
+
+    int chooseUpgrade(const Unit &) override { return strategy.upgrades[rewards++ % SWEEP_REWARDS]; }
+
+    // The favorite item if it was rolled, otherwise the first offer
+    int chooseItem(const Unit &, const LootRoll &items) override
+    {
+        for (int i = 0; i < items.size(); i++)
+        {
+            if (items[i] == strategy.favorite)
+                return i + 1;
+        }
+        return 1;
+    }
+};
+
+void writeSweepRow(ostream &csv, const SweepStrategy &strategy, const BatchStats &stats)
+{
+    csv << className(strategy.classChoice) << "," << strategy.plan() << "," << itemDef(strategy.favorite).name << ","
+        << stats.games << "," << stats.wins << "," << (double)stats.wins / max(1LL, stats.games) << ","
+        << (double)stats.turns / max(1LL, stats.games);
+    for (int stage = 1; stage <= 5; stage++)
+        csv << "," << stats.deathsAtStage[stage];
+    csv << "\n";
+}
+
+/**
+ * @brief Plays every SweepStrategy over the same `seeds` runs and writes one
+ * CSV row per strategy.
+ *
+ * Workers claim whole strategies from a shared atomic counter, so the load
+ * balances itself and each row is written by exactly one thread. Rows are
+ * streamed to the file in strategy order as soon as the finished prefix grows,
+ * by whichever worker gets the file lock first. Every strategy meets the same
+ * seeds, so differences between rows come from the strategy, not the dice.
+ * @return Process exit code
+ */
+int runBalanceSweep(long long seeds, int threads, uint64_t seed, const string &path, int waveSize = 0,
+                    bool endless = false)
+{
+    ofstream csv(path, ios::trunc);
+    if (!csv)
+    {
+        cerr << "Cannot write sweep results to " << path << "\n";
+        return 1;
+    }
+    csv << "class,upgrades,item,games,wins,win_rate,avg_turns";
+    for (int stage = 1; stage <= 5; stage++)
+        csv << ",deaths_stage" << stage;
+    csv << "\n";
+
+    auto start = chrono::steady_clock::now();
+    vector<BatchStats> results(SweepStrategy::COUNT);
+    unique_ptr<atomic<bool>[]> finished = make_unique<atomic<bool>[]>(SweepStrategy::COUNT);
+    atomic<int> nextStrategy(0);
+    mutex csvLock;
+    int nextRow = 0; // First row not yet written; guarded by csvLock
+
+    auto flush = [&]()
+    {
+        for (; nextRow < SweepStrategy::COUNT && finished[nextRow].load(memory_order_acquire); nextRow++)
+            writeSweepRow(csv, SweepStrategy::at(nextRow), results[nextRow]);
+    };
+
+    auto worker = [&]()
+    {
+        while (true)
+        {
+            int index = nextStrategy.fetch_add(1, memory_order_relaxed);
+            if (index >= SweepStrategy::COUNT)
+                break;
+            SweepStrategy strategy = SweepStrategy::at(index);
+            StrategyPolicy policy(strategy);
+            BatchStats stats;
+            for (long long i = 0; i < seeds; i++)
+            {
+                policy.newRun();
+                stats.record(simulateGame(strategy.classChoice, policy, gameSeed(seed, i), nullptr, waveSize, endless));
+            }
+            results[index] = stats;
+            finished[index].store(true, memory_order_release);
+
+            unique_lock<mutex> guard(csvLock, try_to_lock);
+            if (guard.owns_lock())
+                flush();
+        }
+    };
+
+    vector<thread> pool;
+    for (int t = 1; t < max(1, threads); t++)
+        pool.emplace_back(worker);
+    worker();
+    for (thread &th : pool)
+        th.join();
+    flush();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    if (!csv.flush())
+    {
+        cerr << "Cannot write sweep results to " << path << "\n";
+        return 1;
+    }
+
+    long long games = (long long)SweepStrategy::COUNT * seeds;
+    cout << "Strategies: " << SweepStrategy::COUNT << " x " << seeds << " seeds (" << games << " games) -> " << path
+         << "\n";
+    for (int classChoice = 1; classChoice <= 3; classChoice++)
+    {
+        int first = (classChoice - 1) * SWEEP_PLANS * EQUIPMENT_COUNT;
+        int best = first;
+        for (int i = first; i < first + SWEEP_PLANS * EQUIPMENT_COUNT; i++)
+        {
+            if (results[i].wins > results[best].wins)
+                best = i;
+        }
+        SweepStrategy strategy = SweepStrategy::at(best);
+        cout << "Best " << className(classChoice) << ": " << strategy.plan() << " + "
+             << itemDef(strategy.favorite).name << ", win rate "
+             << 100.0 * results[best].wins / max(1LL, results[best].games) << "%\n";
+    }
+    cout << "Elapsed: " << elapsed.count() << " s (" << 1e6 * elapsed.count() / max(1LL, games) << " us per run)\n";
+    return 0;
+}
+
+// ========== Exact Solver ==========
+constexpr size_t SOLVER_DEFAULT_MEMORY = 16 << 20; // Bytes of memo table unless --solve-memory says otherwise
+constexpr int SOLVER_PROBES = 8;                    // Slots a key may occupy; a full window evicts its last slot
+
+/**
+ * @brief Exact probability that a perfect player wins one stage fight,
+ * weighting the boss's actions by its decision table (uniform without one).
+ *
+ * A depth-first expectimax over BattleState to the end of the fight, with
+ * every position where the player is about to act memoised under a 128-bit
+ * key. The table is open-addressed with linear probing over a fixed window,
+ * sized once from the memory bound: when a window is full the new state
+ * replaces its last slot, so a small bound costs recomputation, never
+ * accuracy. There is no cycle to guard against: a fight never hands out
+ * potions, so their count leads a key that falls lexicographically every
+ * round, ahead of mana and HP. A Mana Potion restores 20 MP, but only by
+ * using up a potion; between potions mana never rises, and a round that
+ * spends none takes HP. Passing is left out since it can only delay the
+ * player's win.
+ */
+class WinSolver
+{
+private:
+    struct Entry
+    {
+        uint64_t low = 0, high = 0; // high == 0 marks an empty slot
+        double value = 0.0;
+    };
+
+    // What a key leaves out; the table is only cleared when a solve changes it
+    struct Matchup
+    {
+        int32_t playerMaxHealth, playerMaxMana, playerBaseAttack, playerDefense;
+        int32_t bossMaxHealth, bossMaxMana, bossBaseAttack, bossDefense;
+        const SkillDesc *playerSkills;
+        const BossTactics *bossTactics;
+        bool operator==(const Matchup &) const = default;
+    };
+
+    unique_ptr<Entry[]> table;
+    size_t mask;
+    Matchup cached = {};
+    long long solved = 0; // States computed, including recomputations after an eviction
+    long long hits = 0;
+    long long evictions = 0;
+
+    static bool packable(const FighterState &fighter)
+    {
+        int attackShift = fighter.attack - fighter.baseAttack;
+        bool statusesFit = all_of(fighter.status + 1, fighter.status + STATUS_COUNT, [](int8_t turns) { return turns < 16; });
+        return fighter.health < 65536 && fighter.mana < 65536 && attackShift >= -16 && attackShift < 16 && statusesFit;
+    }
+
+    static Matchup matchupOf(const BattleState &state)
+    {
+        return {state.player.maxHealth, state.player.maxMana, state.player.baseAttack, state.player.defense,
+                state.boss.maxHealth,   state.boss.maxMana,   state.boss.baseAttack,   state.boss.defense,
+                state.playerSkills,     state.bossTactics};
+    }
+
+    // The fields a fight changes, and the turn order; the rest is the Matchup
+    static void pack(const BattleState &state, uint64_t &low, uint64_t &high)
+    {
+        low = (uint64_t)state.player.health | (uint64_t)state.player.mana << 16 | (uint64_t)state.boss.health << 32 |
+              (uint64_t)state.boss.mana << 48;
+        high = (uint64_t)(state.player.attack - state.player.baseAttack + 16) |
+               (uint64_t)(state.boss.attack - state.boss.baseAttack + 16) << 5 | (uint64_t)state.healthPotions << 10 |
+               (uint64_t)state.manaPotions << 16;
+        for (int i = 1; i < STATUS_COUNT; i++)
+            high |= (uint64_t)state.player.status[i] << (18 + 4 * i) | (uint64_t)state.boss.status[i] << (38 + 4 * i);
+        high |= (uint64_t)state.playerFirst << 62 | 1ULL << 63;
+    }
+
+    static size_t slotOf(uint64_t low, uint64_t high)
+    {
+        uint64_t hash = (low ^ (high * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+        return hash ^ (hash >> 31);
+    }
+
+    double playerNode(const BattleState &state)
+    {
+        uint64_t low, high;
+        pack(state, low, high);
+        size_t home = slotOf(low, high);
+        for (int probe = 0; probe < SOLVER_PROBES; probe++)
+        {
+            const Entry &entry = table[(home + probe) & mask];
+            if (entry.high == high && entry.low == low)
+            {
+                ++hits;
+                return entry.value;
+            }
+            if (entry.high == 0)
+                break;
+        }
+
+        double best = 0.0;
+        if (state.player.hasStatus(StatusEffect::STUN))
+        {
+            BattleState next = state;
+            next.playerMove(BattleMove::PASS);
+            best = afterPlayerMove(next, false);
+        }
+        else
+        {
+            for (int m = (int)BattleMove::ATTACK; m < (int)BattleMove::PASS; m++)
+            {
+                if (!isDistinct(state, (BattleMove)m))
+                    continue;
+                BattleState next = state;
+                bool drankPotion = next.playerMove((BattleMove)m);
+                best = max(best, afterPlayerMove(next, drankPotion));
+            }
+        }
+        ++solved;
+
+        // Recursion may have filled the window since the lookup, so search it again for a free slot
+        size_t slot = (home + SOLVER_PROBES - 1) & mask;
+        for (int probe = 0; probe < SOLVER_PROBES; probe++)
+        {
+            if (table[(home + probe) & mask].high == 0)
+            {
+                slot = (home + probe) & mask;
+                break;
+            }
+        }
+        if (table[slot].high != 0)
+            ++evictions;
+        table[slot] = {low, high, best};
+        return best;
+    }
+
+    // Same order of events as SearchPolicy, scored 1 for a win and 0 for a loss
+    double afterPlayerMove(BattleState state, bool drankPotion)
+    {
+        state.player.processStatusEffects();
+        if (!state.player.isAlive())
+            return 0.0;
+        if (!state.boss.isAlive())
+            return 1.0;
+        if (drankPotion && state.playerFirst)
+            return playerNode(state); // The boss loses its turn
+        return bossNode(state);
+    }
+
+    double bossNode(const BattleState &state)
+    {
+        if (state.boss.hasStatus(StatusEffect::STUN))
+            return afterBossMove(state, 0);
+
+        double total = 0.0;
+        if (!state.bossTactics)
+        {
+            for (int action = 0; action < 4; action++)
+                total += afterBossMove(state, action);
+            return total / 4;
+        }
+
+        int situation = state.bossSituation();
+        for (int action = 0; action < 4; action++)
+        {
+            int weight = state.bossTactics->weight(situation, action);
+            if (weight > 0)
+                total += weight * afterBossMove(state, action);
+        }
+        return total / state.bossTactics->total(situation);
+    }
+
+    double afterBossMove(BattleState state, int roll)
+    {
+        state.bossMove(roll);
+        state.boss.processStatusEffects();
+        if (!state.player.isAlive())
+            return 0.0;
+        if (!state.boss.isAlive())
+            return 1.0;
+        return playerNode(state);
+    }
+
+    // Leaves out moves that play exactly like another: an unaffordable skill attacks, a missing potion passes
+    static bool isDistinct(const BattleState &state, BattleMove move)
+    {
+        switch (move)
+        {
+        case BattleMove::SKILL_1:
+        case BattleMove::SKILL_2:
+        case BattleMove::SKILL_3:
+            return state.playerSkills[(int)move - (int)BattleMove::SKILL_1].cost <= state.player.mana;
+        case BattleMove::HEALTH_POTION:
+            return state.healthPotions > 0;
+        case BattleMove::MANA_POTION:
+            return state.manaPotions > 0;
+        default:
+            return true;
+        }
+    }
+
+    // Clears the table for a new matchup; false if the fight does not fit a key
+    bool prepare(const BattleState &state)
+    {
+        if (!packable(state.player) || !packable(state.boss) || state.healthPotions >= 64 || state.manaPotions >= 64)
+            return false;
+        Matchup matchup = matchupOf(state);
+        if (!(matchup == cached))
+        {
+            fill(table.get(), table.get() + mask + 1, Entry());
+            cached = matchup;
+        }
+        return true;
+    }
+
+public:
+    /** @param memoryBytes Upper bound on the memo table; at least a few kilobytes are always used */
+    explicit WinSolver(size_t memoryBytes = SOLVER_DEFAULT_MEMORY)
+    {
+        size_t capacity = 1024;
+        while (capacity * 2 * sizeof(Entry) <= memoryBytes)
+            capacity *= 2;
+        table = make_unique<Entry[]>(capacity);
+        mask = capacity - 1;
+    }
+
+    /**
+     * @brief Win probability of the fight in `start` under optimal play,
+     * from the top of its first round (boss first unless start.playerFirst).
+     * @return The probability, or -1 if the fight is too large to key (HP or MP above 65535)
+     */
+    double solve(const BattleState &start)
+    {
+        if (!prepare(start))
+            return -1.0;
+        return start.playerFirst ? playerNode(start) : bossNode(start);
+    }
+
+    /** @brief An optimal move for a player who is about to act in `state` (not stunned). */
+    BattleMove bestMove(const BattleState &state)
+    {
+        BattleMove best = BattleMove::ATTACK;
+        if (!prepare(state))
+            return best;
+        double bestValue = -1.0;
+        for (int m = (int)BattleMove::ATTACK; m < (int)BattleMove::PASS; m++)
+        {
+            if (!isDistinct(state, (BattleMove)m))
+                continue;
+            BattleState next = state;
+            bool drankPotion = next.playerMove((BattleMove)m);
+            double value = afterPlayerMove(next, drankPotion);
+            if (value > bestValue)
+            {
+                bestValue = value;
+                best = (BattleMove)m;
+            }
+        }
+        return best;
+    }
+
+    long long statesSolved() const { return solved; }
+    long long cacheHits() const { return hits; }
+    long long cacheEvictions() const { return evictions; }
+    size_t memoryUsed() const { return (mask + 1) * sizeof(Entry); }
+};
+
+/**
+ * @brief Solves a fresh hero of every class against the boss of each stage
+ * in [firstStage, lastStage], for both turn orders, and prints the table.
+ */
+void runWinSolver(int firstStage, int lastStage, size_t memoryBytes)
+{
+    WinSolver solver(memoryBytes);
+    cout << "Exact win probability, fresh hero vs stage boss (memo table " << solver.memoryUsed() / 1048576.0 << " MiB)\n";
+    cout << left << setw(9) << "Class" << setw(7) << "Stage" << setw(14) << "Player first" << setw(12)
+         << "Boss first" << setw(12) << "Coin flip" << setw(12) << "States" << "ms\n"
+         << right;
+
+    // solve() returns a negative value for states whose stats do not fit its key
+    auto probability = [](double p)
+    {
+        ostringstream cell;
+        if (p < 0)
+            cell << "n/a";
+        else
+            cell << fixed << setprecision(6) << p;
+        return cell.str();
+    };
+
+    for (int classChoice = 1; classChoice <= 3; classChoice++)
+    {
+        for (int stage = firstStage; stage <= lastStage; stage++)
+        {
+            GameContext ctx;
+            ctx.headless = true;
+            ctx.battleLog = false;
+            Unit *player = createPlayerOfClass(ctx.arena, classChoice, "Solver");
+            BossUnit *boss = spawnBoss(stage, ctx);
+
+            auto start = chrono::steady_clock::now();
+            long long before = solver.statesSolved();
+            double first = solver.solve(BattleState::capture(*player, *boss, true));
+            double second = solver.solve(BattleState::capture(*player, *boss, false));
+            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+            double coinFlip = first < 0 || second < 0 ? -1 : (first + second) / 2;
+            cout << left << setw(9) << className(classChoice) << setw(7) << stage << setw(14) << probability(first)
+                 << setw(12) << probability(second) << setw(12) << probability(coinFlip) << setw(12)
+                 << solver.statesSolved() - before << setprecision(3) << elapsed.count() << setprecision(6) << right
+                 << "\n";
+        }
+    }
+    if (solver.cacheEvictions() > 0)
+        cout << "Evicted " << solver.cacheEvictions() << " memo entries; raise --solve-memory to solve faster\n";
+}
+
+// ========== Batched Battles ==========
+/**
+ * @brief One column per stat, indexed by battle slot.
+ *
+ * A status is active exactly when its duration is positive, which lets the
+ * kernels below test it lane-wise without a separate mask column.
+ */
+struct CombatantArrays
+{
+    vector<int32_t> health, maxHealth, mana, maxMana, baseAttack, attack, defense;
+    vector<int32_t> status[STATUS_COUNT]; // Turns left, indexed by StatusEffect
+
+    void push(int hp, int maxHp, int mp, int maxMp, int baseAtk, int atk, int def)
+    {
+        health.push_back(hp);
+        maxHealth.push_back(maxHp);
+        mana.push_back(mp);
+        maxMana.push_back(maxMp);
+        baseAttack.push_back(baseAtk);
+        attack.push_back(atk);
+        defense.push_back(def);
+        for (vector<int32_t> &column : status)
+            column.push_back(0);
+    }
+
+    size_t size() const { return health.size(); }
+
+    // Drops every slot, keeping the columns' storage
+    void clear()
+    {
+        for (vector<int32_t> *column : {&health, &maxHealth, &mana, &maxMana, &baseAttack, &attack, &defense})
+            column->clear();
+        for (vector<int32_t> &column : status)
+            column.clear();
+    }
+
+    FighterState at(size_t i) const
+    {
+        FighterState fighter = {health[i], maxHealth[i], mana[i], maxMana[i], baseAttack[i], attack[i], defense[i], {}};
+        for (int e = 0; e < STATUS_COUNT; e++)
+            fighter.status[e] = (int8_t)status[e][i];
+        return fighter;
+    }
+};
+
+// ========== SIMD Kernels ==========
+/*
+ * Column-wide versions of the two hot combat paths:
+ *   damage: health = max(0, health - hits * max(1, damage - defense))
+ *           (Unit::takeDamage applied `hits` times; hits = 0 leaves the slot alone)
+ *   tick:   Unit::processStatusEffects for every slot whose mask is 1 (masks hold 0 or 1)
+ * The vector paths (AVX2, SSE4.1 or NEON, whichever the compiler targets)
+ * handle whole registers and the scalar versions finish the tail. The scalar
+ * versions are also the fallback and the reference for --verify.
+ */
+void applyDamageScalar(int32_t *health, const int32_t *defense, const int32_t *damage,
+                       const int32_t *hits, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        int32_t actualDamage = max(1, damage[i] - defense[i]) * hits[i];
+        health[i] = max(0, health[i] - actualDamage);
+    }
+}
+
+void tickStatusScalar(CombatantArrays &unit, const int32_t *mask, size_t begin, size_t end)
+{
+    const int poison = (int)StatusEffect::POISON, bleed = (int)StatusEffect::BLEED;
+    const int strengthUp = (int)StatusEffect::STRENGTH_UP, weakness = (int)StatusEffect::WEAKNESS;
+
+    for (size_t i = begin; i < end; i++)
+    {
+        if (!mask[i])
+            continue;
+
+        if (unit.status[poison][i] > 0)
+            unit.health[i] = max(0, unit.health[i] - max(1, 5 - unit.defense[i]));
+        if (unit.status[bleed][i] > 0)
+            unit.health[i] = max(0, unit.health[i] - max(1, 3 - unit.defense[i]));
+
+        bool strengthActive = unit.status[strengthUp][i] > 0;
+        bool weaknessActive = unit.status[weakness][i] > 0;
+        if (strengthActive)
+            unit.attack[i] = unit.baseAttack[i] + 10;
+        if (weaknessActive)
+            unit.attack[i] = max(1, unit.baseAttack[i] - 5);
+
+        for (int e = 1; e < STATUS_COUNT; e++)
+        {
+            if (unit.status[e][i] > 0)
+                --unit.status[e][i];
+        }
+
+        if ((strengthActive && unit.status[strengthUp][i] == 0) ||
+            (weaknessActive && unit.status[weakness][i] == 0))
+            unit.attack[i] = unit.baseAttack[i];
+    }
+}
+
+#if defined(__AVX2__)
+const char *simdKernelName = "AVX2";
+const size_t SIMD_LANES = 8;
+
+size_t applyDamageSimd(int32_t *health, const int32_t *defense, const int32_t *damage, const int32_t *hits, size_t n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    size_t i = 0;
+    for (; i + SIMD_LANES <= n; i += SIMD_LANES)
+    {
+        __m256i hp = _mm256_loadu_si256((const __m256i *)(health + i));
+        __m256i def = _mm256_loadu_si256((const __m256i *)(defense + i));
+        __m256i dmg = _mm256_loadu_si256((const __m256i *)(damage + i));
+        __m256i cnt = _mm256_loadu_si256((const __m256i *)(hits + i));
+        __m256i actual = _mm256_mullo_epi32(_mm256_max_epi32(one, _mm256_sub_epi32(dmg, def)), cnt);
+        hp = _mm256_max_epi32(zero, _mm256_sub_epi32(hp, actual));
+        _mm256_storeu_si256((__m256i *)(health + i), hp);
+    }
+    return i;
+}
+
+size_t tickStatusSimd(CombatantArrays &unit, const int32_t *mask, size_t n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i five = _mm256_set1_epi32(5);
+    const __m256i three = _mm256_set1_epi32(3);
+    const __m256i ten = _mm256_set1_epi32(10);
+    int32_t *health = unit.health.data(), *attack = unit.attack.data();
+    const int32_t *defense = unit.defense.data(), *baseAttack = unit.baseAttack.data();
+
+    size_t i = 0;
+    for (; i + SIMD_LANES <= n; i += SIMD_LANES)
+    {
+        __m256i on = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i *)(mask + i)), zero);
+        __m256i hp = _mm256_loadu_si256((const __m256i *)(health + i));
+        __m256i def = _mm256_loadu_si256((const __m256i *)(defense + i));
+        __m256i atk = _mm256_loadu_si256((const __m256i *)(attack + i));
+        __m256i base = _mm256_loadu_si256((const __m256i *)(baseAttack + i));
+
+        __m256i active[STATUS_COUNT];
+        __m256i duration[STATUS_COUNT];
+        for (int e = 1; e < STATUS_COUNT; e++)
+        {
+            duration[e] = _mm256_loadu_si256((const __m256i *)(unit.status[e].data() + i));
+            active[e] = _mm256_and_si256(on, _mm256_cmpgt_epi32(duration[e], zero));
+        }
+
+        __m256i poisonDamage = _mm256_and_si256(active[(int)StatusEffect::POISON],
+                                                _mm256_max_epi32(one, _mm256_sub_epi32(five, def)));
+        hp = _mm256_max_epi32(zero, _mm256_sub_epi32(hp, poisonDamage));
+        __m256i bleedDamage = _mm256_and_si256(active[(int)StatusEffect::BLEED],
+                                               _mm256_max_epi32(one, _mm256_sub_epi32(three, def)));
+        hp = _mm256_max_epi32(zero, _mm256_sub_epi32(hp, bleedDamage));
+
+        __m256i strength = active[(int)StatusEffect::STRENGTH_UP];
+        __m256i weakness = active[(int)StatusEffect::WEAKNESS];
+        atk = _mm256_blendv_epi8(atk, _mm256_add_epi32(base, ten), strength);
+        atk = _mm256_blendv_epi8(atk, _mm256_max_epi32(one, _mm256_sub_epi32(base, five)), weakness);
+
+        for (int e = 1; e < STATUS_COUNT; e++)
+        {
+            // Active lanes are all-ones (-1), so adding the mask decrements them
+            duration[e] = _mm256_add_epi32(duration[e], active[e]);
+            _mm256_storeu_si256((__m256i *)(unit.status[e].data() + i), duration[e]);
+        }
+
+        __m256i reset = _mm256_or_si256(
+            _mm256_and_si256(strength, _mm256_cmpeq_epi32(duration[(int)StatusEffect::STRENGTH_UP], zero)),
+            _mm256_and_si256(weakness, _mm256_cmpeq_epi32(duration[(int)StatusEffect::WEAKNESS], zero)));
+        atk = _mm256_blendv_epi8(atk, base, reset);
+
+        _mm256_storeu_si256((__m256i *)(health + i), hp);
+        _mm256_storeu_si256((__m256i *)(attack + i), atk);
+    }
+    return i;
+}
+#elif defined(__SSE4_1__)
+const char *simdKernelName = "SSE4.1";
+const size_t SIMD_LANES = 4;
+
+size_t applyDamageSimd(int32_t *health, const int32_t *defense, const int32_t *damage, const int32_t *hits, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi32(1);
+    size_t i = 0;
+    for (; i + SIMD_LANES <= n; i += SIMD_LANES)
+    {
+        __m128i hp = _mm_loadu_si128((const __m128i *)(health + i));
+        __m128i def = _mm_loadu_si128((const __m128i *)(defense + i));
+        __m128i dmg = _mm_loadu_si128((const __m128i *)(damage + i));
+        __m128i cnt = _mm_loadu_si128((const __m128i *)(hits + i));
+        __m128i actual = _mm_mullo_epi32(_mm_max_epi32(one, _mm_sub_epi32(dmg, def)), cnt);
+        hp = _mm_max_epi32(zero, _mm_sub_epi32(hp, actual));
+        _mm_storeu_si128((__m128i *)(health + i), hp);
+    }
+    return i;
+}
+
+size_t tickStatusSimd(CombatantArrays &, const int32_t *, size_t)
+{
+    return 0; // The scalar tick handles every slot on SSE-only targets
+}
+#elif defined(__ARM_NEON)
+const char *simdKernelName = "NEON";
+const size_t SIMD_LANES = 4;
+
+size_t applyDamageSimd(int32_t *health, const int32_t *defense, const int32_t *damage, const int32_t *hits, size_t n)
+{
+    const int32x4_t zero = vdupq_n_s32(0);
+    const int32x4_t one = vdupq_n_s32(1);
+    size_t i = 0;
+    for (; i + SIMD_LANES <= n; i += SIMD_LANES)
+    {
+        int32x4_t actual = vmulq_s32(vmaxq_s32(one, vsubq_s32(vld1q_s32(damage + i), vld1q_s32(defense + i))),
+                                     vld1q_s32(hits + i));
+        vst1q_s32(health + i, vmaxq_s32(zero, vsubq_s32(vld1q_s32(health + i), actual)));
+    }
+    return i;
+}
+
+size_t tickStatusSimd(CombatantArrays &, const int32_t *, size_t)
+{
+    return 0; // The scalar tick handles every slot on NEON targets
+}
+#else
+const char *simdKernelName = "scalar";
+
+size_t applyDamageSimd(int32_t *, const int32_t *, const int32_t *, const int32_t *, size_t) { return 0; }
+size_t tickStatusSimd(CombatantArrays &, const int32_t *, size_t) { return 0; }
+#endif
+
+void applyDamageKernel(int32_t *health, const int32_t *defense, const int32_t *damage, const int32_t *hits, size_t n)
+{
+    size_t done = applyDamageSimd(health, defense, damage, hits, n);
+    applyDamageScalar(health, defense, damage, hits, done, n);
+}
+
+void tickStatusKernel(CombatantArrays &unit, const int32_t *mask, size_t n)
+{
+    size_t done = tickStatusSimd(unit, mask, n);
+    tickStatusScalar(unit, mask, done, n);
+}
+
+/**
+ * @brief Structure-of-arrays store advancing many independent hero-vs-boss
+ * battles at once.
+ *
+ * Every slot holds one stage fight. step() plays one combat-loop round of
+ * every running slot with the same rules as gameLoop (Unit::takeDamage,
+ * processStatusEffects and the class skills) and the AutoPolicy decisions,
+ * but on plain integer columns with no virtual calls, strings or logging.
+ * A round runs in three phases (boss opening for boss-first slots, player
+ * turn, boss closing for player-first slots); decisions are made per slot
+ * and queue their hits, then the damage and status-tick kernels sweep the
+ * columns. A slot seeded like a GameContext draws the same random numbers in
+ * the same order as the object version.
+ */
+class BattleBatch
+{
+public:
+    enum Outcome : uint8_t
+    {
+        RUNNING,
+        PLAYER_WON,
+        BOSS_WON
+    };
+
+    CombatantArrays player;
+    CombatantArrays boss;
+    vector<uint8_t> playerClass; // 1 = Warrior, 2 = Archer, 3 = Mage
+    vector<uint8_t> playerFirst;
+    vector<uint8_t> outcome;
+    vector<int32_t> healthPotions;
+    vector<int32_t> manaPotions;
+    vector<int32_t> turns;
+    vector<Rng> rng;
+    vector<const BossTactics *> tactics;
+    vector<int8_t> scriptedMove; // BattleMove the player makes next round, or AUTO_MOVE for AutoPolicy's
+
+    static constexpr int8_t AUTO_MOVE = -1;
+
+    size_t size() const { return outcome.size(); }
+
+    // Drops every battle, keeping the storage for the next ones
+    void clear()
+    {
+        player.clear();
+        boss.clear();
+        playerClass.clear();
+        playerFirst.clear();
+        outcome.clear();
+        healthPotions.clear();
+        manaPotions.clear();
+        turns.clear();
+        rng.clear();
+        tactics.clear();
+        scriptedMove.clear();
+        pendingDamage.clear();
+        pendingHits.clear();
+        phaseMask.clear();
+        potionUsed.clear();
+    }
+
+    /**
+     * @brief Adds a battle of `hero` (class 1-3) against the boss of `stage`.
+     * The coin flip is made here with heads picked, like AutoPolicy.
+     * @return The new battle's slot.
+     */
+    size_t addBattle(const Unit &hero, int classChoice, int stage, uint64_t seed)
+    {
+        size_t slot = size();
+
+        player.push(hero.getHealth(), hero.getMaxHealth(), hero.getMana(), hero.getMaxMana(),
+                    hero.getBaseAttack(), hero.getAttack(), hero.getDefense());
+        for (int e = 0; e < STATUS_COUNT; e++)
+            player.status[e][slot] = hero.getStatusDuration((StatusEffect)e);
+
+        int bossHealth = bossHealthForStage(stage);
+        int bossAttack = bossAttackForStage(stage);
+        boss.push(bossHealth, bossHealth, BOSS_MANA, BOSS_MANA, bossAttack, bossAttack, bossDefenseForStage(stage));
+
+        int hp = 0, mp = 0;
+        for (ItemId potion : hero.getPotions())
+            (isHealthPotion(potion) ? hp : mp)++;
+        healthPotions.push_back(hp);
+        manaPotions.push_back(mp);
+
+        playerClass.push_back(clamp(classChoice, 1, 3));
+        turns.push_back(0);
+        rng.emplace_back(seed);
+        tactics.push_back(&activeTactics[stage - 1]);
+        playerFirst.push_back(rng[slot].below(2) == 0);
+        outcome.push_back(RUNNING);
+        scriptedMove.push_back(AUTO_MOVE);
+
+        pendingDamage.push_back(0);
+        pendingHits.push_back(0);
+        phaseMask.push_back(0);
+        potionUsed.push_back(0);
+        return slot;
+    }
+
+    /**
+     * @brief Plays one round of every running battle.
+     * @return Number of battles still running.
+     */
+    size_t step()
+    {
+        const size_t n = size();
+
+        // Phase 1: boss-first rounds open with the boss
+        for (size_t i = 0; i < n; i++)
+        {
+            bool acts = outcome[i] == RUNNING && !playerFirst[i];
+            beginPhase(i, acts);
+            if (acts)
+            {
+                ++turns[i];
+                bossTurn(i);
+            }
+        }
+        applyDamageKernel(player.health.data(), player.defense.data(), pendingDamage.data(), pendingHits.data(), n);
+        tickStatusKernel(boss, phaseMask.data(), n);
+
+        // Phase 2: player turn (skipped when the boss's opening decided the fight)
+        for (size_t i = 0; i < n; i++)
+        {
+            if (outcome[i] == RUNNING && playerFirst[i])
+                ++turns[i];
+            bool acts = outcome[i] == RUNNING && player.health[i] > 0 && boss.health[i] > 0;
+            beginPhase(i, acts);
+            potionUsed[i] = acts && playerTurn(i);
+        }
+        applyDamageKernel(boss.health.data(), boss.defense.data(), pendingDamage.data(), pendingHits.data(), n);
+        tickStatusKernel(player, phaseMask.data(), n);
+
+        // Phase 3: player-first rounds close with the boss unless a potion ended the round
+        for (size_t i = 0; i < n; i++)
+        {
+            bool acts = outcome[i] == RUNNING && playerFirst[i] && !potionUsed[i] && boss.health[i] > 0 &&
+                        player.health[i] > 0;
+            beginPhase(i, acts);
+            if (acts)
+                bossTurn(i);
+        }
+        applyDamageKernel(player.health.data(), player.defense.data(), pendingDamage.data(), pendingHits.data(), n);
+        tickStatusKernel(boss, phaseMask.data(), n);
+
+        size_t running = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (outcome[i] != RUNNING)
+                continue;
+            if (player.health[i] <= 0)
+                outcome[i] = BOSS_WON;
+            else if (boss.health[i] <= 0)
+                outcome[i] = PLAYER_WON;
+            else
+                ++running;
+        }
+        return running;
+    }
+
+    // Steps until every battle has finished
+    void runToCompletion()
+    {
+        while (step() > 0)
+        {
+        }
+    }
+
+private:
+    // Per-phase scratch columns: hits queued by the acting side, and which slots act
+    vector<int32_t> pendingDamage;
+    vector<int32_t> pendingHits;
+    vector<int32_t> phaseMask;
+    vector<uint8_t> potionUsed;
+
+    void beginPhase(size_t i, bool acts)
+    {
+        phaseMask[i] = acts;
+        pendingHits[i] = 0;
+    }
+
+    // Queues `hits` hits of `dmg` on the opposing side for this phase's damage kernel
+    void queueHits(size_t i, int dmg, int hits = 1)
+    {
+        pendingDamage[i] = dmg;
+        pendingHits[i] = hits;
+    }
+
+    // Unit::heal
+    static void heal(CombatantArrays &unit, size_t i, int amount)
+    {
+        unit.health[i] = min(unit.maxHealth[i], unit.health[i] + amount);
+    }
+
+    // Unit::restoreMana
+    static void restoreMana(CombatantArrays &unit, size_t i, int amount)
+    {
+        unit.mana[i] = min(unit.maxMana[i], unit.mana[i] + amount);
+    }
+
+    static void addStatus(CombatantArrays &unit, size_t i, StatusEffect effect, int duration)
+    {
+        unit.status[(int)effect][i] = duration;
+    }
+
+    // Unit::useSkill on the columns; `user` is the side whose skill resolves
+    static bool resolveSkill(const SkillDesc &desc, CombatantArrays &user, CombatantArrays &opponent,
+                             size_t i, BattleBatch &batch)
+    {
+        if (user.mana[i] < desc.cost)
+            return false;
+        user.mana[i] -= desc.cost;
+
+        int dmg = user.attack[i] + desc.damageBonus;
+        if (desc.hits > 0)
+            batch.queueHits(i, dmg, desc.hits);
+        if (desc.status != StatusEffect::NONE)
+            addStatus(desc.statusOnSelf ? user : opponent, i, desc.status, desc.statusDuration);
+        if (desc.drain)
+            heal(user, i, dmg / 2);
+        if (desc.selfHeal > 0)
+            heal(user, i, desc.selfHeal);
+        return true;
+    }
+
+    bool playerSkill(size_t i, int skill)
+    {
+        return resolveSkill(classSkills[playerClass[i]][skill - 1], player, boss, i, *this);
+    }
+
+    void bossSkill(size_t i, int skill)
+    {
+        resolveSkill(bossSkills[skill - 1], boss, player, i, *this);
+    }
+
+    // AutoPolicy::bestSkill
+    int bestSkill(size_t i) const
+    {
+        int best = 0;
+        int bestCost = -1;
+        for (int s = 0; s < SKILLS_PER_UNIT; s++)
+        {
+            int cost = classSkills[playerClass[i]][s].cost;
+            if (cost <= player.mana[i] && cost > bestCost)
+            {
+                best = s + 1;
+                bestCost = cost;
+            }
+        }
+        return best;
+    }
+
+    // BattleState::playerMove on the columns, once past the stun check
+    bool playMove(size_t i, BattleMove move)
+    {
+        switch (move)
+        {
+        case BattleMove::ATTACK:
+            queueHits(i, player.attack[i]);
+            break;
+        case BattleMove::SKILL_1:
+        case BattleMove::SKILL_2:
+        case BattleMove::SKILL_3:
+            if (!playerSkill(i, 1 + (int)move - (int)BattleMove::SKILL_1))
+                queueHits(i, player.attack[i]);
+            break;
+        case BattleMove::HEALTH_POTION:
+            if (healthPotions[i] == 0)
+                break;
+            --healthPotions[i];
+            heal(player, i, itemDef(ItemId::HEALTH_POTION).healthBonus);
+            return true;
+        case BattleMove::MANA_POTION:
+            if (manaPotions[i] == 0)
+                break;
+            --manaPotions[i];
+            restoreMana(player, i, itemDef(ItemId::MANA_POTION).manaBonus);
+            return true;
+        case BattleMove::PASS:
+            break;
+        }
+        return false;
+    }
+
+    // playerTurn with AutoPolicy decisions, or the scripted move; true if a potion ended the round
+    bool playerTurn(size_t i)
+    {
+        const int stun = (int)StatusEffect::STUN;
+        if (player.status[stun][i] > 0)
+        {
+            player.status[stun][i] = 0;
+            return false;
+        }
+
+        bool lowHealth = player.health[i] * 3 < player.maxHealth[i];
+        int skill = bestSkill(i);
+
+        if (scriptedMove[i] != AUTO_MOVE)
+            return playMove(i, (BattleMove)scriptedMove[i]);
+
+        if ((lowHealth && healthPotions[i] > 0) || (skill == 0 && manaPotions[i] > 0))
+            return playMove(i, lowHealth && healthPotions[i] > 0 ? BattleMove::HEALTH_POTION : BattleMove::MANA_POTION);
+
+        if (skill == 0 || !playerSkill(i, skill))
+            queueHits(i, player.attack[i]);
+        return false;
+    }
+
+    // bossTurn
+    void bossTurn(size_t i)
+    {
+        const int stun = (int)StatusEffect::STUN;
+        if (boss.status[stun][i] > 0)
+        {
+            boss.status[stun][i] = 0;
+            return;
+        }
+
+        const int poison = (int)StatusEffect::POISON;
+        int situation = BossTactics::situation(boss.health[i], boss.maxHealth[i], boss.mana[i], player.health[i],
+                                               player.maxHealth[i], player.status[stun][i] > 0,
+                                               player.status[poison][i] > 0);
+        int action = tactics[i]->choose(situation, rng[i]);
+        if (action == 3)
+            queueHits(i, boss.attack[i]);
+        else
+            bossSkill(i, action + 1);
+    }
+};
+
+/**
+ * @brief Checks the damage and status-tick kernels bit-for-bit against
+ * Unit::takeDamage and Unit::processStatusEffects on random states.
+ * @return true if every compared field matched.
+ */
+bool verifyCombatKernels(uint64_t seed, size_t slots = 4099, int rounds = 6)
+{
+    Rng rng(seed);
+    SessionArena arena;
+    CombatantArrays simd, scalar;
+    vector<BossUnit *> units;
+    vector<int32_t> damage(slots), hits(slots), mask(slots);
+
+    for (size_t i = 0; i < slots; i++)
+    {
+        int hp = 1 + rng.below(300), atk = 1 + rng.below(60), def = rng.below(12);
+        BossUnit *unit = arena.create<BossUnit>("Ref", "1", "2", "3", atk, hp, def);
+        unit->getBattleLog().setEnabled(false);
+        simd.push(hp, hp, 0, 0, atk, atk, def);
+        scalar.push(hp, hp, 0, 0, atk, atk, def);
+        for (int e = 1; e < STATUS_COUNT; e++)
+        {
+            if (rng.below(3) == 0)
+            {
+                int duration = 1 + rng.below(4);
+                unit->addStatus((StatusEffect)e, duration, *unit);
+                simd.status[e][i] = scalar.status[e][i] = duration;
+            }
+        }
+        units.push_back(unit);
+    }
+
+    size_t mismatches = 0;
+    for (int round = 0; round < rounds; round++)
+    {
+        for (size_t i = 0; i < slots; i++)
+        {
+            damage[i] = rng.below(80) - 10; // Includes hits weaker than the defense
+            hits[i] = rng.below(3);
+            mask[i] = rng.below(4) != 0;
+        }
+
+        applyDamageKernel(simd.health.data(), simd.defense.data(), damage.data(), hits.data(), slots);
+        applyDamageScalar(scalar.health.data(), scalar.defense.data(), damage.data(), hits.data(), 0, slots);
+        tickStatusKernel(simd, mask.data(), slots);
+        tickStatusScalar(scalar, mask.data(), 0, slots);
+
+        for (size_t i = 0; i < slots; i++)
+        {
+            Unit &unit = *units[i];
+            for (int h = 0; h < hits[i]; h++)
+                unit.takeDamage(damage[i]);
+            if (mask[i])
+                unit.processStatusEffects();
+
+            bool same = unit.getHealth() == simd.health[i] && unit.getHealth() == scalar.health[i] &&
+                        unit.getAttack() == simd.attack[i] && unit.getAttack() == scalar.attack[i];
+            for (int e = 1; e < STATUS_COUNT; e++)
+            {
+                int expected = unit.getStatusDuration((StatusEffect)e);
+                same = same && expected == simd.status[e][i] && expected == scalar.status[e][i];
+            }
+            mismatches += !same;
+        }
+    }
+
+    cout << "Combat kernels (" << simdKernelName << "): " << slots * rounds << " slot updates, "
+         << mismatches << " mismatches\n";
+    return mismatches == 0;
+}
+
+/**
+ * @brief Plays random stage fights through Unit and through BattleState
+ * side by side, comparing the snapshot after every turn.
+ * @return true if the snapshot rules never drifted from the object ones.
+ */
+bool verifyBattleSnapshot(uint64_t seed, int battles = 2000)
+{
+    Rng rng(seed);
+    long long turns = 0, mismatches = 0;
+
+    for (int b = 0; b < battles; b++)
+    {
+        GameContext ctx;
+        ctx.headless = true;
+        ctx.battleLog = false;
+        ctx.rng.reseed(rng.next());
+        Unit *player = createPlayerOfClass(ctx.arena, 1 + rng.below(3), "Ref");
+        player->getBattleLog().setEnabled(false);
+        for (int i = rng.below(4); i > 0; i--)
+            player->addItem((ItemId)rng.below(EQUIPMENT_COUNT));
+        dropPotions(player, rng);
+        BossUnit *boss = spawnBoss(1 + rng.below(5), ctx);
+        EnemyPool noWave(ctx.arena.resource());
+
+        vector<uint8_t> answers;
+        ReplayPolicy policy(answers);
+        BattleState model = BattleState::capture(*player, *boss, true);
+
+        while (player->isAlive() && boss->isAlive() && mismatches == 0)
+        {
+            ++turns;
+            if (!model.player.hasStatus(StatusEffect::STUN))
+            {
+                BattleMove move = (BattleMove)rng.below((int)BattleMove::PASS + 1);
+                if ((move == BattleMove::HEALTH_POTION && model.healthPotions == 0) ||
+                    (move == BattleMove::MANA_POTION && model.manaPotions == 0))
+                    move = BattleMove::PASS;
+
+                if (move == BattleMove::ATTACK)
+                    answers.push_back(1);
+                else if (move == BattleMove::PASS)
+                    answers.push_back(4);
+                else if (move == BattleMove::HEALTH_POTION || move == BattleMove::MANA_POTION)
+                    answers.insert(answers.end(), {3, (uint8_t)(findPotion(*player, move == BattleMove::HEALTH_POTION) + 1)});
+                else
+                    answers.insert(answers.end(), {2, (uint8_t)(1 + (int)move - (int)BattleMove::SKILL_1)});
+                model.playerMove(move);
+            }
+            else
+            {
+                model.playerMove(BattleMove::PASS);
+            }
+            playerTurn(player, boss, noWave, policy, ctx, false);
+            player->processStatusEffects();
+            model.player.processStatusEffects();
+
+            Rng peek = ctx.rng;
+            model.bossMove(model.boss.hasStatus(StatusEffect::STUN) ? 0 : boss->chooseAction(*player, peek));
+            bossTurn(boss, player, ctx);
+            boss->processStatusEffects();
+            model.boss.processStatusEffects();
+
+            BattleState actual = BattleState::capture(*player, *boss, true);
+            bool same = actual.player == model.player && actual.boss == model.boss &&
+                        actual.healthPotions == model.healthPotions && actual.manaPotions == model.manaPotions;
+            mismatches += !same || !policy.consumedExactly();
+        }
+    }
+
+    cout << "Battle snapshot: " << battles << " battles, " << turns << " rounds, " << mismatches << " mismatches\n";
+    return mismatches == 0;
+}
+
+/**
+ * @brief Runs `battles` fresh heroes of one class against one stage's boss in a BattleBatch.
+ */
+void runBatchedBattles(long long battles, int classChoice, int stage, uint64_t seed)
+{
+    auto start = chrono::steady_clock::now();
+
+    SessionArena arena;
+    Unit *hero = createPlayerOfClass(arena, classChoice, "Sim");
+    BattleBatch batch;
+    for (long long i = 0; i < battles; i++)
+        batch.addBattle(*hero, classChoice, stage, gameSeed(seed, i));
+
+    long long rounds = 0;
+    while (batch.step() > 0)
+        ++rounds;
+
+    long long wins = 0, turns = 0;
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        wins += batch.outcome[i] == BattleBatch::PLAYER_WON;
+        turns += batch.turns[i];
+    }
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout << "Battles: " << battles << " (stage " << stage << ")\n";
+    if (battles == 0)
+        return;
+    cout << "Win rate: " << 100.0 * wins / battles << "%\n";
+    cout << "Average turns per battle: " << (double)turns / battles << "\n";
+    cout << "Batch steps: " << rounds + 1 << "\n";
+    cout << "Elapsed: " << elapsed.count() << " s (" << 1e9 * elapsed.count() / turns << " ns per battle turn)\n";
+}
+
+// ========== Differential Harness ==========
+#ifndef WHG_FUZZ
+#define WHG_FUZZ 0 // Build with -DWHG_FUZZ=1 -fsanitize=fuzzer for a libFuzzer target instead of the game
+#endif
+
+/*
+ * One fight played by every rule set at once: the Unit class hierarchy in
+ * gameLoop's turn order, the BattleState snapshot, and a one-slot
+ * BattleBatch with its combat kernels. The input is raw bytes so libFuzzer
+ * can drive it:
+ *   0      class (mod 3)
+ *   1      stage (mod 5)
+ *   2      potions: health in the low nibble, mana in the high one
+ *   3-5    one equipment piece each (mod EQUIPMENT_COUNT + 1; the extra value is none)
+ *   6-13   seed, little-endian
+ *   14...  the player's move for each round (mod 7, a BattleMove)
+ * The fight lasts until it is decided or the moves run out.
+ */
+constexpr size_t DIFFERENTIAL_HEADER = 14;
+
+// Makes a given BattleMove through the menus playerTurn shows
+class ScriptedMovePolicy : public AutoPolicy
+{
+public:
+    BattleMove move = BattleMove::PASS;
+
+    int chooseAction(const Unit &, const Unit &) override
+    {
+        switch (move)
+        {
+        case BattleMove::ATTACK:
+            return 1;
+        case BattleMove::SKILL_1:
+        case BattleMove::SKILL_2:
+        case BattleMove::SKILL_3:
+            return 2;
+        case BattleMove::HEALTH_POTION:
+        case BattleMove::MANA_POTION:
+            return 3;
+        default:
+            return 4;
+        }
+    }
+    int chooseSkill(const Unit &, const Unit &) override { return 1 + (int)move - (int)BattleMove::SKILL_1; }
+    int choosePotion(const Unit &player) override
+    {
+        return findPotion(player, move == BattleMove::HEALTH_POTION) + 1;
+    }
+};
+
+void describeFighter(ostream &out, const char *engine, const FighterState &fighter)
+{
+    out << "  " << engine << ": HP " << fighter.health << "/" << fighter.maxHealth << ", MP " << fighter.mana << "/"
+        << fighter.maxMana << ", ATK " << fighter.attack << "/" << fighter.baseAttack << ", DEF " << fighter.defense
+        << ", statuses";
+    for (int e = 1; e < STATUS_COUNT; e++)
+        out << " " << (int)fighter.status[e];
+    out << "\n";
+}
+
+/**
+ * @brief Plays one encoded fight through all three engines, comparing HP,
+ * MP, attack, defense, statuses and potions after every turn (BattleBatch,
+ * which steps whole rounds, after every round).
+ * @param report Where to describe the first disagreement, if anywhere
+ * @return Rounds played, or -1 if the engines disagreed
+ */
+long long runDifferentialCase(const uint8_t *data, size_t size, ostream *report = nullptr)
+{
+    if (size < DIFFERENTIAL_HEADER)
+        return 0;
+
+    int classChoice = 1 + data[0] % 3;
+    int stage = 1 + data[1] % 5;
+    uint64_t seed = 0;
+    for (int b = 0; b < 8; b++)
+        seed |= (uint64_t)data[6 + b] << (8 * b);
+
+    GameContext ctx;
+    ctx.headless = true;
+    ctx.battleLog = false;
+    ctx.rng.reseed(seed);
+    Unit *player = createPlayerOfClass(ctx.arena, classChoice, "Ref");
+    player->getBattleLog().setEnabled(false);
+    for (int b = 3; b < 6; b++)
+    {
+        if (int item = data[b] % (EQUIPMENT_COUNT + 1); item < EQUIPMENT_COUNT)
+            player->addItem((ItemId)item);
+    }
+    for (int i = data[2] & 15; i > 0; i--)
+        player->addItem(ItemId::HEALTH_POTION);
+    for (int i = data[2] >> 4; i > 0; i--)
+        player->addItem(ItemId::MANA_POTION);
+    BossUnit *boss = spawnBoss(stage, ctx);
+    EnemyPool noWave(ctx.arena.resource());
+
+    static thread_local BattleBatch batch; // Reused so a fight costs no column allocations
+    batch.clear();
+    batch.addBattle(*player, classChoice, stage, seed);
+    bool playerFirst = ctx.rng.below(2) == 0; // The coin flip addBattle made from the same seed
+    BattleState model = BattleState::capture(*player, *boss, playerFirst);
+    ScriptedMovePolicy policy;
+    TurnScheduler turns(player, playerFirst);
+    turns.addEnemy(boss);
+
+    long long rounds = 0;
+    auto disagree = [&](const char *engine, const FighterState &hero, const FighterState &enemy, int healthPotions,
+                        int manaPotions, const char *after)
+    {
+        if (hero == model.player && enemy == model.boss && healthPotions == model.healthPotions &&
+            manaPotions == model.manaPotions)
+            return false;
+        if (report)
+        {
+            *report << "Round " << rounds << ", after the " << after << ": " << engine
+                    << " left the snapshot rules (class " << classChoice << ", stage " << stage << ")\n";
+            describeFighter(*report, "BattleState hero", model.player);
+            describeFighter(*report, engine, hero);
+            describeFighter(*report, "BattleState boss", model.boss);
+            describeFighter(*report, engine, enemy);
+            *report << "  potions " << (int)model.healthPotions << "+" << (int)model.manaPotions << " vs "
+                    << healthPotions << "+" << manaPotions << "\n";
+        }
+        return true;
+    };
+    auto unitDisagrees = [&](const char *after)
+    {
+        int healthPotions = 0, manaPotions = 0;
+        for (ItemId potion : player->getPotions())
+            ++(isHealthPotion(potion) ? healthPotions : manaPotions);
+        return disagree("Unit", FighterState::capture(*player), FighterState::capture(*boss), healthPotions,
+                        manaPotions, after);
+    };
+
+    for (size_t next = DIFFERENTIAL_HEADER; next < size && turns.beginRound(); next++)
+    {
+        ++rounds;
+        BattleMove move = (BattleMove)(data[next] % ((int)BattleMove::PASS + 1));
+        if ((move == BattleMove::HEALTH_POTION && model.healthPotions == 0) ||
+            (move == BattleMove::MANA_POTION && model.manaPotions == 0))
+            move = BattleMove::PASS;
+        policy.move = move;
+        batch.scriptedMove[0] = (int8_t)move;
+
+        for (int actor; (actor = turns.nextActor()) != TurnScheduler::ROUND_OVER;)
+        {
+            if (actor == TurnScheduler::PLAYER)
+            {
+                bool usedPotion = playerTurn(player, boss, noWave, policy, ctx, false);
+                player->processStatusEffects();
+                bool modelPotion = model.playerMove(move);
+                model.player.processStatusEffects();
+                if (usedPotion)
+                    turns.endRound();
+                if (unitDisagrees("player turn") || usedPotion != modelPotion)
+                    return -1;
+            }
+            else
+            {
+                Rng peek = ctx.rng;
+                model.bossMove(model.boss.hasStatus(StatusEffect::STUN) ? 0 : boss->chooseAction(*player, peek));
+                bossTurn(boss, player, ctx);
+                boss->processStatusEffects();
+                model.boss.processStatusEffects();
+                if (unitDisagrees("boss turn"))
+                    return -1;
+            }
+        }
+
+        bool running = batch.step() > 0;
+        if (disagree("BattleBatch", batch.player.at(0), batch.boss.at(0), batch.healthPotions[0],
+                     batch.manaPotions[0], "round") ||
+            running != (player->isAlive() && boss->isAlive()))
+            return -1;
+    }
+    return rounds;
+}
+
+/**
+ * @brief Runs `fights` random fights through runDifferentialCase.
+ * @return true if no engine ever drifted from the others.
+ */
+bool verifyDifferential(uint64_t seed, int fights = 20000)
+{
+    auto start = chrono::steady_clock::now();
+    Rng rng(seed);
+    vector<uint8_t> input;
+    long long rounds = 0, mismatches = 0;
+
+    for (int f = 0; f < fights; f++)
+    {
+        input.resize(DIFFERENTIAL_HEADER + 1 + rng.below(40));
+        for (uint8_t &byte : input)
+            byte = (uint8_t)rng.next();
+        long long played = runDifferentialCase(input.data(), input.size(), mismatches == 0 ? &cout : nullptr);
+        if (played < 0)
+            ++mismatches;
+        else
+            rounds += played;
+    }
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout << "Differential: " << fights << " fights, " << rounds << " rounds, " << mismatches << " mismatches ("
+         << rounds / elapsed.count() << " rounds/s)\n";
+    return mismatches == 0;
+}
+
+#if WHG_FUZZ
+// libFuzzer entry point: any disagreement between the engines is a crash, saved with the input that caused it
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (runDifferentialCase(data, size, &cerr) < 0)
+        abort();
+    return 0;
+}
+#endif
+
+// ========== Benchmarks ==========
+/*
+ * Heap allocations made by the current thread. The whole operator new and
+ * delete family of the program is replaced below, every form on malloc() and
+ * free(), so the benchmarks can tell how often a turn reaches the heap
+ * instead of the session arena, and no form is paired with another's free.
+ */
+thread_local long long heapAllocations = 0;
+
+// All kept out of line: once inlined, GCC pairs the malloc() and free() with the calls and reports a mismatch
+[[gnu::noinline]] void *countedAlloc(size_t size) noexcept
+{
+    ++heapAllocations;
+    return malloc(size ? size : 1);
+}
+
+[[gnu::noinline]] void *countedAlignedAlloc(size_t size, align_val_t alignment) noexcept
+{
+    ++heapAllocations;
+    size_t align = (size_t)alignment;
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, align);
+#else
+    return aligned_alloc(align, (max<size_t>(size, 1) + align - 1) / align * align); // Size must be a multiple
+#endif
+}
+
+[[gnu::noinline]] void alignedFree(void *memory) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+void *operator new(size_t size)
+{
+    if (void *memory = countedAlloc(size))
+        return memory;
+    throw bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    if (void *memory = countedAlloc(size))
+        return memory;
+    throw bad_alloc();
+}
+
+void *operator new(size_t size, align_val_t alignment)
+{
+    if (void *memory = countedAlignedAlloc(size, alignment))
+        return memory;
+    throw bad_alloc();
+}
+
+void *operator new[](size_t size, align_val_t alignment)
+{
+    if (void *memory = countedAlignedAlloc(size, alignment))
+        return memory;
+    throw bad_alloc();
+}
+
+void *operator new(size_t size, const nothrow_t &) noexcept { return countedAlloc(size); }
+void *operator new[](size_t size, const nothrow_t &) noexcept { return countedAlloc(size); }
+void *operator new(size_t size, align_val_t alignment, const nothrow_t &) noexcept
+{
+    return countedAlignedAlloc(size, alignment);
+}
+void *operator new[](size_t size, align_val_t alignment, const nothrow_t &) noexcept
+{
+    return countedAlignedAlloc(size, alignment);
+}
+
+[[gnu::noinline]] void operator delete(void *memory) noexcept { free(memory); }
+[[gnu::noinline]] void operator delete[](void *memory) noexcept { free(memory); }
+[[gnu::noinline]] void operator delete(void *memory, size_t) noexcept { free(memory); }
+[[gnu::noinline]] void operator delete[](void *memory, size_t) noexcept { free(memory); }
+[[gnu::noinline]] void operator delete(void *memory, const nothrow_t &) noexcept { free(memory); }
+[[gnu::noinline]] void operator delete[](void *memory, const nothrow_t &) noexcept { free(memory); }
+void operator delete(void *memory, align_val_t) noexcept { alignedFree(memory); }
+void operator delete[](void *memory, align_val_t) noexcept { alignedFree(memory); }
+void operator delete(void *memory, size_t, align_val_t) noexcept { alignedFree(memory); }
+void operator delete[](void *memory, size_t, align_val_t) noexcept { alignedFree(memory); }
+void operator delete(void *memory, align_val_t, const nothrow_t &) noexcept { alignedFree(memory); }
+void operator delete[](void *memory, align_val_t, const nothrow_t &) noexcept { alignedFree(memory); }
+
+/**
+ * @brief Last-level cache misses of the calling thread, read from the Linux
+ * perf interface. Where that is unavailable (other systems, containers,
+ * perf_event_paranoid) every reading is -1.
+ */
+class CacheMissCounter
+{
+private:
+    int fd = -1;
+
+public:
+    CacheMissCounter()
+    {
+#ifdef __linux__
+        perf_event_attr attr = {};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    CacheMissCounter(const CacheMissCounter &) = delete;
+    CacheMissCounter &operator=(const CacheMissCounter &) = delete;
+
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    bool available() const { return fd >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // Misses since start(), or -1
+    long long stop()
+    {
+        long long count = -1;
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+                count = -1;
+        }
+#endif
+        return count;
+    }
+};
+
+constexpr double BENCH_TOLERANCE = 0.25; // Slowdown against a baseline that counts as a regression; meant for a quiet machine
+
+struct BenchResult
+{
+    string name;          // One word, so results can be written to and read from a baseline file
+    double nsPerOp;
+    double allocsPerOp;
+    double missesPerOp;   // Negative when the counter is unavailable
+};
+
+/**
+ * @brief Times `op(i)` over `iterations` calls, best of five repetitions.
+ * Allocations and cache misses are those of the fastest repetition.
+ */
+template <typename Op>
+BenchResult measure(const string &name, long long iterations, CacheMissCounter &misses, Op op)
+{
+    BenchResult result = {name, numeric_limits<double>::infinity(), 0, -1};
+    for (int repetition = 0; repetition < 5; repetition++)
+    {
+        long long allocationsBefore = heapAllocations;
+        misses.start();
+        auto start = chrono::steady_clock::now();
+        for (long long i = 0; i < iterations; i++)
+            op(i);
+        chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+        long long missCount = misses.stop();
+
+        double nsPerOp = elapsed.count() / iterations;
+        if (nsPerOp < result.nsPerOp)
+        {
+            result.nsPerOp = nsPerOp;
+            result.allocsPerOp = (double)(heapAllocations - allocationsBefore) / iterations;
+            result.missesPerOp = missCount < 0 ? -1 : (double)missCount / iterations;
+        }
+    }
+    return result;
+}
+
+// A unit that can take hits and cast forever: huge HP and MP, nothing else changed
+Unit *benchUnit(GameContext &ctx, int classChoice, bool logged)
+{
+    Unit *unit = createPlayerOfClass(ctx.arena, classChoice, "Bench");
+    UnitState state;
+    unit->captureState(state);
+    state.maxHealth = state.health = 2000000000;
+    state.maxMana = state.mana = 2000000000;
+    unit->restoreState(state);
+    unit->getBattleLog().setEnabled(logged);
+    return unit;
+}
+
+/**
+ * @brief Runs the combat primitive and full-run benchmarks.
+ *
+ * Primitives run with the battle log off, as headless games do, except for
+ * the logged takeDamage variant. Full runs are single-threaded headless
+ * games with AutoPolicy, reported per turn.
+ */
+vector<BenchResult> runBenchmarks(long long iterations, uint64_t seed)
+{
+    vector<BenchResult> results;
+    CacheMissCounter misses;
+    volatile long long sink = 0; // Keeps results observable so the loops are not optimized away
+
+    GameContext ctx;
+    ctx.headless = true;
+    ctx.battleLog = false;
+    ctx.rng.reseed(seed);
+    Unit *target = benchUnit(ctx, 1, false);
+    Unit *loggedTarget = benchUnit(ctx, 1, true);
+
+    results.push_back(measure("takeDamage", iterations, misses, [&](long long i) { target->takeDamage(10 + (i & 15)); }));
+    results.push_back(measure("takeDamage.logged", iterations, misses,
+                              [&](long long i) { loggedTarget->takeDamage(10 + (i & 15)); }));
+
+    Unit *afflicted = benchUnit(ctx, 1, false);
+    for (int effect = 1; effect < STATUS_COUNT; effect++)
+        if ((StatusEffect)effect != StatusEffect::STUN)
+            afflicted->addStatus((StatusEffect)effect, 1 << 30, *target);
+    results.push_back(measure("processStatusEffects", iterations, misses,
+                              [&](long long) { afflicted->processStatusEffects(); }));
+
+    results.push_back(measure("addStatus+hasStatus", iterations, misses, [&](long long i) {
+        StatusEffect effect = (StatusEffect)(1 + i % (STATUS_COUNT - 1));
+        target->addStatus(effect, 3, *afflicted);
+        sink = sink + target->hasStatus((StatusEffect)(1 + (i + 2) % (STATUS_COUNT - 1)));
+    }));
+
+    for (int classChoice = 1; classChoice <= 3; classChoice++)
+    {
+        Unit *caster = benchUnit(ctx, classChoice, false);
+        for (int skill = 1; skill <= SKILLS_PER_UNIT; skill++)
+        {
+            results.push_back(measure(string(className(classChoice)) + ".useSkill" + to_string(skill), iterations,
+                                      misses, [&](long long) { sink = sink + caster->useSkill(skill, *target); }));
+        }
+    }
+
+    results.push_back(measure("generateRandomItems", iterations, misses,
+                              [&](long long) { sink = sink + (int)generateRandomItems(ctx.rng)[0]; }));
+    results.push_back(measure("generateRandomPotions", iterations, misses,
+                              [&](long long) { sink = sink + generateRandomPotions(ctx.rng).size(); }));
+
+    // Whole games, per turn; the counters are read around the whole batch of each class
+    long long games = max(1LL, iterations / 100);
+    for (int classChoice = 1; classChoice <= 3; classChoice++)
+    {
+        AutoPolicy policy;
+        long long turns = 0;
+        long long allocationsBefore = heapAllocations;
+        misses.start();
+        auto start = chrono::steady_clock::now();
+        for (long long i = 0; i < games; i++)
+            turns += simulateGame(classChoice, policy, gameSeed(seed, i)).turns;
+        chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+        long long missCount = misses.stop();
+        turns = max(1LL, turns);
+        results.push_back({string(className(classChoice)) + ".gameTurn", elapsed.count() / turns,
+                           (double)(heapAllocations - allocationsBefore) / turns,
+                           missCount < 0 ? -1 : (double)missCount / turns});
+        cout << className(classChoice) << " full runs: " << (long long)(games / (elapsed.count() * 1e-9))
+             << " games/s (" << (double)turns / games << " turns per game)\n";
+    }
+    return results;
+}
+
+/**
+ * @brief Prints the benchmark table and, with a baseline file, gates on it:
+ * a missing baseline is written, an existing one is compared against.
+ * @return Process exit code: 1 if any benchmark got slower than BENCH_TOLERANCE allows or allocates more than before.
+ */
+int reportBenchmarks(const vector<BenchResult> &results, const string &baselinePath)
+{
+    map<string, pair<double, double>> baseline;
+    ifstream in(baselinePath);
+    bool comparing = !baselinePath.empty() && in;
+    string name;
+    double ns, allocs;
+    while (comparing && in >> name >> ns >> allocs)
+        baseline[name] = {ns, allocs};
+
+    int regressions = 0;
+    cout << left << setw(24) << "Benchmark" << right << setw(12) << "ns/op" << setw(12) << "allocs/op"
+         << setw(16) << "cache-miss/op" << (comparing ? "   vs baseline" : "") << "\n";
+    for (const BenchResult &result : results)
+    {
+        cout << left << setw(24) << result.name << right << fixed << setprecision(2) << setw(12) << result.nsPerOp
+             << setw(12) << result.allocsPerOp << setw(16);
+        if (result.missesPerOp < 0)
+            cout << "n/a";
+        else
+            cout << result.missesPerOp;
+
+        auto found = baseline.find(result.name);
+        if (found != baseline.end())
+        {
+            double ratio = result.nsPerOp / found->second.first;
+            bool regressed = ratio > 1.0 + BENCH_TOLERANCE || result.allocsPerOp > found->second.second + 0.01;
+            regressions += regressed;
+            cout << "   " << setw(6) << showpos << 100.0 * (ratio - 1.0) << noshowpos << "%"
+                 << (regressed ? "  REGRESSION" : "");
+        }
+        cout << "\n";
+    }
+    cout << defaultfloat;
+
+    if (!baselinePath.empty() && !comparing)
+    {
+        ofstream out(baselinePath);
+        for (const BenchResult &result : results)
+            out << result.name << " " << result.nsPerOp << " " << result.allocsPerOp << "\n";
+        cout << "Baseline written to " << baselinePath << "\n";
+    }
+    else if (comparing)
+    {
+        cout << regressions << " regression(s) against " << baselinePath << "\n";
+    }
+    return regressions == 0 ? 0 : 1;
+}
+
+// ========== Coroutine Pipeline ==========
+/**
+ * @brief Lazily started coroutine that its caller can co_await.
+ *
+ * Finishing resumes whoever awaited the task (symmetric transfer), so phases
+ * nest like ordinary calls without growing the native stack. A top-level task
+ * is started with start() and owned until it is done().
+ */
+template <typename T>
+struct TaskResult
+{
+    T value{};
+    void return_value(T v) { value = move(v); }
+    T take() { return move(value); }
+};
+
+template <>
+struct TaskResult<void>
+{
+    void return_void() {}
+    void take() {}
+};
+
+template <typename T = void>
+class Task
+{
+public:
+    struct promise_type : TaskResult<T>
+    {
+        coroutine_handle<> continuation;
+
+        Task get_return_object() { return Task(coroutine_handle<promise_type>::from_promise(*this)); }
+        suspend_always initial_suspend() noexcept { return {}; }
+        void unhandled_exception() { terminate(); }
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            coroutine_handle<> await_suspend(coroutine_handle<promise_type> done) noexcept
+            {
+                coroutine_handle<> next = done.promise().continuation;
+                return next ? next : noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+    };
+
+private:
+    coroutine_handle<promise_type> handle;
+
+public:
+    explicit Task(coroutine_handle<promise_type> h) : handle(h) {}
+    Task(Task &&other) noexcept : handle(exchange(other.handle, nullptr)) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    void start() { handle.resume(); }
+    bool done() const { return !handle || handle.done(); }
+
+    bool await_ready() const noexcept { return false; }
+    coroutine_handle<> await_suspend(coroutine_handle<> caller) noexcept
+    {
+        handle.promise().continuation = caller;
+        return handle;
+    }
+    T await_resume() { return handle.promise().take(); }
+};
+
+class SessionIo;
+
+/**
+ * @brief Single-threaded event loop for console sessions.
+ *
+ * Delays are timers, not sleeps: a session awaiting a pause parks itself here
+ * and the loop resumes it when it is due, so other sessions keep running in
+ * the meantime. The loop only blocks when there is nothing else to do: until
+ * the next timer, or on stdin when every session waits for input.
+ */
+class Scheduler
+{
+private:
+    struct Timer
+    {
+        chrono::steady_clock::time_point due;
+        coroutine_handle<> handle;
+        bool operator>(const Timer &other) const { return due > other.due; }
+    };
+
+    priority_queue<Timer, vector<Timer>, greater<Timer>> timers;
+    vector<SessionIo *> readers; // Sessions waiting for a console line, in arrival order
+    vector<Task<>> tasks;
+
+public:
+    void spawn(Task<> task) { tasks.push_back(move(task)); }
+    void sleepFor(coroutine_handle<> handle, int delayMs)
+    {
+        timers.push({chrono::steady_clock::now() + chrono::milliseconds(delayMs), handle});
+    }
+    void waitForInput(SessionIo &io) { readers.push_back(&io); }
+
+    void run();
+};
+
+/**
+ * @brief Where a coroutine-driven game writes its screens and reads its
+ * choices: the console through a Scheduler, or a server connection.
+ */
+class SessionIo
+{
+private:
+    ostream *output;
+    Scheduler *scheduler; // Null: pauses complete at once (remote sessions)
+    bool console;         // Redraw battles in place instead of appending them
+    string line;
+    bool hasLine = false;
+    coroutine_handle<> reader;
+    vector<int> *written = nullptr; // Server sessions: the worker's list of connections with output to send
+    int connection = -1;            // This session's entry for that list
+    bool listed = false;
+    int worker = 0;                 // Server sessions: the worker whose event loop drives this one
+    coroutine_handle<> mover;       // Parked in moveTo() until the connection reaches its new worker
+
+public:
+    SessionIo(ostream &out, Scheduler *sched, bool consoleScreen)
+        : output(&out), scheduler(sched), console(consoleScreen) {}
+
+    FrameRenderer frames;
+    deque<string> typedAhead; // Choices sent several to a line, waiting for their prompts
+    bool headerShown = false; // Scrolling sessions: this stage's battle header was sent, so renders send changes
+    string shownWave;         // The wave line as last rendered
+
+    ostream &out()
+    {
+        if (written && !listed)
+        {
+            listed = true;
+            written->push_back(connection);
+        }
+        return *output;
+    }
+    void redirect(ostream &out) { output = &out; }
+    bool isConsole() const { return console; }
+
+    /**
+     * @brief Binds the session to `loop`'s event loop: `fd` goes on `pending`
+     * now, and again the first time the session writes after outputTaken(),
+     * so output written by a co-op party from another member's turn still
+     * reaches this client.
+     */
+    void attach(int loop, int fd, vector<int> &pending)
+    {
+        worker = loop;
+        connection = fd;
+        written = &pending;
+        listed = true;
+        pending.push_back(fd);
+    }
+    void outputTaken() { listed = false; }
+
+    // The session waits in moveTo() for its connection to be handed to another worker
+    bool moving() const { return (bool)mover; }
+    // Called by the new worker once it has attached the session
+    void arrived() { exchange(mover, nullptr).resume(); }
+
+    // Forgets the coroutine waiting for a line; it was destroyed without getting one
+    void cancelRead() { reader = nullptr; }
+    // Drops input that arrived while nothing was asking for it
+    void discardInput()
+    {
+        hasLine = false;
+        typedAhead.clear();
+    }
+
+    /** @brief Delivers one line of input, resuming the session if it was waiting for one. */
+    void pushLine(string text)
+    {
+        line = move(text);
+        hasLine = true;
+        if (reader)
+            exchange(reader, nullptr).resume();
+    }
+
+    struct LineAwaiter
+    {
+        SessionIo &io;
+        uint64_t waitStart = 0; // Charged to input_wait on resume, when the session had to wait
+        bool await_ready() const { return io.hasLine; }
+        void await_suspend(coroutine_handle<> handle)
+        {
+            waitStart = phaseClock();
+            io.out() << flush;
+            io.reader = handle;
+            if (io.scheduler)
+                io.scheduler->waitForInput(io);
+        }
+        string await_resume()
+        {
+            recordPhaseSince(Phase::INPUT_WAIT, waitStart);
+            io.hasLine = false;
+            return move(io.line);
+        }
+    };
+
+    struct PauseAwaiter
+    {
+        SessionIo &io;
+        int delayMs;
+        uint64_t waitStart = 0;
+        bool await_ready() const { return !io.scheduler || delayMs <= 0; }
+        void await_suspend(coroutine_handle<> handle)
+        {
+            waitStart = phaseClock();
+            io.out() << flush;
+            io.scheduler->sleepFor(handle, delayMs);
+        }
+        void await_resume() { recordPhaseSince(Phase::SLEEP, waitStart); }
+    };
+
+    struct MoveAwaiter
+    {
+        SessionIo &io;
+        int loop;
+        bool await_ready() const { return io.worker == loop; }
+        void await_suspend(coroutine_handle<> handle) { io.mover = handle; }
+        void await_resume() {}
+    };
+
+    LineAwaiter nextLine() { return {*this}; }
+    PauseAwaiter pause(int delayMs) { return {*this, scaledDelay(delayMs)}; }
+    // Continues on worker `loop`'s thread; the server moves the connection once the session parks here
+    MoveAwaiter moveTo(int loop) { return {*this, loop}; }
+};
+
+void Scheduler::run()
+{
+    for (Task<> &task : tasks)
+        task.start();
+
+    while (any_of(tasks.begin(), tasks.end(), [](const Task<> &task) { return !task.done(); }))
+    {
+        if (!timers.empty())
+        {
+            Timer next = timers.top();
+            timers.pop();
+            this_thread::sleep_until(next.due);
+            next.handle.resume();
+        }
+        else if (!readers.empty())
+        {
+            string text;
+            if (!readConsoleLine(text))
+                break; // Console closed; abandon the waiting sessions
+            SessionIo *io = readers.front();
+            readers.erase(readers.begin());
+            io->pushLine(move(text));
+        }
+        else
+        {
+            break; // Every remaining task waits on something this loop does not drive
+        }
+    }
+}
+
+/**
+ * @brief Prompts until the session sends a number in [minChoice, maxChoice].
+ */
+Task<int> askChoice(SessionIo &io, int minChoice, int maxChoice, string prompt = "Enter your choice: ")
+{
+    io.out() << prompt;
+    while (true)
+    {
+        string text;
+        if (io.typedAhead.empty())
+        {
+            queueChoices(io.typedAhead, co_await io.nextLine());
+            if (io.typedAhead.empty())
+                continue; // A blank line; keep waiting
+        }
+        else
+        {
+            io.out() << io.typedAhead.front() << "\n"; // Answered from the queue, so show what was picked
+        }
+        text = move(io.typedAhead.front());
+        io.typedAhead.pop_front();
+
+        int choice;
+        if (parseChoice(text, minChoice, maxChoice, choice))
+            co_return choice;
+
+        io.typedAhead.clear();
+        io.out() << "Invalid input! Please enter a number between " << minChoice << " and " << maxChoice << ".\n"
+                 << prompt;
+    }
+}
+
+/**
+ * @brief Answers the game functions with choices a coroutine already
+ * collected, so they never block on input.
+ */
+class ReplyPolicy : public PlayerPolicy
+{
+public:
+    int coin = 1;
+    int action = 4;
+    int skill = 0;
+    int potion = 0;
+    int upgrade = 1;
+    int item = 1;
+    int target = 1;
+    vector<uint8_t> *recording = nullptr; // When set, every answer actually asked for is appended
+
+    int chooseCoin() override { return note(coin); }
+    int chooseAction(const Unit &, const Unit &) override { return note(action); }
+    int chooseSkill(const Unit &, const Unit &) override { return note(skill); }
+    int choosePotion(const Unit &) override { return note(potion); }
+    int chooseUpgrade(const Unit &) override { return note(upgrade); }
+    int chooseItem(const Unit &, const LootRoll &) override { return note(item); }
+    int chooseTarget(const Unit &, const Unit &, const EnemyPool &) override { return note(target); }
+
+private:
+    int note(int choice)
+    {
+        if (recording)
+            recording->push_back((uint8_t)choice);
+        return choice;
+    }
+};
+
+/**
+ * @brief Shows the header and everything logged since the last render.
+ *
+ * The console repaints only what changed on screen. Scrolling sessions
+ * get the full header once per stage; after that just the stats that
+ * changed and the new events, which keeps remote turns to a few lines.
+ */
+void renderBattle(SessionIo &io, int stage, Unit *player, Unit *boss, const EnemyPool &wave)
+{
+    PhaseTimer timer(Phase::RENDER);
+    ostringstream waveLine;
+    displayWave(wave, waveLine);
+    if (io.isConsole())
+    {
+        ostringstream frame;
+        displayBattleHeader(stage, player, boss, wave, frame);
+        player->displayBattleLog(frame);
+        io.frames.present(frame.str(), io.out());
+    }
+    else if (!io.headerShown)
+    {
+        io.out() << "\n";
+        displayBattleHeader(stage, player, boss, wave, io.out());
+        player->displayBattleLog(io.out());
+        io.headerShown = true;
+    }
+    else
+    {
+        io.out() << "\n";
+        for (Unit *unit : {player, boss})
+        {
+            if (uint8_t fields = unit->changedFields())
+                unit->displayStatus(io.out(), fields);
+        }
+        if (waveLine.str() != io.shownWave)
+            io.out() << (wave.standing() ? waveLine.str() : "Wave - cleared\n");
+        player->displayBattleLog(io.out(), false);
+    }
+    io.shownWave = waveLine.str();
+    player->markShown();
+    boss->markShown();
+    player->clearBattleLog();
+    boss->clearBattleLog();
+}
+
+/*
+ * The phases below drive a headless GameContext: the rule functions stay
+ * silent and never sleep, and the coroutines print to the session instead
+ * and await their delays.
+ */
+Task<bool> coinFlipPhase(SessionIo &io, GameContext &ctx, ReplyPolicy &replies)
+{
+    io.out() << "\n=== COIN FLIP TO DETERMINE TURN ORDER ===\n"
+             << "Choose: 1. Heads  2. Tails\n";
+    replies.coin = co_await askChoice(io, 1, 2, "Your choice: ");
+
+    bool playerWon = coinFlip(replies, ctx);
+    bool heads = (replies.coin == 1) == playerWon;
+
+    io.out() << "\nFlipping coin...\n";
+    co_await io.pause(1000);
+    io.out() << "Result: " << (heads ? "Heads" : "Tails") << "!\n";
+    if (playerWon)
+        io.out() << "\033[1;32mYou won the coin flip! You go first!\033[0m\n";
+    else
+        io.out() << "\033[1;31mYou lost the coin flip! Enemy goes first!\033[0m\n";
+    co_await io.pause(2000);
+    co_return playerWon;
+}
+
+// Asks for an unstunned player's decisions for one turn (action, then skill, potion or target) into `replies`
+Task<> askTurn(SessionIo &io, ReplyPolicy &replies, Unit *player, Unit *boss, EnemyPool &wave)
+{
+    io.out() << "\n=== YOUR TURN ===\n1. Attack\n2. Use Skills\n3. Inventory\n4. Pass\n";
+    replies.action = co_await askChoice(io, 1, 4, "Choose action: ");
+    replies.potion = 0;
+
+    if (replies.action == 2)
+    {
+        io.out() << "\n=== SKILLS MENU ===\n";
+        for (int i = 1; i <= SKILLS_PER_UNIT; i++)
+            io.out() << i << ". " << player->getSkill(i).name << " (Cost: " << player->getSkillCost(i) << " MP)\n";
+        replies.skill = co_await askChoice(io, 1, SKILLS_PER_UNIT, "Choose skill (1-3): ");
+    }
+    else if (replies.action == 3)
+    {
+        const pmr::vector<ItemId> &equipment = player->getEquipment();
+        const pmr::vector<ItemId> &potions = player->getPotions();
+        io.out() << "\n=== INVENTORY ===\n";
+        if (equipment.empty() && potions.empty())
+            io.out() << "Inventory is empty.\n";
+        if (!equipment.empty())
+        {
+            io.out() << "Equipment:\n";
+            for (ItemId item : equipment)
+            {
+                io.out() << "- ";
+                displayItemInfo(item, io.out());
+            }
+        }
+
+        if (potions.empty())
+        {
+            io.out() << "\nPress Enter to continue...";
+            if (io.typedAhead.empty())
+                co_await io.nextLine();
+        }
+        else
+        {
+            io.out() << "\nPotions:\n";
+            for (size_t i = 0; i < potions.size(); i++)
+            {
+                io.out() << i + 1 << ". ";
+                displayPotionInfo(potions[i], io.out());
+            }
+            io.out() << "\n";
+            replies.potion = co_await askChoice(io, 0, potions.size(), "Enter potion number to use (0 to cancel): ");
+        }
+    }
+    else if (replies.action == 4)
+    {
+        io.out() << "You pass your turn.\n";
+    }
+
+    if (needsTarget(*player, replies.action, replies.skill, wave))
+    {
+        showTargetMenu(*player, *boss, wave, io.out());
+        replies.target = co_await askChoice(io, 1, 3, "Choose target: ");
+    }
+}
+
+/**
+ * @brief Collects the player's decisions for one turn, then resolves it.
+ * @return true if the player drank a potion, which ends the whole round.
+ */
+Task<bool> playerPhase(SessionIo &io, GameContext &ctx, ReplyPolicy &replies, Unit *player, Unit *boss,
+                       EnemyPool &wave, bool echoStun)
+{
+    if (player->hasStatus(StatusEffect::STUN))
+    {
+        if (echoStun)
+            io.out() << "\033[1;35mYou are stunned and skip your turn!\033[0m\n";
+        playerTurn(player, boss, wave, replies, ctx, echoStun);
+        player->processStatusEffects();
+        co_return false;
+    }
+
+    co_await askTurn(io, replies, player, boss, wave);
+    bool usedPotion = playerTurn(player, boss, wave, replies, ctx, echoStun);
+    player->processStatusEffects();
+    co_return usedPotion;
+}
+
+Task<> bossPhase(SessionIo &io, GameContext &ctx, BossUnit *boss, Unit *player)
+{
+    io.out() << "\n=== " << boss->getName() << "'s TURN ===\n";
+    co_await io.pause(800);
+    bossTurn(boss, player, ctx);
+    boss->processStatusEffects();
+}
+
+Task<> wavePhase(SessionIo &io, GameContext &ctx, EnemyPool &wave, Unit *player)
+{
+    io.out() << "\n=== THE WAVE's TURN ===\n";
+    co_await io.pause(800);
+    waveTurn(wave, player, ctx);
+}
+
+Task<> askUpgrade(SessionIo &io, ReplyPolicy &replies)
+{
+    io.out() << "\n=== STAGE COMPLETE! CHOOSE UPGRADE ===\n"
+             << "1. Heal (+30 HP)\n"
+             << "2. Restore Mana (+20 MP)\n"
+             << "3. Increase Attack (+5 ATK)\n"
+             << "4. Increase Defense (+3 DEF)\n";
+    replies.upgrade = co_await askChoice(io, 1, 4, "Choose (1-4): ");
+}
+
+Task<> askItem(SessionIo &io, ReplyPolicy &replies, const LootRoll &itemChoices)
+{
+    io.out() << "\n=== ITEM SELECTION ===\n"
+             << "Choose 1 item from the following 3 options:\n";
+    for (int i = 0; i < itemChoices.size(); i++)
+    {
+        io.out() << (i + 1) << ". ";
+        displayItemInfo(itemChoices[i], io.out());
+    }
+    replies.item = co_await askChoice(io, 1, itemChoices.size(),
+                                      "Choose item (1-" + to_string(itemChoices.size()) + "): ");
+}
+
+Task<> rewardPhase(SessionIo &io, GameContext &ctx, ReplyPolicy &replies, Unit *player)
+{
+    co_await askUpgrade(io, replies);
+    applyUpgrade(player, replies.chooseUpgrade(*player));
+
+    // The loot is rolled only after the upgrade, as in gameLoop, so the random draws stay in step
+    LootRoll itemChoices = generateRandomItems(ctx.rng);
+    co_await askItem(io, replies, itemChoices);
+    player->addItem(itemChoices[replies.chooseItem(*player, itemChoices) - 1]);
+    co_await io.pause(2000);
+}
+
+/**
+ * @brief The run of gameLoop (five stages, or endless) as a coroutine: same
+ * rules and random draws, but input and delays are awaited instead of blocking.
+ * @param ctx Headless context whose arena owns `player`
+ * @param recording If set, collects every decision so the run can be replayed
+ */
+Task<GameResult> playRun(SessionIo &io, GameContext &ctx, Unit *player, Replay *recording = nullptr)
+{
+    GameResult result;
+    ReplyPolicy replies;
+    if (recording)
+        replies.recording = &recording->choices;
+    player->getBattleLog().setEnabled(ctx.battleLog);
+    BossUnit *boss = nullptr;
+    EnemyPool wave(ctx.arena.resource());
+
+    for (int stage = ctx.firstStage; ctx.endless || stage <= 5; ++stage)
+    {
+        result.stageReached = stage;
+        boss = spawnBoss(stage, ctx, boss);
+        wave.spawn(ctx.waveSize, stage);
+
+        io.out() << "\n--- ENEMY APPEARED ---\n";
+        io.headerShown = false;
+        boss->displayStatus(io.out());
+        if (!wave.empty())
+            io.out() << "...leading a wave of " << wave.size() << " minions!\n";
+
+        bool playerFirst = co_await coinFlipPhase(io, ctx, replies);
+
+        TurnScheduler turns(player, playerFirst);
+        turns.addEnemy(boss);
+        if (!wave.empty())
+            turns.setWave(&wave);
+        while (turns.beginRound())
+        {
+            ++result.turns;
+            // Turbo mode draws each round once, after the boss has acted
+            if (turns.playerLeads() || delayPercent == 100)
+                renderBattle(io, stage, player, boss, wave);
+
+            for (int actor; (actor = turns.nextActor()) != TurnScheduler::ROUND_OVER;)
+            {
+                if (actor == TurnScheduler::WAVE)
+                {
+                    co_await wavePhase(io, ctx, wave, player);
+                    continue;
+                }
+                if (actor != TurnScheduler::PLAYER)
+                {
+                    co_await bossPhase(io, ctx, turns.enemy(actor), player);
+                    continue;
+                }
+
+                if (turns.othersActed())
+                    renderBattle(io, stage, player, boss, wave);
+                if (co_await playerPhase(io, ctx, replies, player, boss, wave, turns.othersActed()))
+                    turns.endRound();
+            }
+
+            co_await io.pause(1000);
+        }
+
+        if (!player->isAlive())
+        {
+            renderBattle(io, stage, player, boss, wave);
+            io.out() << "\n\033[1;31mYou were defeated in stage " << stage << "!\033[0m\n";
+            co_return result;
+        }
+
+        renderBattle(io, stage, player, boss, wave);
+        io.out() << "\n\033[1;32mYou defeated " << boss->getName() << (ctx.waveSize > 0 ? " and the wave" : "")
+                 << "!\033[0m\n";
+        PhaseTimer reward(Phase::REWARD); // Through the end of the stage, suspensions included
+        dropPotions(player, ctx.rng);
+
+        if (ctx.endless || stage < 5)
+        {
+            co_await rewardPhase(io, ctx, replies, player);
+            autosave(*player, stage + 1, ctx);
+        }
+    }
+
+    result.won = true;
+    io.out() << "\n\033[1;32m=== CONGRATULATIONS! ===\033[0m\n"
+             << "\033[1;33mYou defeated all bosses and conquered the dungeon!\033[0m\n"
+             << "\n=== FINAL STATUS ===\n";
+    player->displayStatus(io.out());
+    co_return result;
+}
+
+// Top-level console task: one run on the local terminal, recorded into `replay` unless it is endless
+Task<> playConsoleRun(SessionIo &io, GameContext &ctx, Unit *player, Replay &replay)
+{
+    GameResult result = co_await playRun(io, ctx, player, ctx.endless ? nullptr : &replay);
+    if (!ctx.endless)
+        replay.finish(result, *player);
+}
+
+// ========== Leaderboard ==========
+constexpr int LEADERBOARD_SIZE = 20;             // Runs kept on the board
+constexpr int LEADERBOARD_STAGES = 10;           // Stage histogram buckets; the last one counts every deeper stage
+constexpr int LEADERBOARD_TURN_BUCKETS = 16;     // Turn histogram buckets: 0-1, 2-3, 4-7, ... 2^15 and up
+constexpr int LEADERBOARD_SNAPSHOT_SECONDS = 10; // How often --serve rewrites the --leaderboard file
+
+/** @brief One finished run: what it reached and the hero's final stats, as displayStatus shows them. */
+struct RunRecord
+{
+    uint64_t seed;
+    uint8_t classChoice; // 1 = Warrior, 2 = Archer, 3 = Mage
+    uint8_t won;
+    uint16_t stageReached;
+    int32_t turns;
+    int16_t health, maxHealth, mana, maxMana, attack, defense;
+
+    // Wins first, then deeper stages, then fewer turns, then more HP left
+    uint64_t score() const
+    {
+        return (uint64_t)won << 63 | (uint64_t)stageReached << 47 | (uint64_t)(0xFFFFF - min(turns, 0xFFFFF)) << 27 |
+               (uint64_t)max(0, (int)health);
+    }
+
+    static RunRecord of(const GameResult &result, const Unit &hero, int classChoice, uint64_t seed)
+    {
+        auto clip = [](int value) { return (int16_t)clamp(value, 0, INT16_MAX); };
+        return {seed, (uint8_t)classChoice, result.won, (uint16_t)min(result.stageReached, UINT16_MAX), result.turns,
+                clip(hero.getHealth()), clip(hero.getMaxHealth()), clip(hero.getMana()), clip(hero.getMaxMana()),
+                clip(hero.getAttack()), clip(hero.getDefense())};
+    }
+};
+static_assert(is_trivially_copyable_v<RunRecord> && sizeof(RunRecord) == 32, "RunRecord must fill four words");
+
+/**
+ * @brief Best runs and run histograms across every server worker.
+ *
+ * Each thread that reports gets its own cache-line-aligned shard, so a
+ * report never touches memory another reporter writes: the histograms are
+ * single-writer counters (relaxed load and store), and the shard's top
+ * runs are only rewritten when a run beats the shard's worst one, under a
+ * per-shard sequence counter that snapshot readers retry on. Reporting
+ * never blocks, whatever the number of sessions; only a thread's first
+ * report takes the registry lock, to add its shard.
+ */
+class Leaderboard
+{
+private:
+    struct alignas(64) Shard
+    {
+        atomic<uint32_t> sequence{0}; // Odd while the owner rewrites `top`
+        atomic<uint64_t> top[LEADERBOARD_SIZE][sizeof(RunRecord) / 8];
+        int kept = 0;              // Entries of `top` in use, best first; owner only
+        uint64_t worstScore = 0;   // Score of top[kept - 1]; owner only
+        atomic<uint64_t> runs[4];  // By class, 0 unused
+        atomic<uint64_t> wins[4];
+        atomic<uint64_t> stages[4][LEADERBOARD_STAGES];
+        atomic<uint64_t> turns[4][LEADERBOARD_TURN_BUCKETS];
+        atomic<int> published{0};  // Entries of `top` a reader may copy
+
+        static void bump(atomic<uint64_t> &counter, uint64_t by = 1)
+        {
+            counter.store(counter.load(memory_order_relaxed) + by, memory_order_relaxed);
+        }
+
+        void store(int slot, const RunRecord &record)
+        {
+            uint64_t words[sizeof(RunRecord) / 8];
+            memcpy(words, &record, sizeof(record));
+            for (size_t w = 0; w < size(words); w++)
+                top[slot][w].store(words[w], memory_order_relaxed);
+        }
+
+        RunRecord load(int slot) const
+        {
+            uint64_t words[sizeof(RunRecord) / 8];
+            for (size_t w = 0; w < size(words); w++)
+                words[w] = top[slot][w].load(memory_order_relaxed);
+            RunRecord record;
+            memcpy(&record, words, sizeof(record));
+            return record;
+        }
+
+        void offer(const RunRecord &record)
+        {
+            uint64_t score = record.score();
+            if (kept == LEADERBOARD_SIZE && score <= worstScore)
+                return; // The common case: not a top run, nothing to publish
+
+            int slot = min(kept, LEADERBOARD_SIZE - 1);
+            while (slot > 0 && load(slot - 1).score() < score)
+                slot--;
+
+            uint32_t begin = sequence.load(memory_order_relaxed);
+            sequence.store(begin + 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
+            for (int i = min(kept, LEADERBOARD_SIZE - 1); i > slot; i--)
+                store(i, load(i - 1));
+            store(slot, record);
+            kept = min(kept + 1, LEADERBOARD_SIZE);
+            published.store(kept, memory_order_relaxed);
+            sequence.store(begin + 2, memory_order_release);
+            worstScore = load(kept - 1).score();
+        }
+
+        // Copies the top runs consistently, retrying while the owner is mid-update
+        vector<RunRecord> copyTop() const
+        {
+            vector<RunRecord> copy;
+            while (true)
+            {
+                uint32_t begin = sequence.load(memory_order_acquire);
+                if (begin & 1)
+                    continue;
+                copy.clear();
+                int count = published.load(memory_order_relaxed);
+                for (int i = 0; i < count; i++)
+                    copy.push_back(load(i));
+                atomic_thread_fence(memory_order_acquire);
+                if (sequence.load(memory_order_relaxed) == begin)
+                    return copy;
+            }
+        }
+    };
+
+    mutable mutex registryLock; // Taken when a thread first reports and by snapshots, never per report
+    vector<unique_ptr<Shard>> shards;
+
+    Shard &localShard()
+    {
+        thread_local const Leaderboard *owner = nullptr;
+        thread_local Shard *mine = nullptr;
+        if (owner != this)
+        {
+            lock_guard<mutex> guard(registryLock);
+            shards.push_back(make_unique<Shard>());
+            mine = shards.back().get();
+            owner = this;
+        }
+        return *mine;
+    }
+
+    static int turnBucket(int turns)
+    {
+        int bucket = 0;
+        while (bucket < LEADERBOARD_TURN_BUCKETS - 1 && turns >> (bucket + 1))
+            bucket++;
+        return bucket;
+    }
+
+public:
+    /** @brief Adds a finished run; safe from any number of threads at once. */
+    void report(const RunRecord &record)
+    {
+        Shard &shard = localShard();
+        int c = clamp((int)record.classChoice, 1, 3);
+        Shard::bump(shard.runs[c]);
+        Shard::bump(shard.wins[c], record.won);
+        Shard::bump(shard.stages[c][clamp((int)record.stageReached, 1, LEADERBOARD_STAGES) - 1]);
+        Shard::bump(shard.turns[c][turnBucket(record.turns)]);
+        shard.offer(record);
+    }
+
+    /** @brief Everything reported so far, merged over the shards. */
+    struct Snapshot
+    {
+        uint64_t runs[4] = {};
+        uint64_t wins[4] = {};
+        uint64_t stages[4][LEADERBOARD_STAGES] = {};
+        uint64_t turns[4][LEADERBOARD_TURN_BUCKETS] = {};
+        vector<RunRecord> top; // Best first, at most LEADERBOARD_SIZE
+    };
+
+    Snapshot snapshot() const
+    {
+        Snapshot total;
+        lock_guard<mutex> guard(registryLock);
+        for (const unique_ptr<Shard> &shard : shards)
+        {
+            for (int c = 1; c <= 3; c++)
+            {
+                total.runs[c] += shard->runs[c].load(memory_order_relaxed);
+                total.wins[c] += shard->wins[c].load(memory_order_relaxed);
+                for (int s = 0; s < LEADERBOARD_STAGES; s++)
+                    total.stages[c][s] += shard->stages[c][s].load(memory_order_relaxed);
+                for (int t = 0; t < LEADERBOARD_TURN_BUCKETS; t++)
+                    total.turns[c][t] += shard->turns[c][t].load(memory_order_relaxed);
+            }
+            vector<RunRecord> best = shard->copyTop();
+            total.top.insert(total.top.end(), best.begin(), best.end());
+        }
+        stable_sort(total.top.begin(), total.top.end(),
+                    [](const RunRecord &a, const RunRecord &b) { return a.score() > b.score(); });
+        if (total.top.size() > LEADERBOARD_SIZE)
+            total.top.resize(LEADERBOARD_SIZE);
+        return total;
+    }
+
+    /**
+     * @brief Puts a snapshot written by save() back, as if its runs had
+     * just been reported. Call before the workers start.
+     * @return false if the file exists but is not a leaderboard
+     */
+    bool restore(const string &path)
+    {
+        ifstream file(path);
+        if (!file)
+            return true; // Nothing saved yet
+        string word;
+        int version = 0;
+        if (!(file >> word >> version) || word != "whg-leaderboard" || version != 1)
+            return false;
+
+        Shard &shard = localShard();
+        while (file >> word)
+        {
+            int c = 0;
+            if (word[0] == '#')
+            {
+                getline(file, word);
+                continue;
+            }
+            if (word == "top")
+            {
+                RunRecord record;
+                int classChoice, won, stage, health, maxHealth, mana, maxMana, attack, defense;
+                if (!(file >> classChoice >> won >> stage >> record.turns >> health >> maxHealth >> mana >> maxMana >>
+                      attack >> defense >> record.seed))
+                    return false;
+                record.classChoice = (uint8_t)clamp(classChoice, 1, 3);
+                record.won = won != 0;
+                record.stageReached = (uint16_t)clamp(stage, 0, UINT16_MAX);
+                int16_t *stats[6] = {&record.health, &record.maxHealth, &record.mana, &record.maxMana, &record.attack,
+                                     &record.defense};
+                int values[6] = {health, maxHealth, mana, maxMana, attack, defense};
+                for (int i = 0; i < 6; i++)
+                    *stats[i] = (int16_t)clamp(values[i], 0, INT16_MAX);
+                shard.offer(record);
+            }
+            else if (word == "class" && file >> c && c >= 1 && c <= 3)
+            {
+                uint64_t runs, wins, count;
+                string label;
+                if (!(file >> label >> runs >> label >> wins >> label))
+                    return false;
+                Shard::bump(shard.runs[c], runs);
+                Shard::bump(shard.wins[c], wins);
+                for (int s = 0; s < LEADERBOARD_STAGES && file >> count; s++)
+                    Shard::bump(shard.stages[c][s], count);
+                file >> label;
+                for (int t = 0; t < LEADERBOARD_TURN_BUCKETS && file >> count; t++)
+                    Shard::bump(shard.turns[c][t], count);
+                if (!file)
+                    return false;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Writes a snapshot as text, replacing the file atomically so a
+     * crash mid-write keeps the previous one.
+     */
+    bool save(const string &path) const
+    {
+        Snapshot board = snapshot();
+        string temporary = path + ".tmp";
+        {
+            ofstream file(temporary, ios::trunc);
+            file << "whg-leaderboard 1\n"
+                 << "# class <1-3> runs <n> wins <n> stages <deaths or wins by stage 1.." << LEADERBOARD_STAGES
+                 << "+> turns <runs by turns 0-1, 2-3, 4-7, ...>\n";
+            for (int c = 1; c <= 3; c++)
+            {
+                file << "class " << c << " runs " << board.runs[c] << " wins " << board.wins[c] << " stages";
+                for (uint64_t count : board.stages[c])
+                    file << " " << count;
+                file << " turns";
+                for (uint64_t count : board.turns[c])
+                    file << " " << count;
+                file << "\n";
+            }
+            file << "# top <class> <won> <stage> <turns> <hp> <max hp> <mp> <max mp> <attack> <defense> <seed>\n";
+            for (const RunRecord &run : board.top)
+                file << "top " << (int)run.classChoice << " " << (int)run.won << " " << run.stageReached << " "
+                     << run.turns << " " << run.health << " " << run.maxHealth << " " << run.mana << " "
+                     << run.maxMana << " " << run.attack << " " << run.defense << " " << run.seed << "\n";
+            if (!file)
+                return false;
+        }
+        return rename(temporary.c_str(), path.c_str()) == 0;
+    }
+};
+
+// ========== Co-op Parties ==========
+constexpr int PARTY_MIN = 2;
+constexpr int PARTY_MAX = 4;
+constexpr int PARTY_TURN_SECONDS = 30;   // How long a party waits for its members' choices before auto-playing the rest
+constexpr int PARTY_WAVE_PER_MEMBER = 2; // Minions each member adds to every stage's wave
+constexpr int PARTY_WORKER = 0;          // The server worker whose event loop runs the lobby and every party
+
+class PartyTicket;
+
+/**
+ * @brief One member of a party: their session while it lasts, their hero
+ * and the choices collected for the next resolution.
+ */
+struct PartySeat
+{
+    PartyTicket *ticket; // Null once the player has left; AutoPolicy plays the hero from then on
+    SessionIo *io;       // Null together with `ticket`
+    int classChoice;
+    Unit *hero = nullptr;
+    ReplyPolicy replies;
+    optional<Task<>> decision; // Prompts for this seat's choices while the party waits
+    bool ready = false;        // `replies` holds this round's choices (or none are needed)
+    string pendingLog;         // Log lines worded for this member, waiting for the next render
+
+    PartySeat(PartyTicket *member, SessionIo *session, int heroClass)
+        : ticket(member), io(session), classChoice(heroClass) {}
+};
+
+/**
+ * @brief A co-op run: 2-4 heroes against every stage's boss and a wave.
+ *
+ * Each round every member chooses at once, each through a prompt coroutine
+ * of their own; the run waits until all have answered or the turn window
+ * closes, then resolves the choices in seat order, so the outcome depends
+ * only on the seed and the choices, never on who answered first. A party
+ * and all its members belong to one server worker: the shared battle is
+ * only ever touched by that thread and needs no locks.
+ */
+class Party
+{
+public:
+    int size;                    // Seats to fill before the run starts
+    vector<PartyTicket *> lobby; // Members waiting for the party to fill, in joining order
+    vector<PartySeat> seats;     // One per member once the run starts
+    uint64_t seed;
+    bool endless;
+    Leaderboard *board;
+    GameContext ctx;
+    optional<Task<>> run;
+    coroutine_handle<> waiting; // The run, parked until the members have chosen
+    chrono::steady_clock::time_point deadline;
+
+    Party(int members, uint64_t runSeed, bool endlessRun, Leaderboard *results)
+        : size(members), seed(runSeed), endless(endlessRun), board(results) {}
+
+    bool full() const { return (int)lobby.size() == size; }
+
+    int connected() const
+    {
+        return count_if(seats.begin(), seats.end(), [](const PartySeat &seat) { return seat.io != nullptr; });
+    }
+
+    int standing() const
+    {
+        return count_if(seats.begin(), seats.end(), [](const PartySeat &seat) { return seat.hero->isAlive(); });
+    }
+
+    // Nobody left to wait for: every member has chosen or is gone and will get AutoPolicy's choice
+    bool everyoneReady() const
+    {
+        return all_of(seats.begin(), seats.end(), [](const PartySeat &seat) { return seat.ready || !seat.io; });
+    }
+
+    // Writes `text` to every member still connected
+    void tell(const string &text)
+    {
+        for (PartySeat &seat : seats)
+        {
+            if (seat.io)
+                seat.io->out() << text;
+        }
+    }
+
+    struct ChoiceWindow
+    {
+        Party &party;
+        bool await_ready() const { return party.everyoneReady(); }
+        void await_suspend(coroutine_handle<> handle) { party.waiting = handle; }
+        void await_resume() {}
+    };
+
+    // Resumes the run once every seat is ready, or PARTY_TURN_SECONDS from now (PartyHall::poll decides)
+    ChoiceWindow allChosen()
+    {
+        deadline = chrono::steady_clock::now() + chrono::seconds(PARTY_TURN_SECONDS);
+        return {*this};
+    }
+};
+
+/**
+ * @brief The server's lobby and running parties, touched only by
+ * PARTY_WORKER: sessions move to that worker before they join through a
+ * PartyTicket, and it calls poll() after every batch of events.
+ */
+class PartyHall
+{
+private:
+    uint64_t seed;
+    bool endless;
+    Leaderboard *board;
+    long long formed = 0;
+    unique_ptr<Party> forming[PARTY_MAX + 1]; // The party filling up, by size
+    vector<unique_ptr<Party>> active;
+
+    void start(Party &party);
+    void tellLobby(Party &party, const string &text);
+
+public:
+    PartyHall(uint64_t hallSeed, bool endlessRuns, Leaderboard *results)
+        : seed(hallSeed), endless(endlessRuns), board(results) {}
+
+    void join(PartyTicket &ticket);
+    void leave(PartyTicket &ticket);
+
+    /**
+     * @brief Resumes runs whose members have all chosen or whose window has
+     * closed, then sends the members of finished runs back to their menus.
+     */
+    void poll(chrono::steady_clock::time_point now);
+
+    // Milliseconds until the next choice window closes, or -1 if none is open
+    int msUntilDeadline(chrono::steady_clock::time_point now) const
+    {
+        int wait = -1;
+        for (const unique_ptr<Party> &party : active)
+        {
+            if (!party->waiting)
+                continue;
+            auto left = chrono::duration_cast<chrono::milliseconds>(party->deadline - now).count();
+            int ms = (int)max<long long>(0, left + 1);
+            wait = wait < 0 ? ms : min(wait, ms);
+        }
+        return wait;
+    }
+};
+
+/**
+ * @brief A session's place in a party, awaited until the party's run is
+ * over. Destroying it (its player disconnected) leaves the lobby, or hands
+ * the hero to AutoPolicy if the run has started.
+ */
+class PartyTicket
+{
+public:
+    PartyHall &hall;
+    SessionIo &io;
+    int size;
+    int classChoice;
+    Party *party = nullptr; // Null before joining and once the run is over
+    int seat = -1;
+    coroutine_handle<> member;
+
+    PartyTicket(PartyHall &h, SessionIo &session, int members, int heroClass)
+        : hall(h), io(session), size(members), classChoice(heroClass) {}
+    PartyTicket(const PartyTicket &) = delete;
+    PartyTicket &operator=(const PartyTicket &) = delete;
+    ~PartyTicket() { hall.leave(*this); }
+
+    bool await_ready() const { return false; }
+    void await_suspend(coroutine_handle<> handle)
+    {
+        member = handle;
+        hall.join(*this);
+    }
+    void await_resume() {}
+};
+
+// Fills `seat.replies` with what AutoPolicy would do, for members who did not choose in time or have left
+void autoChooseTurn(PartySeat &seat, const Unit &boss, const EnemyPool &wave)
+{
+    AutoPolicy autopilot;
+    seat.replies.action = autopilot.chooseAction(*seat.hero, boss);
+    seat.replies.skill = autopilot.chooseSkill(*seat.hero, boss);
+    seat.replies.potion = autopilot.choosePotion(*seat.hero);
+    seat.replies.target = autopilot.chooseTarget(*seat.hero, boss, wave);
+}
+
+Task<> chooseTurn(PartySeat &seat, Unit *boss, EnemyPool &wave)
+{
+    co_await askTurn(*seat.io, seat.replies, seat.hero, boss, wave);
+    seat.ready = true;
+    seat.io->out() << "Waiting for the rest of the party...\n";
+}
+
+Task<> chooseReward(PartySeat &seat, const LootRoll &loot)
+{
+    co_await askUpgrade(*seat.io, seat.replies);
+    co_await askItem(*seat.io, seat.replies, loot);
+    seat.ready = true;
+    seat.io->out() << "Waiting for the rest of the party...\n";
+}
+
+/**
+ * @brief Starts a prompt for every seat that `needsChoice` and waits for
+ * them; seats still unanswered when the window closes get `fallback`.
+ */
+template <typename Needs, typename Prompt, typename Fallback>
+Task<> collectChoices(Party &party, Needs needsChoice, Prompt prompt, Fallback fallback)
+{
+    for (PartySeat &seat : party.seats)
+    {
+        seat.ready = !needsChoice(seat);
+        if (!seat.ready && seat.io)
+        {
+            seat.decision.emplace(prompt(seat));
+            seat.decision->start();
+        }
+    }
+    co_await party.allChosen();
+
+    for (PartySeat &seat : party.seats)
+    {
+        if (seat.ready)
+            continue;
+        if (seat.io)
+        {
+            seat.decision.reset();
+            seat.io->cancelRead();
+            seat.io->discardInput();
+            seat.io->out() << "\n\033[1;33mTime's up! Your hero follows AutoPolicy this time.\033[0m\n";
+        }
+        fallback(seat);
+        seat.ready = true;
+    }
+    for (PartySeat &seat : party.seats)
+        seat.decision.reset();
+}
+
+/**
+ * @brief Moves every hero's new log events into each member's pendingLog,
+ * worded for that member. Each event is logged by the hero it concerns, so
+ * gathering after every actor keeps the lines in the order things happened.
+ */
+void gatherLogs(Party &party)
+{
+    for (PartySeat &viewer : party.seats)
+    {
+        if (!viewer.io)
+            continue;
+        ostringstream lines;
+        for (PartySeat &seat : party.seats)
+            seat.hero->displayBattleLog(lines, false, viewer.hero);
+        viewer.pendingLog += lines.str();
+    }
+    for (PartySeat &seat : party.seats)
+        seat.hero->clearBattleLog();
+}
+
+/**
+ * @brief The party's battle screen for every member: the whole header the
+ * first time in a stage, then only the stats that changed, plus the log
+ * gathered since the last render.
+ */
+void renderParty(Party &party, int stage, BossUnit *boss, const EnemyPool &wave)
+{
+    PhaseTimer timer(Phase::RENDER);
+    gatherLogs(party);
+    ostringstream waveLine;
+    displayWave(wave, waveLine);
+
+    for (PartySeat &viewer : party.seats)
+    {
+        if (!viewer.io)
+            continue;
+        ostream &out = viewer.io->out();
+        out << "\n";
+        if (!viewer.io->headerShown)
+        {
+            out << "========================================\n";
+            out << "| STAGE " << stage << " PARTY BATTLE";
+            out << string(24 - to_string(stage).length(), ' ') << "|\n";
+            out << "========================================\n";
+            out << "\n=== YOUR PARTY ===\n";
+            for (PartySeat &seat : party.seats)
+                seat.hero->displayStatus(out);
+            out << "\n=== ENEMY STATUS ===\n";
+            boss->displayStatus(out);
+            out << waveLine.str() << "\n=== BATTLE LOG ===\n";
+            viewer.io->headerShown = true;
+        }
+        else
+        {
+            for (PartySeat &seat : party.seats)
+            {
+                if (uint8_t fields = seat.hero->changedFields())
+                    seat.hero->displayStatus(out, fields);
+            }
+            if (uint8_t fields = boss->changedFields())
+                boss->displayStatus(out, fields);
+            if (waveLine.str() != viewer.io->shownWave)
+                out << (wave.standing() ? waveLine.str() : "Wave - cleared\n");
+        }
+        out << viewer.pendingLog;
+        viewer.pendingLog.clear();
+        viewer.io->shownWave = waveLine.str();
+    }
+
+    for (PartySeat &seat : party.seats)
+        seat.hero->markShown();
+    boss->markShown();
+    boss->clearBattleLog();
+}
+
+/**
+ * @brief The boss, then the wave, each strike a standing hero drawn from the
+ * run's dice. The wave is compacted afterwards, so minions downed by their
+ * own poison or bleed ticks are gone before anyone is asked for a target.
+ */
+void enemiesAct(Party &party, BossUnit *boss, EnemyPool &wave)
+{
+    auto pickTarget = [&party]() -> Unit *
+    {
+        int pick = party.ctx.rng.below(party.standing());
+        for (PartySeat &seat : party.seats)
+        {
+            if (seat.hero->isAlive() && pick-- == 0)
+                return seat.hero;
+        }
+        return nullptr;
+    };
+
+    if (boss->isAlive() && party.standing() > 0)
+    {
+        bossTurn(boss, pickTarget(), party.ctx);
+        boss->processStatusEffects();
+        gatherLogs(party);
+    }
+    if (wave.standing() > 0 && party.standing() > 0)
+        waveTurn(wave, pickTarget(), party.ctx);
+    wave.compact();
+}
+
+/**
+ * @brief A party's whole run, gameLoop's stages with these differences:
+ * the boss has its health times the party size and a wave of
+ * PARTY_WAVE_PER_MEMBER minions per member; the turn order is one shared
+ * coin flip; a potion only uses up its drinker's turn; a fallen hero sits
+ * out the rest of the run, which ends when the whole party has fallen.
+ */
+Task<> playParty(Party &party)
+{
+    GameContext &ctx = party.ctx;
+    ctx.headless = true;
+    ctx.endless = party.endless;
+    ctx.rng.reseed(party.seed);
+    const int members = (int)party.seats.size();
+
+    for (int i = 0; i < members; i++)
+    {
+        PartySeat &seat = party.seats[i];
+        string name = string(className(seat.classChoice)) + " " + to_string(i + 1);
+        seat.hero = createPlayerOfClass(ctx.arena, seat.classChoice, name);
+        seat.io->discardInput(); // Whatever was typed in the lobby answered nothing
+    }
+    party.tell("\n\033[1;32mThe party is complete! The adventure begins.\033[0m\n");
+
+    GameResult result;
+    BossUnit *boss = nullptr;
+    EnemyPool wave(ctx.arena.resource());
+
+    for (int stage = 1; ctx.endless || stage <= 5; ++stage)
+    {
+        result.stageReached = stage;
+        boss = spawnBoss(stage, ctx, boss);
+        boss->increaseMaxHealth(boss->getMaxHealth() * (members - 1));
+        boss->clearBattleLog();
+        wave.spawn(PARTY_WAVE_PER_MEMBER * members, stage);
+
+        ostringstream intro;
+        intro << "\n--- ENEMY APPEARED ---\n";
+        boss->displayStatus(intro);
+        intro << "...leading a wave of " << wave.size() << " minions!\n";
+        bool partyFirst = ctx.rng.below(2) == 0;
+        intro << (partyFirst ? "\033[1;32mThe party moves first!\033[0m\n" : "\033[1;31mThe enemies move first!\033[0m\n");
+        party.tell(intro.str());
+        for (PartySeat &seat : party.seats)
+        {
+            if (seat.io)
+                seat.io->headerShown = false;
+        }
+
+        auto decided = [&] { return party.standing() == 0 || (!boss->isAlive() && wave.standing() == 0); };
+        while (!decided())
+        {
+            if (party.connected() == 0)
+                co_return; // Everyone left; nobody is watching the heroes
+            ++result.turns;
+            if (!partyFirst)
+                enemiesAct(party, boss, wave);
+            if (decided())
+                break;
+
+            renderParty(party, stage, boss, wave);
+            for (PartySeat &seat : party.seats)
+            {
+                if (seat.io && seat.hero->isAlive() && seat.hero->hasStatus(StatusEffect::STUN))
+                    seat.io->out() << "\033[1;35mYou are stunned and skip your turn!\033[0m\n";
+            }
+            co_await collectChoices(
+                party,
+                [](const PartySeat &seat) { return seat.hero->isAlive() && !seat.hero->hasStatus(StatusEffect::STUN); },
+                [boss, &wave](PartySeat &seat) { return chooseTurn(seat, boss, wave); },
+                [boss, &wave](PartySeat &seat) { autoChooseTurn(seat, *boss, wave); });
+            for (PartySeat &seat : party.seats)
+            {
+                if (!seat.hero->isAlive() || decided())
+                    continue;
+                playerTurn(seat.hero, boss, wave, seat.replies, ctx, false);
+                seat.hero->processStatusEffects();
+                gatherLogs(party);
+            }
+
+            if (partyFirst && !decided())
+                enemiesAct(party, boss, wave);
+        }
+
+        renderParty(party, stage, boss, wave);
+        if (party.standing() == 0)
+        {
+            party.tell("\n\033[1;31mThe party was defeated in stage " + to_string(stage) + "!\033[0m\n");
+            break;
+        }
+        party.tell("\n\033[1;32mThe party defeated " + boss->getName() + " and the wave!\033[0m\n");
+        if (!ctx.endless && stage == 5)
+        {
+            result.won = true;
+            break;
+        }
+
+        // Every draw is made in seat order before anyone is asked, so the order of answers changes nothing
+        LootRoll loot[PARTY_MAX];
+        for (int i = 0; i < members; i++)
+        {
+            if (party.seats[i].hero->isAlive())
+            {
+                dropPotions(party.seats[i].hero, ctx.rng);
+                loot[i] = generateRandomItems(ctx.rng);
+            }
+        }
+        co_await collectChoices(
+            party, [](const PartySeat &seat) { return seat.hero->isAlive(); },
+            [&](PartySeat &seat) { return chooseReward(seat, loot[&seat - party.seats.data()]); },
+            [&](PartySeat &seat)
+            {
+                AutoPolicy autopilot;
+                seat.replies.upgrade = autopilot.chooseUpgrade(*seat.hero);
+                seat.replies.item = autopilot.chooseItem(*seat.hero, loot[&seat - party.seats.data()]);
+            });
+        for (int i = 0; i < members; i++)
+        {
+            PartySeat &seat = party.seats[i];
+            if (!seat.hero->isAlive())
+                continue;
+            applyUpgrade(seat.hero, seat.replies.upgrade);
+            seat.hero->addItem(loot[i][seat.replies.item - 1]);
+        }
+    }
+
+    ostringstream summary;
+    if (result.won)
+        summary << "\n\033[1;32m=== CONGRATULATIONS! ===\033[0m\n"
+                << "\033[1;33mThe party conquered the dungeon!\033[0m\n";
+    summary << "\n=== FINAL PARTY STATUS ===\n";
+    for (PartySeat &seat : party.seats)
+    {
+        seat.hero->displayStatus(summary);
+        if (party.board)
+            party.board->report(RunRecord::of(result, *seat.hero, seat.classChoice, party.seed));
+    }
+    party.tell(summary.str());
+}
+
+void PartyHall::start(Party &party)
+{
+    party.seats.reserve(party.lobby.size()); // Seats are referenced by address from here on
+    for (PartyTicket *ticket : party.lobby)
+        party.seats.emplace_back(ticket, &ticket->io, ticket->classChoice);
+    party.lobby.clear();
+    party.run.emplace(playParty(party));
+    party.run->start();
+}
+
+void PartyHall::tellLobby(Party &party, const string &text)
+{
+    for (PartyTicket *ticket : party.lobby)
+        ticket->io.out() << text;
+}
+
+void PartyHall::join(PartyTicket &ticket)
+{
+    unique_ptr<Party> &party = forming[ticket.size];
+    if (!party)
+        party = make_unique<Party>(ticket.size, mixSeed(seed, formed++), endless, board);
+
+    ticket.party = party.get();
+    ticket.seat = (int)party->lobby.size();
+    party->lobby.push_back(&ticket);
+    tellLobby(*party, "\nPlayer " + to_string(party->lobby.size()) + " joined the party (" +
+                          to_string(party->lobby.size()) + "/" + to_string(party->size) + ")\n");
+    if (!party->full())
+    {
+        ticket.io.out() << "Waiting for " << party->size - party->lobby.size() << " more player(s)...\n";
+        return;
+    }
+
+    active.push_back(move(party));
+    start(*active.back());
+}
+
+void PartyHall::leave(PartyTicket &ticket)
+{
+    if (!ticket.party)
+        return;
+    Party &party = *ticket.party;
+    ticket.party = nullptr;
+
+    if (!party.run)
+    {
+        // Still in the lobby: give up the seat
+        party.lobby.erase(party.lobby.begin() + ticket.seat);
+        for (size_t i = ticket.seat; i < party.lobby.size(); i++)
+            party.lobby[i]->seat = (int)i;
+        if (party.lobby.empty())
+            forming[party.size].reset();
+        else
+            tellLobby(party, "\nA player left the queue (" + to_string(party.lobby.size()) + "/" +
+                                 to_string(party.size) + ")\n");
+        return;
+    }
+
+    PartySeat &seat = party.seats[ticket.seat];
+    seat.decision.reset(); // Its prompt goes with the session
+    seat.ticket = nullptr;
+    seat.io = nullptr;
+    party.tell("\n" + seat.hero->getName() + "'s player disconnected; AutoPolicy takes over the hero.\n");
+}
+
+void PartyHall::poll(chrono::steady_clock::time_point now)
+{
+    for (size_t i = 0; i < active.size(); i++)
+    {
+        Party &party = *active[i];
+        if (party.waiting && (party.everyoneReady() || now >= party.deadline))
+            exchange(party.waiting, nullptr).resume();
+    }
+
+    vector<coroutine_handle<>> released;
+    for (size_t i = 0; i < active.size();)
+    {
+        if (!active[i]->run->done())
+        {
+            ++i;
+            continue;
+        }
+        for (PartySeat &seat : active[i]->seats)
+        {
+            if (seat.ticket)
+            {
+                seat.ticket->party = nullptr;
+                released.push_back(seat.ticket->member);
+            }
+        }
+        active.erase(active.begin() + i);
+    }
+    for (coroutine_handle<> member : released)
+        member.resume();
+}
+
+/**
+ * @brief Opens `parties` party rounds with the enemies moving first against
+ * a wave whose last minions fall to their own status ticks, and checks that
+ * no member is then offered a minion to target.
+ */
+bool verifyPartyWave(uint64_t seed, int parties = 200)
+{
+    Rng rng(seed);
+    long long minions = 0, mismatches = 0;
+
+    for (int p = 0; p < parties; p++)
+    {
+        int members = PARTY_MIN + rng.below(PARTY_MAX - PARTY_MIN + 1);
+        Party party(members, rng.next(), false, nullptr);
+        party.ctx.headless = true;
+        party.ctx.rng.reseed(party.seed);
+        int stage = 1 + rng.below(5);
+
+        deque<ostringstream> screens;
+        deque<SessionIo> sessions;
+        party.seats.reserve(members);
+        for (int i = 0; i < members; i++)
+        {
+            sessions.emplace_back(screens.emplace_back(), nullptr, false);
+            party.seats.emplace_back(nullptr, &sessions.back(), 1 + rng.below(3));
+            party.seats.back().hero = createPlayerOfClass(party.ctx.arena, party.seats.back().classChoice, "Ref");
+        }
+        BossUnit *boss = spawnBoss(stage, party.ctx);
+        EnemyPool wave(party.ctx.arena.resource());
+        wave.spawn(PARTY_WAVE_PER_MEMBER * members, stage);
+        for (int i = 0; i < wave.size(); i++)
+        {
+            FighterState &minion = wave[i].state;
+            if (rng.below(4) == 0)
+            {
+                minion.health = 0; // Fell to a hero last round
+                continue;
+            }
+            minion.health = 1 + rng.below(3);
+            minion.status[(int)(rng.below(2) ? StatusEffect::POISON : StatusEffect::BLEED)] = 1;
+            ++minions;
+        }
+
+        enemiesAct(party, boss, wave);
+        if (!wave.empty())
+            ++mismatches;
+        for (PartySeat &seat : party.seats)
+        {
+            // Attacking with every minion gone needs no target, so the turn is complete without another line
+            seat.io->typedAhead.push_back("1");
+            Task<> turn = askTurn(*seat.io, seat.replies, seat.hero, boss, wave);
+            turn.start();
+            mismatches += !turn.done();
+        }
+        for (ostringstream &screen : screens)
+            mismatches += screen.str().find("CHOOSE TARGET") != string::npos;
+    }
+
+    cout << "Party wave: " << parties << " rounds, " << minions << " minions downed by their own ticks, " << mismatches
+         << " mismatches\n";
+    return mismatches == 0;
+}
+
+// ========== Session Server ==========
+/**
+ * @brief A remote player's whole visit: main menu, class select, then runs
+ * until they quit. Each run gets its own GameContext, freed when it ends.
+ * @param board If set, every finished run is reported to it
+ * @param hall If set, the menu also offers co-op parties formed in it
+ */
+Task<> runSession(SessionIo &io, uint64_t seed, bool endless, Leaderboard *board = nullptr, PartyHall *hall = nullptr)
+{
+    long long runs = 0;
+    while (true)
+    {
+        io.out() << "\n=== WAVE HUNGER GAME ===\n1. Start New Game\n2. Quit\n";
+        if (hall)
+            io.out() << "3. Join a Co-op Party\n";
+        int menuChoice = co_await askChoice(io, 1, hall ? 3 : 2, hall ? "Choose (1-3): " : "Choose (1-2): ");
+        if (menuChoice == 2)
+        {
+            io.out() << "Thank you for playing!\n";
+            co_return;
+        }
+
+        int partySize = 1;
+        if (menuChoice == 3)
+            partySize = co_await askChoice(io, PARTY_MIN, PARTY_MAX, "Party size (2-4): ");
+
+        io.out() << "\nSelect a class:\n"
+                 << "1. Warrior (High HP, Medium MP, Physical skills)\n"
+                 << "2. Archer (Medium HP, Poison/Bleed skills)\n"
+                 << "3. Mage (Low HP, High MP, Magic skills)\n";
+        int classChoice = co_await askChoice(io, 1, 3, "Choose (1-3): ");
+
+        if (partySize > 1)
+        {
+            co_await io.moveTo(PARTY_WORKER); // Every lobby member has to be on the hall's thread
+            PartyTicket ticket(*hall, io, partySize, classChoice);
+            co_await ticket; // Until the party's run is over
+            continue;
+        }
+
+        unique_ptr<GameContext> game = make_unique<GameContext>();
+        game->headless = true;
+        game->endless = endless;
+        uint64_t runSeed = mixSeed(seed, runs++); // Every run of the visit gets fresh dice
+        game->rng.reseed(runSeed);
+        Unit *hero = createPlayerOfClass(game->arena, classChoice, "Hero");
+        GameResult result = co_await playRun(io, *game, hero);
+        if (board)
+            board->report(RunRecord::of(result, *hero, classChoice, runSeed));
+    }
+}
+
+/**
+ * @brief One remote player's game, suspended between input lines.
+ *
+ * The session never waits: handleLine() resumes its coroutine, which runs
+ * until it needs the next decision and writes what the player should see.
+ * Between lines the session is just a suspended coroutine frame; the
+ * GameContext (and its arena) only exists while a run is in progress.
+ * Output collects in the session until takeOutput(), since a co-op party
+ * also writes to its members when someone else's line or a deadline moves
+ * the run on.
+ */
+class GameSession
+{
+private:
+    ostringstream outbox;
+    SessionIo io;
+    Task<> task;
+
+public:
+    GameSession(uint64_t seed, bool endless, Leaderboard *board, PartyHall *hall = nullptr)
+        : io(outbox, nullptr, false), task(runSession(io, seed, endless, board, hall)) {}
+
+    // Runs the session on `worker`'s loop, reporting it on `written` whenever it has new output for `fd`
+    void attach(int worker, int fd, vector<int> &written) { io.attach(worker, fd, written); }
+
+    void greet() { task.start(); }
+    bool isClosed() const { return task.done(); }
+
+    // The session is about to join a party and waits to be handed to PARTY_WORKER
+    bool isMoving() const { return io.moving(); }
+    void arrived() { io.arrived(); }
+
+    /** @brief Feeds one line of client input; the response waits in takeOutput(). */
+    void handleLine(const string &line) { io.pushLine(line); }
+
+    string takeOutput()
+    {
+        string text = outbox.str();
+        outbox.str("");
+        io.outputTaken();
+        return text;
+    }
+};
+
+#ifdef __linux__
+/**
+ * @brief A client socket and its session; buffers hold only unsent or unparsed bytes.
+ */
+struct Connection
+{
+    int fd;
+    GameSession session;
+    string input;
+    string output;
+    bool wantWrite = false;
+
+    Connection(int f, uint64_t seed, bool endless, Leaderboard *board, PartyHall *hall)
+        : fd(f), session(seed, endless, board, hall) {}
+};
+
+const size_t MAX_INPUT_LINE = 256; // Clients sending longer lines are dropped
+
+/**
+ * @brief Connections on their way to PARTY_WORKER. Other workers push a
+ * connection whose session is moving; the eventfd wakes PARTY_WORKER's
+ * loop, which takes them over with their unsent output and unread input.
+ * A session stays on PARTY_WORKER once it has moved there.
+ */
+class Handoff
+{
+private:
+    mutex lock;
+    vector<unique_ptr<Connection>> arriving;
+
+public:
+    const int wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    Handoff() = default;
+    Handoff(const Handoff &) = delete;
+    Handoff &operator=(const Handoff &) = delete;
+    ~Handoff() { close(wakeFd); }
+
+    void send(unique_ptr<Connection> conn)
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            arriving.push_back(move(conn));
+        }
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t n = write(wakeFd, &one, sizeof(one));
+    }
+
+    vector<unique_ptr<Connection>> receive()
+    {
+        uint64_t count;
+        [[maybe_unused]] ssize_t n = read(wakeFd, &count, sizeof(count));
+        lock_guard<mutex> guard(lock);
+        return exchange(arriving, {});
+    }
+};
+
+int openListenSocket(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+        return -1;
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief One worker's event loop: accepts on its own SO_REUSEPORT socket and
+ * drives every session it owns from epoll readiness, never blocking on a client.
+ * Sessions joining a party are handed to PARTY_WORKER, which alone runs `hall`.
+ */
+void serveWorker(int listenFd, int worker, int workers, uint64_t seed, bool endless, Leaderboard *board,
+                 PartyHall &hall, Handoff &handoff)
+{
+    int epollFd = epoll_create1(0);
+    epoll_event listenEvent = {};
+    listenEvent.events = EPOLLIN;
+    listenEvent.data.fd = listenFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent);
+
+    bool runsParties = worker == PARTY_WORKER;
+    if (runsParties)
+    {
+        epoll_event wakeEvent = {};
+        wakeEvent.events = EPOLLIN;
+        wakeEvent.data.fd = handoff.wakeFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, handoff.wakeFd, &wakeEvent);
+    }
+
+    vector<int> written; // Connections whose sessions wrote during this batch
+    // Connections and parties draw from separate streams, so their seeds do not line up
+    uint64_t connectionSeeds = mixSeed(seed, 0);
+    vector<unique_ptr<Connection>> connections; // Indexed by fd; declared last, as its sessions refer to `written`
+    long long accepted = 0;
+    int spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC); // Given up to shed a client when out of descriptors
+
+    auto watch = [&](Connection &conn, bool wantWrite)
+    {
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP | (wantWrite ? (uint32_t)EPOLLOUT : 0u);
+        event.data.fd = conn.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, conn.fd, &event);
+        conn.wantWrite = wantWrite;
+    };
+
+    auto drop = [&](int fd)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        connections[fd].reset();
+    };
+
+    // Takes over a connection accepted here or handed over by another worker
+    auto adopt = [&](unique_ptr<Connection> conn)
+    {
+        int fd = conn->fd;
+        if (fd >= (int)connections.size())
+            connections.resize(fd + 1);
+        connections[fd] = move(conn);
+
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        connections[fd]->wantWrite = false;
+        connections[fd]->session.attach(worker, fd, written);
+    };
+
+    // Feeds the session the complete lines received so far, stopping if it closes or starts moving
+    auto feed = [&](Connection &conn)
+    {
+        size_t start = 0, newline;
+        while (!conn.session.isClosed() && !conn.session.isMoving() &&
+               (newline = conn.input.find('\n', start)) != string::npos)
+        {
+            conn.session.handleLine(conn.input.substr(start, newline - start));
+            start = newline + 1;
+        }
+        conn.input.erase(0, start);
+    };
+
+    // Sends as much pending output as the socket takes; false if the connection is gone
+    auto flush = [&](Connection &conn)
+    {
+        size_t sent = 0;
+        while (sent < conn.output.size())
+        {
+            ssize_t n = send(conn.fd, conn.output.data() + sent, conn.output.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            if (n <= 0)
+                return false;
+            sent += n;
+        }
+        conn.output.erase(0, sent);
+        bool pending = !conn.output.empty();
+        if (pending != conn.wantWrite)
+            watch(conn, pending);
+        return !(conn.output.empty() && conn.session.isClosed());
+    };
+
+    epoll_event events[256];
+    while (true)
+    {
+        int timeout = runsParties ? hall.msUntilDeadline(chrono::steady_clock::now()) : -1;
+        int ready = epoll_wait(epollFd, events, 256, timeout);
+        if (ready < 0 && errno != EINTR)
+        {
+            cerr << "Worker " << worker << " stopped: " << strerror(errno) << "\n";
+            return;
+        }
+        for (int e = 0; e < ready; e++)
+        {
+            int fd = events[e].data.fd;
+            if (fd == listenFd)
+            {
+                while (true)
+                {
+                    int client = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+                    if (client < 0 && (errno == EMFILE || errno == ENFILE) && spareFd >= 0)
+                    {
+                        // Out of descriptors: accept and hang up with the spare one, or the
+                        // pending client keeps the listen socket readable and the loop spins
+                        close(spareFd);
+                        int refused = accept(listenFd, nullptr, nullptr);
+                        if (refused >= 0)
+                            close(refused);
+                        spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                        if (refused < 0)
+                            break; // The queue was empty; accept reports EMFILE before looking
+                        continue;
+                    }
+                    if (client < 0)
+                        break;
+                    if (spareFd < 0)
+                        spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+                    adopt(make_unique<Connection>(client, mixSeed(connectionSeeds, accepted++ * workers + worker),
+                                                  endless, board, &hall));
+                    connections[client]->session.greet();
+                }
+                continue;
+            }
+            if (runsParties && fd == handoff.wakeFd)
+            {
+                for (unique_ptr<Connection> &arrival : handoff.receive())
+                {
+                    Connection &conn = *arrival;
+                    adopt(move(arrival));
+                    conn.session.arrived();
+                    feed(conn); // Lines typed ahead while the connection was on its way
+                    if (conn.input.size() > MAX_INPUT_LINE)
+                        drop(conn.fd);
+                }
+                continue;
+            }
+
+            if (!connections[fd])
+                continue; // Dropped earlier in this batch
+            Connection &conn = *connections[fd];
+            bool alive = !(events[e].events & EPOLLERR);
+
+            if (alive && (events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)))
+            {
+                char buffer[512];
+                ssize_t n;
+                while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+                    conn.input.append(buffer, n);
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+                    alive = false;
+
+                feed(conn);
+                // A moving session has stopped reading; its new worker feeds the rest
+                if (conn.input.size() > MAX_INPUT_LINE && !conn.session.isMoving())
+                    alive = false;
+            }
+
+            if (alive && (events[e].events & EPOLLOUT))
+                alive = flush(conn);
+            if (!alive)
+            {
+                drop(fd);
+            }
+            else if (conn.session.isMoving())
+            {
+                // Its output so far goes along: the session's outbox and any unsent bytes
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+                handoff.send(move(connections[fd]));
+            }
+        }
+
+        // Sessions write from other connections' lines and party deadlines too, so
+        // output is collected once per batch; a drop here may list more sessions
+        if (runsParties)
+            hall.poll(chrono::steady_clock::now());
+        for (size_t i = 0; i < written.size(); i++)
+        {
+            int fd = written[i];
+            if (!connections[fd])
+                continue;
+            Connection &conn = *connections[fd];
+            conn.output += conn.session.takeOutput();
+            if (!flush(conn))
+                drop(fd);
+        }
+        written.clear();
+    }
+}
+
+/**
+ * @brief Hosts sessions on `port` with `workers` event-loop threads until killed.
+ * @param leaderboardPath If set, finished runs go on a leaderboard restored
+ * from this file and rewritten to it every LEADERBOARD_SNAPSHOT_SECONDS
+ * @return Process exit code; returns on setup failure, or once every worker's event loop has failed.
+ */
+int runServer(int port, int workers, uint64_t seed, bool endless, const string &leaderboardPath = "")
+{
+    Leaderboard board;
+    Leaderboard *reporting = leaderboardPath.empty() ? nullptr : &board;
+    if (reporting && !board.restore(leaderboardPath))
+    {
+        cerr << "Cannot restore leaderboard " << leaderboardPath << ": not a leaderboard snapshot\n";
+        return 1;
+    }
+
+    vector<int> listenFds;
+    for (int w = 0; w < workers; w++)
+    {
+        int fd = openListenSocket(port);
+        if (fd < 0)
+        {
+            cerr << "Cannot listen on port " << port << ": " << strerror(errno) << "\n";
+            return 1;
+        }
+        listenFds.push_back(fd);
+    }
+
+    cout << "Serving Wave Hunger Game on port " << port << " with " << workers << " worker(s)\n";
+
+    // One lobby for the whole server, run by PARTY_WORKER; declared before `handoff`, whose connections may refer to it
+    PartyHall hall(mixSeed(seed, 1), endless, reporting);
+    Handoff handoff;
+
+    // The snapshot thread uses `board`, so it is stopped and joined before runServer returns
+    mutex stopLock;
+    condition_variable stopSignal;
+    bool stopping = false;
+    thread snapshots;
+    if (reporting)
+        snapshots = thread([&]
+                           {
+                               unique_lock<mutex> lock(stopLock);
+                               while (!stopSignal.wait_for(lock, chrono::seconds(LEADERBOARD_SNAPSHOT_SECONDS),
+                                                           [&] { return stopping; }))
+                               {
+                                   if (!board.save(leaderboardPath))
+                                       cerr << "Cannot write leaderboard " << leaderboardPath << "\n";
+                               }
+                           });
+
+    vector<thread> pool;
+    for (int w = 1; w < workers; w++)
+        pool.emplace_back(serveWorker, listenFds[w], w, workers, seed, endless, reporting, ref(hall), ref(handoff));
+    serveWorker(listenFds[0], 0, workers, seed, endless, reporting, hall, handoff);
+    for (thread &th : pool)
+        th.join();
+
+    if (snapshots.joinable())
+    {
+        {
+            lock_guard<mutex> lock(stopLock);
+            stopping = true;
+        }
+        stopSignal.notify_one();
+        snapshots.join();
+        if (!board.save(leaderboardPath))
+            cerr << "Cannot write leaderboard " << leaderboardPath << "\n";
+    }
+    return 0;
+}
+#else
+int runServer(int, int, uint64_t, bool, const string & = "")
+{
+    cerr << "Server mode needs epoll and is only available on Linux.\n";
+    return 1;
+}
+#endif
+
+// ========== UI Functions ==========
+void printLogo()
+{
+    cout << "\033[1;35m";
+    cout << R"(
+__        __  _    _  _____
+\ \      / //| |  | |/ ____|
+ \ \ /\ / /  | |__| || |  __
+  \ V  V /   |  __  || | |_ |
+   \_/\_/    |_|  |_| \_____|
+             |_|  |_| \_____|
+)" << '\n';
+    cout << "\033[0m";
+}
+
+void showIntro()
+{
+    clearScreen();
+    animateText("\nInitializing Wave HG Universe...\n", 30);
+    waitFor(800);
+    clearScreen();
+    for (int i = 0; i < 3; i++)
+    {
+        cout << "\n\n\n\n";
+        waitFor(200);
+        clearScreen();
+    }
+    printLogo();
+    animateText("\nText base game\n\n", 40);
+    waitFor(2000);
+}
+
+void showMainMenu(int turboPercent)
+{
+    clearScreen();
+    printLogo();
+    animateText("\nWelcome to Wave Hunger Game Turn Based RPG!\n\n");
+    cout << "1. Start New Game\n2. How to Play\n3. Turbo Mode: ";
+    if (delayPercent == 100)
+        cout << "OFF\n";
+    else
+        cout << "ON (" << turboPercent << "% delays)\n";
+    cout << "4. Exit\n";
+}
+
+void showHowToPlay()
+{
+    clearScreen();
+    printLogo();
+    animateText("WELCOME TO Wave Hunger Game Turn Based RPG!\n\n");
+
+    animateText("HOW TO PLAY: \n", 10);
+    animateText("- Choose your class: Warrior, Archer, or Mage\n", 10);
+    animateText("- Battle against bosses in turn-based combat\n", 10);
+    animateText("- Use normal attacks or powerful skills (consume MP)\n", 10);
+    animateText("- Use inventory items to recover HP or MP\n", 10);
+    animateText("- Win by defeating all 5 bosses!\n\n", 10);
+
+    animateText("KEY SYSTEMS:\n"), 10;
+    animateText("- Coin flip determines turn order each battle\n", 10);
+    animateText("- Upgrade system: Choose buffs after each win (Heal, MP, ATK, DEF)\n", 10);
+    animateText("- Loot system: Pick 1 of 3 random powerful items\n", 10);
+    animateText("- Status effects like Poison, Bleed, Stun add strategy\n\n", 10);
+
+    animateText("GOOD LUCK, HERO!\n");
+
+    animateText("Press Enter to return to main menu...");
+    waitForEnter();
+}
+
+// Plays one run on the terminal through the coroutine pipeline
+void playConsoleGame(GameContext &ctx, Unit *player, Replay &replay)
+{
+    Scheduler scheduler;
+    SessionIo io(cout, &scheduler, true);
+    io.typedAhead = move(consoleInput.typedAhead); // Choices typed ahead at the menus carry into the game
+    scheduler.spawn(playConsoleRun(io, ctx, player, replay));
+    scheduler.run();
+    consoleInput.typedAhead = move(io.typedAhead);
+}
+
+constexpr int METRICS_EXPORT_SECONDS = 10; // How often --serve rewrites the --metrics file
+
+// ========== Command Line ==========
+struct CommandLineOptions
+{
+    long long simulateGames = 0; // --simulate <games>: run headless batches instead of the menu
+    int simulateClass = 1;       // --class <1-3>: hero class used by --simulate and --batch
+    long long batchBattles = 0;  // --batch <battles>: run single-stage battles in a BattleBatch
+    int batchStage = 1;          // --stage <1-5>: stage fought by --batch
+    int threads = max(1u, thread::hardware_concurrency()); // --threads <n>
+    uint64_t seed = random_device{}() ^ (uint64_t)time(0); // --seed <n>: fixed seed for reproducible runs
+    bool verify = false;         // --verify: self-check the optimized combat paths and exit
+    int servePort = 0;           // --serve <port>: host remote sessions over TCP instead of the menu
+    string recordPath;           // --record <file>: append a replay of every game played (or simulated)
+    string replayPath;           // --replay <file>: verify every replay in an archive and exit
+    string savePath;             // --save <file>: checkpoint console games after every cleared stage
+    string loadPath;             // --load <file>: resume a saved game before showing the menu
+    int searchDepth = 0;         // --search [depth]: --simulate with the expectimax player (default 3 rounds)
+    int waveSize = 0;            // --waves <n>: minions beside every boss in console games and --simulate
+    bool endless = false;        // --endless: runs go on past stage 5 (console, --simulate and --serve)
+    long long benchIterations = 0; // --bench [baseline]: run the benchmarks (and gate on a baseline file) and exit
+    string benchBaseline;
+    long long sweepSeeds = 0;    // --sweep <seeds> [file]: play every class/upgrade/item strategy, write a CSV and exit
+    string sweepPath = "sweep.csv";
+    int solveStage = -1;         // --solve [stage]: exact win probabilities for one stage (0 = all five) and exit
+    size_t solveMemory = SOLVER_DEFAULT_MEMORY; // --solve-memory <MiB>: bound on the solver's memo table
+    string contentPath;          // --content <pack>: play with the bosses, skills, items and stats of a content pack
+    string contentSource;        // --build-content <source> <pack>: compile a content source into a pack and exit
+    string contentPack;
+    string exportPath;           // --export-content <source>: write the content in use as an editable source and exit
+    string leaderboardPath;      // --leaderboard <file>: rank finished --serve runs, snapshotted to this file
+    string scriptPath;           // --script <file>: answer console prompts from this file before the keyboard
+    string metricsPath;          // --metrics <file>: time the game phases and export them (Prometheus, or JSON for *.json)
+    bool turbo = false;          // --turbo [percent]: start with delays scaled down (0 skips them)
+    int turboPercent = TURBO_DELAY_PERCENT;
+};
+
+CommandLineOptions parseCommandLine(int argc, char *argv[])
+{
+    CommandLineOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--simulate" && hasValue)
+            options.simulateGames = max(0LL, atoll(argv[++i]));
+        else if (arg == "--class" && hasValue)
+            options.simulateClass = clamp(atoi(argv[++i]), 1, 3);
+        else if (arg == "--batch" && hasValue)
+            options.batchBattles = max(0LL, atoll(argv[++i]));
+        else if (arg == "--stage" && hasValue)
+            options.batchStage = clamp(atoi(argv[++i]), 1, 5);
+        else if (arg == "--verify")
+            options.verify = true;
+        else if (arg == "--turbo")
+        {
+            options.turbo = true;
+            if (hasValue && isdigit((unsigned char)argv[i + 1][0]))
+                options.turboPercent = clamp(atoi(argv[++i]), 0, 99);
+        }
+        else if (arg == "--search")
+        {
+            options.searchDepth = 3;
+            if (hasValue && isdigit((unsigned char)argv[i + 1][0]))
+                options.searchDepth = clamp(atoi(argv[++i]), 1, 8);
+        }
+        else if (arg == "--bench")
+        {
+            options.benchIterations = 2000000;
+            if (hasValue && argv[i + 1][0] != '-')
+                options.benchBaseline = argv[++i];
+        }
+        else if (arg == "--solve")
+        {
+            options.solveStage = 0;
+            if (hasValue && isdigit((unsigned char)argv[i + 1][0]))
+                options.solveStage = clamp(atoi(argv[++i]), 1, 5);
+        }
+        else if (arg == "--solve-memory" && hasValue)
+            options.solveMemory = (size_t)max(1LL, atoll(argv[++i])) << 20;
+        else if (arg == "--sweep" && hasValue)
+        {
+            options.sweepSeeds = max(0LL, atoll(argv[++i]));
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                options.sweepPath = argv[++i];
+        }
+        else if (arg == "--endless")
+            options.endless = true;
+        else if (arg == "--waves" && hasValue)
+            options.waveSize = clamp(atoi(argv[++i]), 0, 10000);
+        else if (arg == "--content" && hasValue)
+            options.contentPath = argv[++i];
+        else if (arg == "--build-content" && i + 2 < argc)
+        {
+            options.contentSource = argv[++i];
+            options.contentPack = argv[++i];
+        }
+        else if (arg == "--export-content" && hasValue)
+            options.exportPath = argv[++i];
+        else if (arg == "--leaderboard" && hasValue)
+            options.leaderboardPath = argv[++i];
+        else if (arg == "--script" && hasValue)
+            options.scriptPath = argv[++i];
+        else if (arg == "--metrics" && hasValue)
+            options.metricsPath = argv[++i];
+        else if (arg == "--record" && hasValue)
+            options.recordPath = argv[++i];
+        else if (arg == "--replay" && hasValue)
+            options.replayPath = argv[++i];
+        else if (arg == "--save" && hasValue)
+            options.savePath = argv[++i];
+        else if (arg == "--load" && hasValue)
+            options.loadPath = argv[++i];
+        else if (arg == "--serve" && hasValue)
+            options.servePort = clamp(atoi(argv[++i]), 0, 65535);
+        else if (arg == "--threads" && hasValue)
+            options.threads = max(1, atoi(argv[++i]));
+        else if (arg == "--seed" && hasValue)
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        else
+            cerr << "Ignoring unknown option: " << arg << "\n";
+    }
+    return options;
+}
+
+#if !WHG_FUZZ
+int main(int argc, char *argv[])
+{
+    enableAnsiEscapes();
+    CommandLineOptions options = parseCommandLine(argc, argv);
+
+    if (!options.contentSource.empty())
+        return buildContentPack(options.contentSource, options.contentPack);
+    if (!options.contentPath.empty() && !loadContentPack(options.contentPath))
+        return 1;
+    if (!options.exportPath.empty())
+    {
+        if (exportContent(options.exportPath))
+            return 0;
+        cerr << "Cannot write content source " << options.exportPath << "\n";
+        return 1;
+    }
+
+    if (!options.metricsPath.empty())
+        enablePhaseMetrics();
+    auto exportMetrics = [&options]
+    {
+        if (phaseMetricsEnabled && !writePhaseMetrics(options.metricsPath))
+            cerr << "Cannot write metrics to " << options.metricsPath << "\n";
+    };
+
+    if (!options.replayPath.empty())
+    {
+        int status = verifyReplayArchive(options.replayPath, options.threads);
+        exportMetrics();
+        return status;
+    }
+
+    if (options.simulateGames > 0)
+    {
+        vector<string> records;
+        bool recording = !options.recordPath.empty() && !options.endless;
+        if (options.endless && !options.recordPath.empty())
+            cerr << "Endless runs are not recorded; ignoring --record\n";
+        auto start = chrono::steady_clock::now();
+        BatchStats stats = runSimulations(options.simulateGames, options.simulateClass,
+                                          options.threads, options.seed, recording ? &records : nullptr,
+                                          options.searchDepth, options.waveSize, options.endless);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        printBatchStats(stats, elapsed.count());
+        exportMetrics();
+
+        if (recording)
+        {
+            string archive;
+            for (const string &record : records)
+                archive += record;
+            if (!appendToFile(options.recordPath, archive))
+                cerr << "Cannot write replays to " << options.recordPath << "\n";
+        }
+        return 0;
+    }
+
+    if (options.solveStage >= 0)
+    {
+        runWinSolver(max(1, options.solveStage), options.solveStage > 0 ? options.solveStage : 5, options.solveMemory);
+        return 0;
+    }
+
+    if (options.sweepSeeds > 0)
+    {
+        int status = runBalanceSweep(options.sweepSeeds, options.threads, options.seed, options.sweepPath,
+                                     options.waveSize, options.endless);
+        exportMetrics();
+        return status;
+    }
+
+    if (options.benchIterations > 0)
+    {
+        return reportBenchmarks(runBenchmarks(options.benchIterations, options.seed), options.benchBaseline);
+    }
+
+    if (options.verify)
+    {
+        bool kernelsMatch = verifyCombatKernels(options.seed);
+        bool snapshotMatches = verifyBattleSnapshot(options.seed);
+        bool enginesAgree = verifyDifferential(options.seed);
+        bool partyWaveClears = verifyPartyWave(options.seed);
+        return kernelsMatch && snapshotMatches && enginesAgree && partyWaveClears ? 0 : 1;
+    }
+
+    if (options.batchBattles > 0)
+    {
+        runBatchedBattles(options.batchBattles, options.simulateClass, options.batchStage, options.seed);
+        exportMetrics();
+        return 0;
+    }
+
+    if (options.servePort > 0)
+    {
+        // The server runs until it is killed, so the file is refreshed on a timer
+        if (phaseMetricsEnabled)
+            thread([exportMetrics]
+                   {
+                       while (true)
+                       {
+                           this_thread::sleep_for(chrono::seconds(METRICS_EXPORT_SECONDS));
+                           exportMetrics();
+                       }
+                   }).detach();
+        return runServer(options.servePort, options.threads, options.seed, options.endless, options.leaderboardPath);
+    }
+
+    if (options.turbo)
+        delayPercent = options.turboPercent;
+
+    if (!options.scriptPath.empty())
+    {
+        ifstream script(options.scriptPath);
+        if (!script)
+        {
+            cerr << "Cannot open script " << options.scriptPath << "\n";
+            return 1;
+        }
+        for (string line; getline(script, line);)
+            consoleInput.scriptLines.push_back(line);
+    }
+
+    if (!options.loadPath.empty())
+    {
+        GameContext ctx;
+        ctx.headless = true;
+        ctx.savePath = options.savePath;
+        ctx.waveSize = options.waveSize;
+        Unit *player = loadGame(options.loadPath, ctx);
+        if (!player)
+            return 1;
+
+        // A resumed run does not start from its seed, so it is never recorded as a replay
+        showIntro();
+        Replay replay;
+        playConsoleGame(ctx, player, replay);
+        animateText("\nPress Enter to return to main menu...");
+        waitForEnter();
+    }
+    else
+    {
+        showIntro();
+    }
+
+    long long gamesPlayed = 0;
+    while (true)
+    {
+        showMainMenu(options.turboPercent);
+        int choice = getValidInput(1, 4, "Choose (1-4): ");
+
+        switch (choice)
+        {
+        case 1:
+        {
+            clearScreen();
+            printLogo();
+            string playerName;
+            animateText("\nEnter your hero's name: ");
+            readConsoleText(playerName);
+
+            GameContext ctx;
+            ctx.headless = true; // The coroutine pipeline does all the printing and waiting
+            ctx.savePath = options.savePath;
+            ctx.waveSize = options.waveSize;
+            ctx.endless = options.endless;
+            int classChoice = chooseClass(playerName);
+            Unit *player = createPlayerOfClass(ctx.arena, classChoice, playerName);
+            clearScreen();
+            printLogo();
+            animateText("\nPreparing for battle...\n");
+            waitFor(1000);
+
+            uint64_t runSeed = gameSeed(options.seed, gamesPlayed++);
+            ctx.rng.reseed(runSeed);
+            Replay replay;
+            replay.begin(runSeed, classChoice, ctx.waveSize);
+
+            playConsoleGame(ctx, player, replay);
+            if (!options.recordPath.empty() && replay.stageReached > 0)
+                appendToFile(options.recordPath, encodeReplay(replay));
+            exportMetrics();
+
+            animateText("\nPress Enter to return to main menu...");
+            waitForEnter();
+            break;
+        }
+        case 2:
+            showHowToPlay();
+            break;
+        case 3:
+            delayPercent = delayPercent == 100 ? options.turboPercent : 100;
+            break;
+        case 4:
+            clearScreen();
+            printLogo();
+            animateText("\nThanks for playing Wave Hunger Game Turn Based RPG!\n");
+            animateText("May your adventures continue...\n");
+            exportMetrics();
+            return 0;
+        }
+    }
+}
+#endif